@@ -10,9 +10,46 @@ struct Stats {
     uint64_t cond_signals;
     uint64_t cond_broadcasts;
 
+    uint64_t allocations;
+    uint64_t deallocations;
+    uint64_t allocated_bytes;
+
     Stats ReadImprecise() const;
 };
 
 Stats& GlobalStats();
 
 std::ostream& operator<<(std::ostream& os, const Stats& stats);
+
+struct AllocStats {
+    uint64_t allocations;
+    uint64_t deallocations;
+    uint64_t allocated_bytes;
+};
+
+// Whether malloc and operator new are counted. They are not under sanitizers,
+// which interpose the allocator themselves.
+bool AllocationsTracked();
+
+// Allocations made by the calling thread so far
+AllocStats ThreadAllocStats();
+
+// Counts the allocations made while it is alive, either by all threads or by
+// the calling one only. To assert that a region does not allocate.
+struct AllocationRegion {
+    enum class Scope {
+        Global,
+        Thread,
+    };
+
+    explicit AllocationRegion(Scope scope = Scope::Global);
+
+    uint64_t Allocations() const;
+    uint64_t Bytes() const;
+
+  private:
+    AllocStats Now() const;
+
+    Scope scope_;
+    AllocStats start_;
+};
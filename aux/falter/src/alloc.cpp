@@ -0,0 +1,184 @@
+#include <falter/interface.hpp>
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdlib>
+#include <new>
+
+// The allocator is interposed by calling into the glibc one directly, rather
+// than through dlsym, which allocates itself
+
+extern "C" {
+void* __libc_malloc(size_t size);
+void* __libc_calloc(size_t n, size_t size);
+void* __libc_realloc(void* ptr, size_t size);
+void* __libc_memalign(size_t align, size_t size);
+void __libc_free(void* ptr);
+}
+
+// Initial-exec, so that touching it never allocates
+__attribute__((tls_model("initial-exec"))) static thread_local AllocStats
+    thread_stats{};
+
+#if !defined(ASAN) && !defined(TSAN)
+
+static void Add(uint64_t& where, uint64_t val) {
+    std::atomic_ref{where}.fetch_add(val, std::memory_order_relaxed);
+}
+
+static void CountAllocation(size_t size) {
+    Add(GlobalStats().allocations, 1);
+    Add(GlobalStats().allocated_bytes, size);
+    ++thread_stats.allocations;
+    thread_stats.allocated_bytes += size;
+}
+
+static void CountDeallocation(void* ptr) {
+    if (ptr != nullptr) {
+        Add(GlobalStats().deallocations, 1);
+        ++thread_stats.deallocations;
+    }
+}
+
+extern "C" void* malloc(size_t size) {
+    CountAllocation(size);
+    return __libc_malloc(size);
+}
+
+extern "C" void* calloc(size_t n, size_t size) {
+    CountAllocation(n * size);
+    return __libc_calloc(n, size);
+}
+
+extern "C" void* realloc(void* ptr, size_t size) {
+    CountDeallocation(ptr);
+    CountAllocation(size);
+    return __libc_realloc(ptr, size);
+}
+
+extern "C" void* memalign(size_t align, size_t size) {
+    CountAllocation(size);
+    return __libc_memalign(align, size);
+}
+
+extern "C" void* aligned_alloc(size_t align, size_t size) {
+    return memalign(align, size);
+}
+
+extern "C" int posix_memalign(void** ptr, size_t align, size_t size) {
+    if (align % sizeof(void*) != 0 || (align & (align - 1)) != 0) {
+        return EINVAL;
+    }
+    *ptr = memalign(align, size);
+    return *ptr != nullptr ? 0 : ENOMEM;
+}
+
+extern "C" void free(void* ptr) {
+    CountDeallocation(ptr);
+    __libc_free(ptr);
+}
+
+static void* New(size_t size, size_t align = 0) {
+    auto* ptr = align == 0 ? malloc(size) : memalign(align, size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc{};
+    }
+    return ptr;
+}
+
+void* operator new(size_t size) {
+    return New(size);
+}
+
+void* operator new[](size_t size) {
+    return New(size);
+}
+
+void* operator new(size_t size, std::align_val_t align) {
+    return New(size, static_cast<size_t>(align));
+}
+
+void* operator new[](size_t size, std::align_val_t align) {
+    return New(size, static_cast<size_t>(align));
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return malloc(size);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return malloc(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+    free(ptr);
+}
+
+bool AllocationsTracked() {
+    return true;
+}
+
+#else
+
+bool AllocationsTracked() {
+    return false;
+}
+
+#endif
+
+AllocStats ThreadAllocStats() {
+    return thread_stats;
+}
+
+AllocationRegion::AllocationRegion(Scope scope)
+    : scope_(scope), start_(Now()) {
+}
+
+uint64_t AllocationRegion::Allocations() const {
+    return Now().allocations - start_.allocations;
+}
+
+uint64_t AllocationRegion::Bytes() const {
+    return Now().allocated_bytes - start_.allocated_bytes;
+}
+
+AllocStats AllocationRegion::Now() const {
+    if (scope_ == Scope::Thread) {
+        return ThreadAllocStats();
+    }
+    auto stats = GlobalStats().ReadImprecise();
+    return {
+        .allocations = stats.allocations,
+        .deallocations = stats.deallocations,
+        .allocated_bytes = stats.allocated_bytes,
+    };
+}
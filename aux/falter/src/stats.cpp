@@ -14,6 +14,9 @@ Stats Stats::ReadImprecise() const {
         .cond_waits = Load(cond_waits),
         .cond_signals = Load(cond_signals),
         .cond_broadcasts = Load(cond_broadcasts),
+        .allocations = Load(allocations),
+        .deallocations = Load(deallocations),
+        .allocated_bytes = Load(allocated_bytes),
     };
 }
 
@@ -23,6 +26,9 @@ static Stats stats_{
     .cond_waits = 0,
     .cond_signals = 0,
     .cond_broadcasts = 0,
+    .allocations = 0,
+    .deallocations = 0,
+    .allocated_bytes = 0,
 };
 
 Stats& GlobalStats() {
@@ -36,6 +42,9 @@ std::ostream& operator<<(std::ostream& os, const Stats& s) {
     os << "timed_locks: " << stats.timed_locks << ", ";
     os << "cond_waits: " << stats.cond_waits << ", ";
     os << "cond_signals: " << stats.cond_signals << ", ";
-    os << "cond_broadcasts: " << stats.cond_broadcasts << "}";
+    os << "cond_broadcasts: " << stats.cond_broadcasts << ", ";
+    os << "allocations: " << stats.allocations << ", ";
+    os << "deallocations: " << stats.deallocations << ", ";
+    os << "allocated_bytes: " << stats.allocated_bytes << "}";
     return os;
 }
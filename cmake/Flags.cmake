@@ -8,3 +8,6 @@ elseif("${CMAKE_BUILD_TYPE}" STREQUAL "Tsan")
     add_link_options(-fsanitize=thread)
 endif()
 
+if(PROTO_CORO_AVX2)
+    add_compile_options(-mavx2)
+endif()
@@ -0,0 +1,202 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/event-loop/fail.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/http/file-cache.hpp>
+#include <proto-coro/io/buf-writer.hpp>
+#include <proto-coro/io/io.hpp>
+#include <proto-coro/pc.hpp>
+#include <proto-coro/thread/event.hpp>
+
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Sends a file over loopback TCP again and again, the ways a server may:
+// - copy: pread into memory and write it through a BufWriter
+// - sendfile: straight from the page cache, FileCache with nothing mapped
+// - mapped: a single write from the mapping in FileCache
+
+enum class Mode {
+    Copy,
+    SendFile,
+    Mapped,
+};
+
+struct SendTimes : Pc {
+    SendTimes(const RegisteredFd& fd, Mode mode, const StaticFile& file,
+              int times)
+        : fd_(fd), mode_(mode), file_(file), times_(times) {
+    }
+
+    PROTO_CORO(IoResult) {
+        PC_BEGIN;
+
+        writer_.emplace(fd_);
+        chunk_.resize(64 * 1024);
+        for (i_ = 0; i_ < times_; ++i_) {
+            if (mode_ == Mode::Copy) {
+                for (offset_ = 0; offset_ < file_.Size();) {
+                    {
+                        auto n = pread(file_.Fd(), chunk_.data(),
+                                       chunk_.size(), offset_);
+                        if (n <= 0) {
+                            return std::unexpected(EIO);
+                        }
+                        offset_ += n;
+                        read_ = n;
+                    }
+                    CALL(auto n, writer_->WriteAll(
+                                     std::span{chunk_}.first(read_)));
+                    if (!n.has_value()) {
+                        return n;
+                    }
+                }
+                CALL(auto n, writer_->Flush());
+                if (!n.has_value()) {
+                    return n;
+                }
+            } else if (mode_ == Mode::SendFile) {
+                CALL(auto n, SendFileAll(fd_, file_.Fd(), 0, file_.Size()));
+                if (!n.has_value()) {
+                    return n;
+                }
+            } else {
+                CALL(auto n, WriteAll(fd_, file_.Data()));
+                if (!n.has_value()) {
+                    return n;
+                }
+            }
+        }
+        return file_.Size() * times_;
+
+        PC_END;
+    }
+
+  private:
+    const RegisteredFd& fd_;
+    Mode mode_;
+    const StaticFile& file_;
+    int times_;
+    int i_ = 0;
+    size_t offset_ = 0;
+    size_t read_ = 0;
+    std::vector<char> chunk_;
+    std::optional<BufWriter> writer_;
+    CALLS(BufWriter::WriteAllOp, BufWriter::FlushOp, SendFileAllOp,
+          WriteAllOp);
+};
+
+// A connected pair over loopback, the server end ready for the loop
+std::pair<RegisteredFd, OwnedFd> Connect(EventLoop& loop) {
+    auto listener = OwnedFd::FromRaw(socket(AF_INET, SOCK_STREAM, 0));
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(addr);
+    if (bind(listener.AsRawFd(), reinterpret_cast<sockaddr*>(&addr), len) ||
+        listen(listener.AsRawFd(), 1) ||
+        getsockname(listener.AsRawFd(), reinterpret_cast<sockaddr*>(&addr),
+                    &len)) {
+        Fail("listen on loopback");
+    }
+
+    auto client = OwnedFd::FromRaw(socket(AF_INET, SOCK_STREAM, 0));
+    if (connect(client.AsRawFd(), reinterpret_cast<sockaddr*>(&addr), len)) {
+        Fail("connect");
+    }
+    int server = accept4(listener.AsRawFd(), nullptr, nullptr,
+                         SOCK_NONBLOCK | SOCK_CLOEXEC);
+    if (server < 0) {
+        Fail("accept");
+    }
+    return {RegisteredFd{OwnedFd::FromRaw(server), &loop}, std::move(client)};
+}
+
+double Measure(EventLoop& loop, Mode mode, const StaticFile& file,
+               int times) {
+    auto [fd, client] = Connect(loop);
+    size_t total = file.Size() * times;
+    std::thread reader{[&client, total] {
+        std::vector<char> buf(256 * 1024);
+        for (size_t left = total; left > 0;) {
+            auto n = read(client.AsRawFd(), buf.data(), buf.size());
+            if (n <= 0) {
+                Fail("read");
+            }
+            left -= n;
+        }
+    }};
+
+    ThreadOneshotEvent done;
+    auto start = Clock::now();
+    auto routine = Spawn{SendTimes{fd, mode, file, times} | FMap{[&](auto res) {
+                             if (!res.has_value()) {
+                                 Fail("send");
+                             }
+                             done.Fire();
+                             return Unit{};
+                         }}};
+    loop.Submit(&routine);
+    done.Wait();
+    reader.join();
+
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    return static_cast<double>(total) / elapsed.count() / (1 << 30);
+}
+
+int main(int argc, char** argv) {
+    size_t size = argc > 1 ? std::atoll(argv[1]) : 1 << 20;
+    int times = argc > 2 ? std::atoi(argv[2]) : 2000;
+    constexpr int kRounds = 3;
+
+    char dir[] = "/tmp/proto-coro-bench-XXXXXX";
+    if (mkdtemp(dir) == nullptr) {
+        Fail("mkdtemp");
+    }
+    std::string path = std::string{dir} + "/file";
+    {
+        auto fd = OwnedFd::FromRaw(
+            open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600));
+        std::string data(size, 'x');
+        if (write(fd.AsRawFd(), data.data(), data.size()) !=
+            static_cast<ssize_t>(size)) {
+            Fail("write the file");
+        }
+    }
+
+    FileCache opened{dir, {.max_mapped_size = 0}};
+    FileCache mapped{dir, {.max_mapped_size = size}};
+    auto open_file = opened.Load("file");
+    auto mapped_file = mapped.Load("file");
+    if (!open_file.has_value() || !mapped_file.has_value() ||
+        !(*mapped_file)->IsMapped()) {
+        Fail("load the file");
+    }
+
+    EventLoop loop{1};
+    loop.Start();
+
+    std::cout << size << " bytes, " << times << " times" << std::endl;
+    for (int round = 0; round < kRounds; ++round) {
+        auto copy = Measure(loop, Mode::Copy, **open_file, times);
+        auto sendfile = Measure(loop, Mode::SendFile, **open_file, times);
+        auto map = Measure(loop, Mode::Mapped, **mapped_file, times);
+        std::cout << "copy: " << copy << " GiB/s, sendfile: " << sendfile
+                  << " GiB/s, mapped: " << map << " GiB/s" << std::endl;
+    }
+
+    loop.Stop();
+    unlink(path.c_str());
+    rmdir(dir);
+}
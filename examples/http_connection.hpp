@@ -0,0 +1,329 @@
+#pragma once
+
+#include <proto-coro/arena.hpp>
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/http/file-cache.hpp>
+#include <proto-coro/http/request.hpp>
+#include <proto-coro/io/buf-reader.hpp>
+#include <proto-coro/io/buffer-pool.hpp>
+#include <proto-coro/io/io.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <sys/uio.h>
+
+#include <algorithm>
+#include <charconv>
+#include <chrono>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// How long a connection may wait for a request or for the client to take
+// the response
+constexpr Duration kIdleTimeout = std::chrono::seconds{30};
+constexpr size_t kMaxHeaderSize = 16 * 1024;
+
+struct Response {
+    using Headers =
+        std::pmr::vector<std::pair<std::string_view, std::string_view>>;
+
+    explicit Response(std::pmr::memory_resource* memory) : headers(memory) {
+    }
+
+    uint16_t status_code = 0;
+    Headers headers;
+    // Header lines sent as they are, each ending with CRLF
+    std::string_view raw_headers;
+    std::span<const char> body;
+    // Sent after the body with sendfile, if any
+    int file_fd = -1;
+    size_t file_size = 0;
+};
+
+inline std::string_view StatusLine(uint16_t status_code) {
+    switch (status_code) {
+    case 200:
+        return "HTTP/1.1 200 OK\r\n";
+    case 204:
+        return "HTTP/1.1 204 No Content\r\n";
+    case 400:
+        return "HTTP/1.1 400 Bad Request\r\n";
+    case 404:
+        return "HTTP/1.1 404 Not Found\r\n";
+    case 408:
+        return "HTTP/1.1 408 Request Timeout\r\n";
+    case 413:
+        return "HTTP/1.1 413 Content Too Large\r\n";
+    case 431:
+        return "HTTP/1.1 431 Request Header Fields Too Large\r\n";
+    case 501:
+        return "HTTP/1.1 501 Not Implemented\r\n";
+    default:
+        return "HTTP/1.1 500 Internal Server Error\r\n";
+    }
+}
+
+// Sends the head and the body with a single writev where the socket takes
+// it, pointing at the header strings and the body rather than copying them.
+// The iovecs are built in iov, which the caller keeps across responses so
+// that its capacity is reused.
+struct WriteResponse : Pc {
+    WriteResponse(const RegisteredFd& fd, const Response& response,
+                  std::pmr::vector<iovec>& iov)
+        : fd_(fd), response_(response), iov_(iov) {
+    }
+
+    PROTO_CORO(IoResult) {
+        PC_BEGIN;
+
+        iov_.clear();
+        iov_.reserve(response_.headers.size() * 4 + 3);
+        Add(StatusLine(response_.status_code));
+        for (const auto& [name, value] : response_.headers) {
+            Add(name);
+            Add(": ");
+            Add(value);
+            Add("\r\n");
+        }
+        Add(response_.raw_headers);
+        {
+            constexpr std::string_view kPrefix = "Content-Length: ";
+            constexpr std::string_view kSuffix = "\r\n\r\n";
+            auto* it = std::copy(kPrefix.begin(), kPrefix.end(), length_);
+            it = std::to_chars(it, std::end(length_),
+                               response_.body.size() + response_.file_size)
+                     .ptr;
+            it = std::copy(kSuffix.begin(), kSuffix.end(), it);
+            Add({length_, it});
+        }
+        Add({response_.body.data(), response_.body.size()});
+
+        {
+            CALL(auto n, WriteAllV(fd_, iov_));
+            if (!n.has_value() || response_.file_fd < 0) {
+                return n;
+            }
+        }
+        {
+            CALL(auto n, SendFileAll(fd_, response_.file_fd, 0,
+                                     response_.file_size));
+            if (n.has_value() && *n < response_.file_size) {
+                // Truncated under us, so the length we sent is a lie
+                return std::unexpected(EIO);
+            }
+            return n;
+        }
+
+        PC_END;
+    }
+
+  private:
+    void Add(std::string_view chunk) {
+        iov_.push_back({const_cast<char*>(chunk.data()), chunk.size()});
+    }
+
+    const RegisteredFd& fd_;
+    const Response& response_;
+    std::pmr::vector<iovec>& iov_;
+    char length_[48];
+    CALLS(WriteAllVOp, SendFileAllOp);
+};
+
+constexpr std::string_view kBodyPrefix = R"(<!doctype html>
+<html lang="en">
+  <head>
+    <meta charset="utf-8">
+    <meta name="viewport" content="width=device-width, initial-scale=1">
+    <title>Title</title>
+  </head>
+  <body><h3>Your header</h3><pre>)";
+
+constexpr std::string_view kBodySuffix = R"(</pre>
+  </body>
+</html>
+)";
+
+// Serves the requests of a connection one after another. The ones a client
+// pipelines are parsed right out of the buffer of the reader. The arena is
+// the one of the connection and never frees, so whatever is allocated from
+// it is made once and reused by every request.
+struct ConnectionServe : Pc {
+    ConnectionServe(RegisteredFd fd, FileCache* files)
+        : fd_(std::move(fd)), files_(files) {
+    }
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        // Coroutines stay in place once started. The whole head of a request
+        // has to fit into the buffer of the reader, which is only held while
+        // a request is in it.
+        reader_.emplace(fd_, BufferPool::Default(), kMaxHeaderSize);
+        request_.emplace(ARENA);
+        response_.emplace(ARENA);
+        body_buf_.emplace(ARENA);
+        iov_.emplace(ARENA);
+
+        while (true) {
+            {
+                CALL(auto head, Timeout(reader_->PeekUntil(kHttpHeadEnd),
+                                        kIdleTimeout));
+                // Idle for too long, gone, or cut off mid-request
+                if (!head.has_value() ||
+                    (!head->has_value() && head->error() != EMSGSIZE) ||
+                    (head->has_value() && !(*head)->ends_with(kHttpHeadEnd))) {
+                    return Unit{};
+                }
+                if (head->has_value()) {
+                    head_ = **head;
+                    auto parsed = ParseHttpRequest(head_, *request_);
+                    status_ = parsed.has_value() ? 200 : parsed.error();
+                } else {
+                    head_ = {};
+                    status_ = 431;
+                }
+                close_ = status_ != 200 || !request_->keep_alive;
+            }
+
+            // Checked before adding to the size of the head, which a length
+            // the client made up could wrap around
+            if (status_ == 200 && request_->content_length >
+                                      reader_->Capacity() - head_.size()) {
+                status_ = 413;
+                close_ = true;
+            }
+            if (status_ == 200 && request_->content_length > 0) {
+                CALL(auto whole,
+                     Timeout(reader_->Peek(head_.size() +
+                                           request_->content_length),
+                             kIdleTimeout));
+                if (!whole.has_value() ||
+                    (!whole->has_value() && whole->error() != EMSGSIZE) ||
+                    (whole->has_value() &&
+                     (*whole)->size() <
+                         head_.size() + request_->content_length)) {
+                    return Unit{};
+                }
+                if (whole->has_value()) {
+                    // Reading the body may have moved the head within the
+                    // buffer, so the request is parsed anew
+                    head_ = (*whole)->substr(0, head_.size());
+                    ParseHttpRequest(head_, *request_);
+                } else {
+                    status_ = 413;
+                    close_ = true;
+                }
+            }
+
+            if (status_ == 200 && IsStatic()) {
+                file_ = files_->Find(StaticPath());
+                if (file_ == nullptr) {
+                    CALL(auto file,
+                         LoadFile(*files_, std::string{StaticPath()}));
+                    if (file.has_value()) {
+                        file_ = std::move(*file);
+                    } else {
+                        status_ = file.error() == ENOENT ||
+                                          file.error() == ENOTDIR
+                                      ? 404
+                                      : 500;
+                    }
+                }
+            }
+
+            Respond();
+            {
+                CALL(auto n, Timeout(WriteResponse{fd_, *response_, *iov_},
+                                     kIdleTimeout));
+                if (!n.has_value() || !n->has_value()) {
+                    return Unit{};
+                }
+            }
+            file_ = nullptr;
+            if (close_) {
+                return Unit{};
+            }
+            reader_->Consume(head_.size() + request_->content_length);
+        }
+
+        PC_END;
+    }
+
+  private:
+    static constexpr std::string_view kStaticPrefix = "/static/";
+
+    bool IsStatic() const {
+        return request_->method == "GET" &&
+               request_->target.starts_with(kStaticPrefix);
+    }
+
+    std::string_view StaticPath() const {
+        auto path = request_->target.substr(kStaticPrefix.size());
+        return path.substr(0, path.find('?'));
+    }
+
+    void Respond() {
+        response_->status_code = status_;
+        response_->headers.clear();
+        response_->raw_headers = {};
+        response_->body = {};
+        response_->file_fd = -1;
+        response_->file_size = 0;
+
+        if (close_) {
+            response_->headers.emplace_back("Connection", "close");
+        } else if (request_->minor_version == 0) {
+            response_->headers.emplace_back("Connection", "keep-alive");
+        }
+        if (status_ != 200) {
+            return;
+        }
+
+        if (file_ != nullptr) {
+            // Small files come straight from the mapping, others go out
+            // with sendfile
+            response_->raw_headers = file_->Headers();
+            if (file_->IsMapped()) {
+                response_->body = file_->Data();
+            } else {
+                response_->file_fd = file_->Fd();
+                response_->file_size = file_->Size();
+            }
+            return;
+        }
+
+        response_->headers.emplace_back("Content-Type", "text/html");
+        body_buf_->assign(kBodyPrefix).append(head_).append(kBodySuffix);
+        response_->body = *body_buf_;
+    }
+
+    using PeekHeadOp = decltype(Timeout(
+        std::declval<BufReader::PeekUntilOp>(), kIdleTimeout));
+    using PeekBodyOp =
+        decltype(Timeout(std::declval<BufReader::PeekOp>(), kIdleTimeout));
+    using WriteOp =
+        decltype(Timeout(std::declval<WriteResponse>(), kIdleTimeout));
+    using LoadOp = decltype(LoadFile(std::declval<FileCache&>(), ""));
+
+    RegisteredFd fd_;
+    FileCache* files_;
+    std::optional<BufReader> reader_;
+    // Allocated from the arena of the connection
+    std::optional<HttpRequest> request_;
+    std::optional<Response> response_;
+    std::optional<std::pmr::string> body_buf_;
+    std::optional<std::pmr::vector<iovec>> iov_;
+    // Points into the buffer of the reader
+    std::string_view head_;
+    uint16_t status_ = 200;
+    bool close_ = false;
+    // Held until the response with it is written
+    FileCache::Entry file_;
+    // Last, since the callees point into the members above
+    CALLS(PeekHeadOp, PeekBodyOp, LoadOp, WriteOp);
+};
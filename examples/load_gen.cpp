@@ -0,0 +1,476 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/event-loop/fail.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/http/request.hpp>
+#include <proto-coro/io/buf-reader.hpp>
+#include <proto-coro/io/io.hpp>
+#include <proto-coro/net/address.hpp>
+#include <proto-coro/net/connect.hpp>
+#include <proto-coro/pc.hpp>
+#include <proto-coro/thread/event.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <expected>
+#include <iomanip>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Sends HTTP requests over a number of connections and reports the latency
+// and the throughput. Closed loop by default: each connection sends its next
+// request as soon as the previous one is answered. With --rate the requests
+// go out on a fixed schedule instead, and a late response delays the ones
+// after it on its connection, which is counted into their latency rather
+// than hidden.
+
+using namespace std::chrono_literals;
+
+struct Config {
+    SocketAddress addr = SocketAddress::Loopback(3333);
+    std::string host = "127.0.0.1:3333";
+    std::string path = "/";
+    size_t connections = 64;
+    size_t threads = 2;
+    Duration duration = 10s;
+    // Requests a second over all connections, zero for a closed loop
+    double rate = 0;
+    bool keep_alive = true;
+    Duration timeout = 10s;
+};
+
+// Counts of values in buckets that are within 1/32 of each other, so the
+// percentiles come out with about 3% of error at most, whatever the range
+struct LatencyHistogram {
+    void Record(Duration latency) {
+        auto ns = static_cast<uint64_t>(std::max<int64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(latency)
+                .count(),
+            0));
+        ++counts_[BucketOf(ns)];
+        ++count_;
+        sum_ += ns;
+        max_ = std::max(max_, ns);
+    }
+
+    void Merge(const LatencyHistogram& other) {
+        for (size_t i = 0; i < kBuckets; ++i) {
+            counts_[i] += other.counts_[i];
+        }
+        count_ += other.count_;
+        sum_ += other.sum_;
+        max_ = std::max(max_, other.max_);
+    }
+
+    uint64_t Count() const {
+        return count_;
+    }
+
+    // In nanoseconds, q in [0, 1]
+    uint64_t Percentile(double q) const {
+        auto rank = static_cast<uint64_t>(q * count_);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < kBuckets; ++i) {
+            seen += counts_[i];
+            if (seen > rank) {
+                return std::min(ValueOf(i), max_);
+            }
+        }
+        return max_;
+    }
+
+    uint64_t Mean() const {
+        return count_ == 0 ? 0 : sum_ / count_;
+    }
+
+    uint64_t Max() const {
+        return max_;
+    }
+
+  private:
+    static constexpr unsigned kSubBits = 5;
+    static constexpr uint64_t kSub = 1 << kSubBits;
+    static constexpr size_t kBuckets = (65 - kSubBits) * kSub;
+
+    // Values below 2 * kSub get a bucket each, the ones above share them in
+    // kSub steps per power of two
+    static size_t BucketOf(uint64_t ns) {
+        if (ns < 2 * kSub) {
+            return ns;
+        }
+        unsigned shift = std::bit_width(ns) - kSubBits - 1;
+        return (shift + 1) * kSub + ((ns >> shift) - kSub);
+    }
+
+    // The middle of the bucket
+    static uint64_t ValueOf(size_t bucket) {
+        if (bucket < 2 * kSub) {
+            return bucket;
+        }
+        unsigned shift = bucket / kSub - 1;
+        uint64_t low = (bucket % kSub + kSub) << shift;
+        return low + (uint64_t{1} << shift) / 2;
+    }
+
+    std::array<uint64_t, kBuckets> counts_{};
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+struct Stats {
+    LatencyHistogram latency;
+    uint64_t errors = 0;
+    uint64_t timeouts = 0;
+    uint64_t non_2xx = 0;
+    uint64_t connects = 0;
+    uint64_t bytes = 0;
+
+    void Merge(const Stats& other) {
+        latency.Merge(other.latency);
+        errors += other.errors;
+        timeouts += other.timeouts;
+        non_2xx += other.non_2xx;
+        connects += other.connects;
+        bytes += other.bytes;
+    }
+};
+
+struct ResponseHead {
+    int status = 0;
+    size_t content_length = 0;
+    bool close = false;
+};
+
+// Only as much of the head as a client that discards the body needs
+std::optional<ResponseHead> ParseResponseHead(std::string_view head) {
+    using namespace http_detail;
+
+    ResponseHead response;
+    auto line = TakeLine(head);
+    if (!line.has_value() || !line->starts_with("HTTP/1.") ||
+        line->size() < 12) {
+        return std::nullopt;
+    }
+    auto code = line->substr(9, 3);
+    if (std::from_chars(code.data(), code.data() + code.size(),
+                        response.status)
+            .ec != std::errc{}) {
+        return std::nullopt;
+    }
+    while (auto header = TakeLine(head)) {
+        if (header->empty()) {
+            break;
+        }
+        auto colon = header->find(':');
+        if (colon == std::string_view::npos) {
+            return std::nullopt;
+        }
+        auto name = header->substr(0, colon);
+        auto value = TrimWhitespace(header->substr(colon + 1));
+        if (EqualsIgnoreCase(name, "Content-Length")) {
+            if (std::from_chars(value.data(), value.data() + value.size(),
+                                response.content_length)
+                    .ec != std::errc{}) {
+                return std::nullopt;
+            }
+        } else if (EqualsIgnoreCase(name, "Connection")) {
+            response.close = HasOption(value, "close");
+        }
+    }
+    return response;
+}
+
+using ExchangeResult = std::expected<ResponseHead, int>;
+
+// Sends a request and reads the response to it, skipping the body
+struct Exchange : Pc {
+    Exchange(const RegisteredFd& fd, BufReader& reader,
+             std::string_view request, std::vector<char>& scratch)
+        : fd_(fd), reader_(reader), request_(request), scratch_(scratch) {
+    }
+
+    PROTO_CORO(ExchangeResult) {
+        PC_BEGIN;
+
+        {
+            CALL(auto n, WriteAll(fd_, request_));
+            if (!n.has_value()) {
+                return std::unexpected(n.error());
+            }
+        }
+        {
+            CALL(auto head, reader_.PeekUntil(kHttpHeadEnd));
+            if (!head.has_value()) {
+                return std::unexpected(head.error());
+            }
+            auto parsed = ParseResponseHead(*head);
+            if (!head->ends_with(kHttpHeadEnd) || !parsed.has_value()) {
+                return std::unexpected(EPROTO);
+            }
+            response_ = *parsed;
+            reader_.Consume(head->size());
+        }
+        for (left_ = response_.content_length; left_ > 0;) {
+            CALL(auto n, reader_.Read(std::span{scratch_}.first(
+                             std::min(left_, scratch_.size()))));
+            if (!n.has_value()) {
+                return std::unexpected(n.error());
+            }
+            if (*n == 0) {
+                return std::unexpected(EPROTO);
+            }
+            left_ -= *n;
+        }
+        return response_;
+
+        PC_END;
+    }
+
+  private:
+    const RegisteredFd& fd_;
+    BufReader& reader_;
+    std::string_view request_;
+    std::vector<char>& scratch_;
+    ResponseHead response_;
+    size_t left_ = 0;
+    CALLS(WriteAllOp, BufReader::PeekUntilOp, BufReader::ReadOp);
+};
+
+// The requests of a single connection, reconnecting as needed
+struct Client : Pc {
+    Client(const Config& config, std::string_view request, TimePoint start,
+           Duration offset)
+        : config_(config), request_(request),
+          deadline_(start + config.duration), next_(start + offset) {
+        if (config.rate > 0) {
+            interval_ = std::chrono::duration_cast<Duration>(
+                std::chrono::duration<double>(config.connections /
+                                              config.rate));
+        }
+    }
+
+    PROTO_CORO(Stats) {
+        PC_BEGIN;
+
+        scratch_.resize(64 * 1024);
+        while (true) {
+            if (interval_.has_value()) {
+                // Timed from when the request was due, not from when it
+                // could be sent
+                sent_ = next_;
+                next_ += *interval_;
+                if (sent_ >= deadline_) {
+                    break;
+                }
+                if (sent_ > Clock::now()) {
+                    SLEEP_UNTIL(sent_);
+                }
+            } else {
+                sent_ = Clock::now();
+                if (sent_ >= deadline_) {
+                    break;
+                }
+            }
+
+            if (!fd_.has_value()) {
+                {
+                    CALL(auto fd, Connect(config_.addr));
+                    if (fd.has_value()) {
+                        fd_.emplace(std::move(*fd));
+                        reader_.emplace(*fd_);
+                        ++stats_.connects;
+                    } else {
+                        ++stats_.errors;
+                    }
+                }
+                if (!fd_.has_value()) {
+                    // Not to spin while the server is down
+                    SLEEP_FOR(10ms);
+                    continue;
+                }
+            }
+
+            {
+                CALL(auto response,
+                     Timeout(Exchange{*fd_, *reader_, request_, scratch_},
+                             config_.timeout));
+                if (!response.has_value() || !response->has_value()) {
+                    ++(response.has_value() ? stats_.errors
+                                            : stats_.timeouts);
+                    Disconnect();
+                    continue;
+                }
+                stats_.latency.Record(Clock::now() - sent_);
+                stats_.bytes += (*response)->content_length;
+                if ((*response)->status < 200 || (*response)->status > 299) {
+                    ++stats_.non_2xx;
+                }
+                if (!config_.keep_alive || (*response)->close) {
+                    Disconnect();
+                }
+            }
+        }
+        return stats_;
+
+        PC_END;
+    }
+
+  private:
+    void Disconnect() {
+        reader_.reset();
+        fd_.reset();
+    }
+
+    using ExchangeOp = decltype(Timeout(std::declval<Exchange>(), 1s));
+
+    const Config& config_;
+    std::string_view request_;
+    TimePoint deadline_;
+    TimePoint next_;
+    std::optional<Duration> interval_;
+    TimePoint sent_;
+    std::optional<RegisteredFd> fd_;
+    std::optional<BufReader> reader_;
+    std::vector<char> scratch_;
+    Stats stats_;
+    CALLS(ConnectOp, ExchangeOp);
+};
+
+std::optional<Config> ParseArgs(int argc, char** argv) {
+    Config config;
+    for (int i = 1; i < argc; ++i) {
+        std::string_view arg = argv[i];
+        auto eq = arg.find('=');
+        auto key = arg.substr(0, eq);
+        auto value =
+            eq == std::string_view::npos ? "" : arg.substr(eq + 1);
+        auto number = [&value] {
+            return std::strtod(std::string{value}.c_str(), nullptr);
+        };
+
+        if (key == "--addr") {
+            auto addr = SocketAddress::Parse(value);
+            if (!addr.has_value()) {
+                return std::nullopt;
+            }
+            config.addr = *addr;
+            config.host = value;
+        } else if (key == "--path") {
+            config.path = value;
+        } else if (key == "--connections") {
+            config.connections = std::max(number(), 1.0);
+        } else if (key == "--threads") {
+            config.threads = std::max(number(), 1.0);
+        } else if (key == "--duration") {
+            config.duration = std::chrono::duration_cast<Duration>(
+                std::chrono::duration<double>(number()));
+        } else if (key == "--rate") {
+            config.rate = number();
+        } else if (key == "--timeout") {
+            config.timeout = std::chrono::duration_cast<Duration>(
+                std::chrono::duration<double>(number()));
+        } else if (key == "--close") {
+            config.keep_alive = false;
+        } else {
+            return std::nullopt;
+        }
+    }
+    return config;
+}
+
+// Requests only go out until the deadline, so the rates are over the
+// duration. The exchanges still in flight then are waited for, up to the
+// timeout, which is reported on its own as the drain.
+void Report(const Config& config, const Stats& stats, Duration drain) {
+    auto seconds = std::chrono::duration<double>(config.duration).count();
+    auto ms = [](uint64_t ns) {
+        return static_cast<double>(ns) / 1e6;
+    };
+    const auto& latency = stats.latency;
+
+    std::cout << std::fixed << std::setprecision(3);
+    if (config.rate > 0) {
+        std::cout << "open loop at " << config.rate << " req/s";
+    } else {
+        std::cout << "closed loop";
+    }
+    std::cout << ", " << config.connections << " connections, "
+              << (config.keep_alive ? "keep-alive" : "connection per request")
+              << "\n";
+    std::cout << "requests: " << latency.Count() << " in " << seconds
+              << " s, " << latency.Count() / seconds << " req/s, "
+              << stats.bytes / seconds / (1 << 20) << " MiB/s of bodies, "
+              << std::chrono::duration<double>(drain).count()
+              << " s to drain\n";
+    std::cout << "connects: " << stats.connects << ", errors: " << stats.errors
+              << ", timeouts: " << stats.timeouts
+              << ", non-2xx: " << stats.non_2xx << "\n";
+    std::cout << "latency ms: mean " << ms(latency.Mean()) << ", p50 "
+              << ms(latency.Percentile(0.5)) << ", p90 "
+              << ms(latency.Percentile(0.9)) << ", p99 "
+              << ms(latency.Percentile(0.99)) << ", p999 "
+              << ms(latency.Percentile(0.999)) << ", max "
+              << ms(latency.Max()) << std::endl;
+}
+
+int main(int argc, char** argv) {
+    auto config = ParseArgs(argc, argv);
+    if (!config.has_value()) {
+        std::cerr << "usage: load_gen [--addr=127.0.0.1:3333] [--path=/]\n"
+                     "                [--connections=64] [--threads=2]\n"
+                     "                [--duration=10] [--rate=req/s]\n"
+                     "                [--timeout=10] [--close]\n";
+        return 1;
+    }
+
+    std::string request = "GET " + config->path + " HTTP/1.1\r\nHost: " +
+                           config->host + "\r\n";
+    if (!config->keep_alive) {
+        request += "Connection: close\r\n";
+    }
+    request += "\r\n";
+
+    EventLoop loop{config->threads};
+    loop.Start();
+
+    // Spread over the first interval, so that an open loop doesn't start
+    // with a burst
+    auto start = Clock::now() + 10ms;
+    Duration spread =
+        config->rate > 0
+            ? std::chrono::duration_cast<Duration>(
+                  std::chrono::duration<double>(1 / config->rate))
+            : Duration{0};
+    std::vector<Client> clients;
+    for (size_t i = 0; i < config->connections; ++i) {
+        clients.emplace_back(*config, request, start,
+                             spread * static_cast<int64_t>(i));
+    }
+
+    Stats total;
+    ThreadOneshotEvent done;
+    auto routine = Spawn{WhenAll(std::move(clients)) |
+                         FMap{[&](std::vector<Stats> stats) {
+                             for (const auto& s : stats) {
+                                 total.Merge(s);
+                             }
+                             done.Fire();
+                             return Unit{};
+                         }}};
+    loop.Submit(&routine);
+    done.Wait();
+    auto drain = std::max(Clock::now() - (start + config->duration),
+                          Duration{0});
+    loop.Stop();
+
+    Report(*config, total, drain);
+}
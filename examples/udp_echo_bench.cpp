@@ -0,0 +1,264 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/event-loop/fail.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/net/address.hpp>
+#include <proto-coro/net/udp.hpp>
+#include <proto-coro/pc.hpp>
+#include <proto-coro/thread/event.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+// Echoes datagrams over loopback: clients send a window of them and wait
+// for the echoes, a server sends back whatever it receives. Compares a
+// datagram per syscall, batches of them with recvmmsg and sendmmsg, and
+// batches of runs of them with GSO and GRO, where the whole run goes
+// through the stack as one.
+
+using namespace std::chrono_literals;
+
+struct Setup {
+    size_t batch;
+    bool gso;
+    size_t payload;
+    size_t clients;
+    Duration duration;
+};
+
+// Datagrams a received one stands for
+size_t CountOf(const DatagramBatch& batch, size_t i) {
+    auto segment = batch.SegmentSize(i);
+    auto size = batch.Data(i).size();
+    return segment == 0 ? 1 : (size + segment - 1) / segment;
+}
+
+UdpOptions Options(const Setup& setup) {
+    return {.gro = setup.gso,
+            .recv_buffer = 4 << 20,
+            .send_buffer = 4 << 20};
+}
+
+RegisteredFd Bind(EventLoop& loop, const Setup& setup) {
+    auto fd = BindUdp(SocketAddress::Loopback(0), Options(setup));
+    if (!fd.has_value()) {
+        errno = fd.error();
+        Fail("bind a UDP socket");
+    }
+    return RegisteredFd{std::move(*fd), &loop};
+}
+
+struct EchoServer : Pc {
+    EchoServer(const RegisteredFd& fd, const Setup& setup)
+        : fd_(fd),
+          batch_(setup.batch,
+                 setup.gso ? DatagramBatch::kMaxDatagram : setup.payload) {
+    }
+
+    EchoServer(EchoServer&& other)
+        : fd_(other.fd_), batch_(other.batch_.Capacity(),
+                                 other.batch_.MaxSize()) {
+    }
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        while (true) {
+            {
+                CALL(auto n, RecvBatch(fd_, batch_));
+                if (!n.has_value()) {
+                    Fail("receive");
+                }
+            }
+            batch_.PrepareReplies();
+            {
+                CALL(auto n, SendBatchAll(fd_, batch_));
+                if (!n.has_value()) {
+                    Fail("send");
+                }
+            }
+        }
+
+        PC_END;
+    }
+
+  private:
+    const RegisteredFd& fd_;
+    DatagramBatch batch_;
+    CALLS(RecvBatchOp, SendBatchAllOp);
+};
+
+// Receives until count datagrams came back
+struct ReceiveEchoes : Pc {
+    ReceiveEchoes(const RegisteredFd& fd, DatagramBatch& batch, size_t count)
+        : fd_(fd), batch_(batch), count_(count) {
+    }
+
+    PROTO_CORO(size_t) {
+        PC_BEGIN;
+
+        while (got_ < count_) {
+            CALL(auto n, RecvBatch(fd_, batch_));
+            if (!n.has_value()) {
+                Fail("receive");
+            }
+            for (size_t i = 0; i < batch_.Size(); ++i) {
+                got_ += CountOf(batch_, i);
+            }
+        }
+        return got_;
+
+        PC_END;
+    }
+
+  private:
+    const RegisteredFd& fd_;
+    DatagramBatch& batch_;
+    size_t count_;
+    size_t got_ = 0;
+    CALLS(RecvBatchOp);
+};
+
+struct ClientStats {
+    size_t echoed = 0;
+    size_t lost = 0;
+};
+
+struct Client : Pc {
+    Client(EventLoop& loop, const Setup& setup, const SocketAddress& server,
+           TimePoint deadline)
+        : setup_(setup), server_(server), deadline_(deadline),
+          fd_(Bind(loop, setup)),
+          out_(setup.batch, setup.gso ? DatagramBatch::kMaxDatagram
+                                      : setup.payload),
+          in_(setup.batch, out_.MaxSize()) {
+    }
+
+    Client(Client&& other)
+        : setup_(other.setup_), server_(other.server_),
+          deadline_(other.deadline_), fd_(std::move(other.fd_)),
+          out_(other.out_.Capacity(), other.out_.MaxSize()),
+          in_(other.in_.Capacity(), other.in_.MaxSize()) {
+    }
+
+    PROTO_CORO(ClientStats) {
+        PC_BEGIN;
+
+        {
+            std::string payload(setup_.payload, 'x');
+            if (setup_.gso) {
+                // As many as a single datagram takes, 64 segments at most
+                size_t segments =
+                    std::min<size_t>(DatagramBatch::kMaxDatagram /
+                                         setup_.payload,
+                                     64);
+                std::string run(segments * setup_.payload, 'x');
+                while (!out_.Full()) {
+                    out_.Push(run, server_, setup_.payload);
+                }
+                window_ = segments * out_.Size();
+            } else {
+                while (!out_.Full()) {
+                    out_.Push(payload, server_);
+                }
+                window_ = out_.Size();
+            }
+        }
+
+        while (Clock::now() < deadline_) {
+            {
+                CALL(auto n, SendBatchAll(fd_, out_));
+                if (!n.has_value()) {
+                    Fail("send");
+                }
+            }
+            {
+                CALL(auto got, Timeout(ReceiveEchoes{fd_, in_, window_},
+                                       100ms));
+                // Late echoes of a lost round count towards the next one
+                auto echoed = got.value_or(0);
+                stats_.echoed += echoed;
+                stats_.lost += window_ - std::min(echoed, window_);
+            }
+        }
+        return stats_;
+
+        PC_END;
+    }
+
+  private:
+    using ReceiveOp = decltype(Timeout(
+        std::declval<ReceiveEchoes>(), 1ms));
+
+    const Setup& setup_;
+    SocketAddress server_;
+    TimePoint deadline_;
+    RegisteredFd fd_;
+    DatagramBatch out_;
+    DatagramBatch in_;
+    size_t window_ = 0;
+    ClientStats stats_;
+    CALLS(SendBatchAllOp, ReceiveOp);
+};
+
+void Measure(EventLoop& loop, const Setup& setup) {
+    auto server_fd = Bind(loop, setup);
+    auto server_addr = SocketAddress::LocalOf(server_fd.AsRawFd());
+    if (!server_addr.has_value()) {
+        Fail("getsockname");
+    }
+
+    auto start = Clock::now();
+    std::vector<Client> clients;
+    for (size_t i = 0; i < setup.clients; ++i) {
+        clients.emplace_back(loop, setup, *server_addr,
+                             start + setup.duration);
+    }
+
+    ClientStats total;
+    ThreadOneshotEvent done;
+    // The server is cancelled once the clients are done
+    auto routine = Spawn{
+        WhenAny(EchoServer{server_fd, setup}, WhenAll(std::move(clients))) |
+        FMap{[&](auto res) {
+            for (const auto& stats : std::get<1>(res)) {
+                total.echoed += stats.echoed;
+                total.lost += stats.lost;
+            }
+            done.Fire();
+            return Unit{};
+        }}};
+    loop.Submit(&routine);
+    done.Wait();
+
+    std::chrono::duration<double> elapsed = Clock::now() - start;
+    std::cout << "batch " << setup.batch << (setup.gso ? " with GSO/GRO" : "")
+              << ": " << total.echoed / elapsed.count() / 1e6
+              << " M datagrams/s echoed, " << total.lost << " lost"
+              << std::endl;
+}
+
+int main(int argc, char** argv) {
+    size_t batch = argc > 1 ? std::atoll(argv[1]) : 32;
+    size_t payload = argc > 2 ? std::atoll(argv[2]) : 64;
+    size_t clients = argc > 3 ? std::atoll(argv[3]) : 4;
+    auto duration = std::chrono::seconds{argc > 4 ? std::atoi(argv[4]) : 3};
+    batch = std::max<size_t>(batch, 1);
+    payload = std::clamp<size_t>(payload, 1, 1400);
+
+    EventLoop loop{2};
+    loop.Start();
+
+    std::cout << payload << " byte datagrams, " << clients << " clients"
+              << std::endl;
+    Measure(loop, {1, false, payload, clients, duration});
+    Measure(loop, {batch, false, payload, clients, duration});
+    Measure(loop, {batch, true, payload, clients, duration});
+
+    loop.Stop();
+}
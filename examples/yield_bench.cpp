@@ -0,0 +1,92 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/pc.hpp>
+#include <proto-coro/thread/event.hpp>
+
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+
+// Routines that do nothing but yield, so that the time goes into Submit and
+// the scheduling around it. Compares routines that reach the loop through
+// IRuntime with the ones declared to run on an EventLoop.
+
+struct VirtualYields : Pc {
+    explicit VirtualYields(int times) : times_(times) {
+    }
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        for (i_ = 0; i_ < times_; ++i_) {
+            YIELD;
+        }
+        return Unit{};
+
+        PC_END;
+    }
+
+  private:
+    int times_;
+    int i_ = 0;
+};
+
+struct StaticYields : Pc {
+    explicit StaticYields(int times) : times_(times) {
+    }
+
+    PROTO_CORO_ON(EventLoop, Unit) {
+        PC_BEGIN;
+
+        for (i_ = 0; i_ < times_; ++i_) {
+            YIELD;
+        }
+        return Unit{};
+
+        PC_END;
+    }
+
+  private:
+    int times_;
+    int i_ = 0;
+};
+
+template <class T>
+double Measure(EventLoop& loop, int routines, int yields) {
+    ThreadOneshotEvent done;
+
+    auto start = Clock::now();
+    auto routine =
+        Spawn{WhenAll(std::vector<T>(routines, T{yields})) | FMap{[&](auto) {
+                  done.Fire();
+                  return Unit{};
+              }}};
+    loop.Submit(&routine);
+    done.Wait();
+
+    std::chrono::duration<double, std::nano> elapsed = Clock::now() - start;
+    return elapsed.count() / (static_cast<double>(routines) * yields);
+}
+
+int main(int argc, char** argv) {
+    int workers = argc > 1 ? std::atoi(argv[1]) : 1;
+    int routines = argc > 2 ? std::atoi(argv[2]) : 64;
+    int yields = argc > 3 ? std::atoi(argv[3]) : 100'000;
+    constexpr int kRounds = 5;
+
+    EventLoop loop(workers);
+    loop.Start();
+
+    // Warms up the queues and the worker threads
+    Measure<VirtualYields>(loop, routines, yields / 10);
+
+    for (int round = 0; round < kRounds; ++round) {
+        auto virtual_ns = Measure<VirtualYields>(loop, routines, yields);
+        auto static_ns = Measure<StaticYields>(loop, routines, yields);
+        std::cout << "IRuntime: " << virtual_ns << " ns/yield, "
+                  << "EventLoop: " << static_ns << " ns/yield" << std::endl;
+    }
+
+    loop.Stop();
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "ctx.hpp"
+#include "pc.hpp"
+
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
+#include <utility>
+
+// Memory for whatever the current routine allocates: its arena if it has one,
+// the heap otherwise. Things allocated there must not outlive the routine.
+inline std::pmr::memory_resource* MemoryOf(const Context* ctx) {
+    return ctx->arena != nullptr ? ctx->arena
+                                 : std::pmr::get_default_resource();
+}
+
+#define ARENA MemoryOf(CTX_VAR)
+
+constexpr size_t kDefaultArenaSize = 4096;
+
+// Runs coro with a monotonic arena: allocations from ARENA are a pointer bump
+// into a buffer inline in the coroutine, spilling to the heap once it runs
+// out, and nothing is freed until the whole arena is released along with the
+// coroutine.
+//
+// The arena is not thread-safe, so it is not handed down to the branches of
+// a WhenAll or a WhenAny, which may run in parallel.
+template <class T, size_t InlineSize = kDefaultArenaSize>
+struct WithArena : Pc, RuntimeOfCoro<T> {
+    explicit WithArena(T coro) : inner_(std::move(coro)) {
+    }
+
+    // Only meaningful before the coroutine is started, so the buffer is not
+    // copied
+    WithArena(WithArena&& other) : inner_(std::move(other.inner_)) {
+    }
+
+    PROTO_CORO_LIKE(T, OutputOf<T>) {
+        if (!arena_.has_value()) {
+            arena_.emplace(buffer_, sizeof(buffer_));
+        }
+        auto ctx = *CTX_VAR;
+        ctx.arena = &*arena_;
+        return inner_.Step(&ctx);
+    }
+
+  private:
+    // Declared first, since inner_ may hold memory from the arena till it is
+    // destroyed
+    alignas(std::max_align_t) std::byte buffer_[InlineSize];
+    std::optional<std::pmr::monotonic_buffer_resource> arena_;
+
+    T inner_;
+};
@@ -0,0 +1,158 @@
+#include "blocking-pool.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <list>
+#include <mutex>
+#include <thread>
+
+struct BlockingPool::Impl {
+    using Threads = std::list<std::thread>;
+
+    Impl(size_t max_threads, Duration keep_alive)
+        : max_threads_(std::max<size_t>(max_threads, 1)),
+          keep_alive_(keep_alive) {
+    }
+
+    void Submit(BlockingTask* task) {
+        std::lock_guard lk{m_};
+        Push(task);
+        // The idle threads may all have been claimed by the tasks queued
+        // before, which they are yet to pick up
+        if (queued_ > idle_ && threads_.size() < max_threads_) {
+            Reap();
+            auto it = threads_.emplace(threads_.end());
+            *it = std::thread(&Impl::WorkerThread, this, it);
+        } else {
+            has_tasks_or_stopped_.notify_one();
+        }
+    }
+
+    bool Withdraw(BlockingTask* task) {
+        std::lock_guard lk{m_};
+        if (!task->queued_) {
+            return false;
+        }
+        Unlink(task);
+        return true;
+    }
+
+    Metrics GetMetrics() const {
+        std::lock_guard lk{m_};
+        return Metrics{
+            .threads = threads_.size(),
+            .idle_threads = idle_,
+            .queued = queued_,
+            .peak_queued = peak_queued_,
+            .completed = completed_,
+        };
+    }
+
+    void Stop() {
+        {
+            std::lock_guard lk{m_};
+            stopped_ = true;
+            has_tasks_or_stopped_.notify_all();
+        }
+        // No one touches the lists once stopped
+        for (auto& thread : threads_) {
+            thread.join();
+        }
+        Reap();
+    }
+
+  private:
+    void WorkerThread(Threads::iterator self) {
+        std::unique_lock lk{m_};
+        while (true) {
+            if (head_ != nullptr) {
+                auto* task = head_;
+                Unlink(task);
+                lk.unlock();
+                task->Run();
+                lk.lock();
+                ++completed_;
+                continue;
+            }
+            if (stopped_) {
+                return;
+            }
+
+            ++idle_;
+            bool woken = has_tasks_or_stopped_.wait_for(lk, keep_alive_, [&] {
+                return head_ != nullptr || stopped_;
+            });
+            --idle_;
+            if (!woken) {
+                break;
+            }
+        }
+        // Joined by whoever spawns the next thread
+        exited_.splice(exited_.end(), threads_, self);
+    }
+
+    void Reap() {
+        for (auto& thread : exited_) {
+            thread.join();
+        }
+        exited_.clear();
+    }
+
+    void Push(BlockingTask* task) {
+        task->prev_ = tail_;
+        task->next_ = nullptr;
+        (tail_ != nullptr ? tail_->next_ : head_) = task;
+        tail_ = task;
+        task->queued_ = true;
+        peak_queued_ = std::max(peak_queued_, ++queued_);
+    }
+
+    void Unlink(BlockingTask* task) {
+        (task->prev_ != nullptr ? task->prev_->next_ : head_) = task->next_;
+        (task->next_ != nullptr ? task->next_->prev_ : tail_) = task->prev_;
+        task->queued_ = false;
+        --queued_;
+    }
+
+    const size_t max_threads_;
+    const Duration keep_alive_;
+
+    mutable std::mutex m_;
+    std::condition_variable has_tasks_or_stopped_;
+    bool stopped_ = false;
+
+    BlockingTask* head_ = nullptr;
+    BlockingTask* tail_ = nullptr;
+    size_t queued_ = 0;
+    size_t peak_queued_ = 0;
+    size_t idle_ = 0;
+    uint64_t completed_ = 0;
+
+    Threads threads_;
+    Threads exited_;
+};
+
+BlockingPool::BlockingPool(size_t max_threads, Duration keep_alive)
+    : impl_(max_threads, keep_alive) {
+}
+
+void BlockingPool::Submit(BlockingTask* task) {
+    impl_->Submit(task);
+}
+
+bool BlockingPool::Withdraw(BlockingTask* task) {
+    return impl_->Withdraw(task);
+}
+
+BlockingPool::Metrics BlockingPool::GetMetrics() const {
+    return impl_->GetMetrics();
+}
+
+BlockingPool::~BlockingPool() {
+    impl_->Stop();
+}
+
+BlockingPool& DefaultBlockingPool() {
+    static BlockingPool pool;
+    return pool;
+}
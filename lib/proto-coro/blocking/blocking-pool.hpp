@@ -0,0 +1,58 @@
+#pragma once
+
+#include <proto-coro/fast-pimpl.hpp>
+#include <proto-coro/rt.hpp>
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+// A job for the blocking pool. Linked into its queue until a thread takes it.
+struct BlockingTask {
+    virtual void Run() = 0;
+
+  private:
+    friend struct BlockingPool;
+
+    BlockingTask* prev_ = nullptr;
+    BlockingTask* next_ = nullptr;
+    bool queued_ = false;
+};
+
+// Threads for the calls that block, e.g. on regular files, so that they stay
+// off the workers of the event loop. Grows a thread whenever a task finds
+// them all busy, up to max_threads, and lets a thread go once it has been
+// idle for keep_alive.
+struct BlockingPool {
+    struct Metrics {
+        size_t threads = 0;
+        size_t idle_threads = 0;
+        size_t queued = 0;
+        size_t peak_queued = 0;
+        uint64_t completed = 0;
+    };
+
+    explicit BlockingPool(size_t max_threads = 512,
+                          Duration keep_alive = std::chrono::seconds{10});
+
+    BlockingPool(const BlockingPool&) = delete;
+    BlockingPool& operator=(const BlockingPool&) = delete;
+
+    void Submit(BlockingTask* task);
+
+    // Takes the task back unless a thread has picked it up already. Returns
+    // true if it did, the task is then never run.
+    bool Withdraw(BlockingTask* task);
+
+    Metrics GetMetrics() const;
+
+    // Runs what is still queued and joins the threads
+    ~BlockingPool();
+
+  private:
+    struct Impl;
+    FastPimpl<Impl, 256, 8> impl_;
+};
+
+// Shared by everyone who doesn't need a pool of their own
+BlockingPool& DefaultBlockingPool();
@@ -0,0 +1,97 @@
+#pragma once
+
+#include "spawn-blocking.hpp"
+
+#include <proto-coro/event-loop/owned-fd.hpp>
+
+#include <cerrno>
+#include <expected>
+#include <fcntl.h>
+#include <span>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+// Regular files are always ready as far as epoll is concerned, and reading
+// one may still block on the disk. So these run on the blocking pool, and
+// fail with the errno of the call.
+
+inline auto OpenFile(std::string path, int flags, mode_t mode = 0) {
+    return SpawnBlocking([path = std::move(path), flags,
+                          mode]() -> std::expected<OwnedFd, int> {
+        int fd = ::open(path.c_str(), flags | O_CLOEXEC, mode);
+        if (fd < 0) {
+            return std::unexpected(errno);
+        }
+        return OwnedFd::FromRaw(fd);
+    });
+}
+
+// Reads up to buf.size() bytes at offset, fewer only at the end of the file
+inline auto ReadAt(int fd, std::span<char> buf, off_t offset) {
+    return SpawnBlocking([fd, buf, offset]() -> std::expected<size_t, int> {
+        size_t done = 0;
+        while (done < buf.size()) {
+            auto n = ::pread(fd, buf.data() + done, buf.size() - done,
+                             offset + done);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return std::unexpected(errno);
+            }
+            if (n == 0) {
+                break;
+            }
+            done += n;
+        }
+        return done;
+    });
+}
+
+inline auto WriteAt(int fd, std::span<const char> buf, off_t offset) {
+    return SpawnBlocking([fd, buf, offset]() -> std::expected<size_t, int> {
+        size_t done = 0;
+        while (done < buf.size()) {
+            auto n = ::pwrite(fd, buf.data() + done, buf.size() - done,
+                              offset + done);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return std::unexpected(errno);
+            }
+            done += n;
+        }
+        return done;
+    });
+}
+
+// The whole file in one go
+inline auto ReadFile(std::string path) {
+    return SpawnBlocking(
+        [path = std::move(path)]() -> std::expected<std::string, int> {
+            int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                return std::unexpected(errno);
+            }
+            auto file = OwnedFd::FromRaw(fd);
+
+            std::string data;
+            char buf[16 * 1024];
+            while (true) {
+                auto n = ::read(fd, buf, sizeof(buf));
+                if (n < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return std::unexpected(errno);
+                }
+                if (n == 0) {
+                    return data;
+                }
+                data.append(buf, n);
+            }
+        });
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "blocking-pool.hpp"
+
+#include <proto-coro/cancel.hpp>
+#include <proto-coro/pc.hpp>
+#include <proto-coro/routine.hpp>
+#include <proto-coro/rt.hpp>
+
+#include <cstdint>
+#include <optional>
+#include <type_traits>
+#include <utility>
+
+template <class F>
+using BlockingOutput =
+    std::conditional_t<std::is_void_v<std::invoke_result_t<F&>>, Unit,
+                       std::invoke_result_t<F&>>;
+
+template <class F>
+struct SpawnBlockingOp : Pc, BlockingTask {
+    using Output = BlockingOutput<F>;
+
+    SpawnBlockingOp(BlockingPool& pool, F fn)
+        : pool_(&pool), fn_(std::move(fn)) {
+    }
+
+    PROTO_CORO(Output) {
+        PC_BEGIN;
+
+        routine_ = CTX_VAR->self;
+        rt_ = CTX_VAR->rt;
+        // Only a task that is still queued can be taken back
+        if (CTX_VAR->cancel != nullptr) {
+            CTX_VAR->cancel->Arm(
+                [](void* pool, uintptr_t task, IRoutine*, IRuntime*) {
+                    return static_cast<BlockingPool*>(pool)->Withdraw(
+                        reinterpret_cast<BlockingTask*>(task));
+                },
+                pool_,
+                reinterpret_cast<uintptr_t>(static_cast<BlockingTask*>(this)));
+        }
+        SUSPEND_AND(pool_->Submit(this));
+        return std::move(*output_);
+
+        PC_END;
+    }
+
+  private:
+    void Run() override {
+        if constexpr (std::is_void_v<std::invoke_result_t<F&>>) {
+            fn_();
+            output_.emplace();
+        } else {
+            output_.emplace(fn_());
+        }
+        // The op may be gone as soon as the routine is resumed
+        rt_->Submit(routine_);
+    }
+
+    BlockingPool* pool_;
+    F fn_;
+    std::optional<Output> output_;
+    IRoutine* routine_ = nullptr;
+    IRuntime* rt_ = nullptr;
+};
+
+// Runs fn on a thread of the pool, completing with whatever it returns. The
+// routine is resumed through its runtime once fn is done.
+template <class F>
+auto SpawnBlocking(BlockingPool& pool, F fn) {
+    return SpawnBlockingOp<F>{pool, std::move(fn)};
+}
+
+template <class F>
+auto SpawnBlocking(F fn) {
+    return SpawnBlocking(DefaultBlockingPool(), std::move(fn));
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+// Cooperative preemption. A routine whose I/O keeps succeeding right away
+// never suspends on its own, and would hold on to its worker while the other
+// routines starve. So the runtime hands every step of a routine a budget of
+// operations, and once it is spent they yield instead, as if they were not
+// ready. It is charged by the operations themselves: the I/O ops on every
+// attempt, the sync ops and channels once per call, POLL of an expression and
+// COOPERATE. Coroutines that only call others, such as CALL and the
+// combinators, don't charge it, so every step gets at least one operation
+// done however deep it is nested.
+//
+// The budget is per thread. Threads that are not workers of a runtime never
+// reset it, so theirs is unlimited.
+struct Budget {
+    static constexpr uint32_t kDefault = 128;
+    static constexpr uint32_t kUnlimited = std::numeric_limits<uint32_t>::max();
+
+    // Called by the runtime before every step
+    static void Reset(uint32_t ops) {
+        remaining_ = ops;
+    }
+
+    // Takes one operation from the budget. Returns false once it is spent.
+    static bool Charge() {
+        if (remaining_ == kUnlimited) {
+            return true;
+        }
+        if (remaining_ == 0) {
+            return false;
+        }
+        --remaining_;
+        return true;
+    }
+
+    static uint32_t Remaining() {
+        return remaining_;
+    }
+
+  private:
+    static inline thread_local uint32_t remaining_ = kUnlimited;
+};
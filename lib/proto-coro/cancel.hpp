@@ -0,0 +1,203 @@
+#pragma once
+
+#include "routine.hpp"
+#include "rt.hpp"
+#include "thread/spinlock.hpp"
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+// Cancellation of a routine. A cancelled routine is never stepped again: its
+// owner withdraws the wakeup it is suspended on and destroys it.
+//
+// A suspension point that can be withdrawn arms the state with a hook right
+// before registering its wakeup, and the owner of the routine disarms it once
+// the routine is resumed. Since the hook may race with the registration, the
+// owner settles the state after every suspension as well, so exactly one of
+// them gets to withdraw the wakeup.
+struct CancelState {
+    // Returns true if the wakeup of routine was withdrawn before it fired
+    using WithdrawFn = bool (*)(void* what, uintptr_t arg, IRoutine* routine,
+                                IRuntime* rt);
+
+    bool IsCancelled() const {
+        return cancelled_.load(std::memory_order_acquire) != 0;
+    }
+
+    void Arm(WithdrawFn withdraw, void* what, uintptr_t arg = 0) {
+        std::lock_guard lk{lock_};
+        withdraw_ = withdraw;
+        what_ = what;
+        arg_ = arg;
+    }
+
+    // Once it returns, the hook is neither running nor going to be called
+    void Disarm() {
+        std::unique_lock lk{lock_};
+        WaitIdle(lk);
+        withdraw_ = nullptr;
+    }
+
+    // Returns true if the wakeup was withdrawn, in which case the caller is
+    // responsible for resuming routine
+    bool Cancel(IRoutine* routine, IRuntime* rt) {
+        cancelled_.fetch_or(1, std::memory_order_acq_rel);
+        return Withdraw(routine, rt);
+    }
+
+    // To be called by the owner once routine has suspended. Same as Cancel,
+    // for a cancellation that came before the wakeup was registered.
+    bool Settle(IRoutine* routine, IRuntime* rt) {
+        // Both sides go through a read-modify-write, so either this one sees
+        // the cancellation or the canceller sees the registered wakeup
+        return cancelled_.fetch_or(0, std::memory_order_acq_rel) != 0 &&
+               Withdraw(routine, rt);
+    }
+
+  private:
+    // The hook runs outside of the lock, since cancelling a fork cascades
+    // into its branches and the runtime
+    bool Withdraw(IRoutine* routine, IRuntime* rt) {
+        WithdrawFn withdraw;
+        void* what;
+        uintptr_t arg;
+        {
+            std::unique_lock lk{lock_};
+            // A concurrent attempt may fail for having come too early, so
+            // this one still gets its turn once that is over
+            WaitIdle(lk);
+            if (withdraw_ == nullptr) {
+                return false;
+            }
+            withdraw = withdraw_;
+            what = what_;
+            arg = arg_;
+            running_ = true;
+        }
+
+        bool withdrawn = withdraw(what, arg, routine, rt);
+
+        std::lock_guard lk{lock_};
+        running_ = false;
+        if (withdrawn) {
+            withdraw_ = nullptr;
+        }
+        return withdrawn;
+    }
+
+    void WaitIdle(std::unique_lock<SpinLock>& lk) {
+        while (running_) {
+            lk.unlock();
+            std::this_thread::yield();
+            lk.lock();
+        }
+    }
+
+    std::atomic<uint8_t> cancelled_ = 0;
+
+    SpinLock lock_;
+    WithdrawFn withdraw_ = nullptr;
+    void* what_ = nullptr;
+    uintptr_t arg_ = 0;
+    bool running_ = false;
+};
+
+// To be notified by a CancelSource. Linked into the source while subscribed.
+struct CancelSubscription {
+    void (*on_cancel)(void* what) = nullptr;
+    void* what = nullptr;
+
+  private:
+    friend struct CancelSource;
+
+    CancelSubscription* prev_ = nullptr;
+    CancelSubscription* next_ = nullptr;
+    bool linked_ = false;
+};
+
+struct CancelToken;
+
+// Cancels whatever runs on its tokens, including the routines that subscribe
+// after the fact. Has to outlive them.
+struct CancelSource {
+    CancelSource() = default;
+
+    CancelSource(const CancelSource&) = delete;
+    CancelSource& operator=(const CancelSource&) = delete;
+
+    CancelToken Token();
+
+    void Cancel() {
+        std::lock_guard lk{m_};
+        cancelled_.store(true, std::memory_order_release);
+        for (auto* sub = head_; sub != nullptr; sub = sub->next_) {
+            sub->on_cancel(sub->what);
+        }
+    }
+
+    bool IsCancelled() const {
+        return cancelled_.load(std::memory_order_acquire);
+    }
+
+    // Returns false, leaving sub unlinked, if the source is already cancelled
+    bool Subscribe(CancelSubscription* sub) {
+        std::lock_guard lk{m_};
+        if (IsCancelled()) {
+            return false;
+        }
+        sub->prev_ = nullptr;
+        sub->next_ = std::exchange(head_, sub);
+        if (sub->next_ != nullptr) {
+            sub->next_->prev_ = sub;
+        }
+        sub->linked_ = true;
+        return true;
+    }
+
+    // Once it returns, sub is not being notified and never will be
+    void Unsubscribe(CancelSubscription* sub) {
+        std::lock_guard lk{m_};
+        if (!std::exchange(sub->linked_, false)) {
+            return;
+        }
+        (sub->prev_ != nullptr ? sub->prev_->next_ : head_) = sub->next_;
+        if (sub->next_ != nullptr) {
+            sub->next_->prev_ = sub->prev_;
+        }
+    }
+
+    ~CancelSource() {
+        assert(head_ == nullptr);
+    }
+
+  private:
+    std::mutex m_;
+    std::atomic<bool> cancelled_ = false;
+    CancelSubscription* head_ = nullptr;
+};
+
+// A handle that lets its holder run routines cancellable by the source, but
+// not cancel them itself
+struct CancelToken {
+    explicit CancelToken(CancelSource& source) : source_(&source) {
+    }
+
+    bool IsCancelled() const {
+        return source_->IsCancelled();
+    }
+
+    CancelSource& Source() const {
+        return *source_;
+    }
+
+  private:
+    CancelSource* source_;
+};
+
+inline CancelToken CancelSource::Token() {
+    return CancelToken{*this};
+}
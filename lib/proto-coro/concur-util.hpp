@@ -1,19 +1,31 @@
 #pragma once
 
+#include "cancel.hpp"
 #include "pc.hpp"
 #include "routine.hpp"
 #include "rt.hpp"
+#include "thread/object-pool.hpp"
 
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
 
 template <class Inner>
-struct Boxed {
+struct Boxed : RuntimeOfCoro<Inner> {
     template <class... Args>
     Boxed(Args&&... args)
         : inner(std::make_unique<Inner>(std::forward<Args>(args)...)) {
     }
 
-    PROTO_CORO(OutputOf<Inner>) {
+    PROTO_CORO_LIKE(Inner, OutputOf<Inner>) {
         return inner->Step(CTX_VAR);
     }
 
@@ -27,7 +39,7 @@ struct Spawn : IRoutine {
     }
 
     void Step(IRuntime* rt) override {
-        Context ctx{this, rt};
+        auto ctx = MakeContext<T>(this, rt);
         inner.Step(&ctx);
     }
 
@@ -35,14 +47,49 @@ struct Spawn : IRoutine {
     T inner;
 };
 
-#define SLEEP_UNTIL(when)                                                      \
-    SUSPEND_AND({ CTX_VAR->rt->After(when, CTX_VAR->self); })
+// Register a wakeup of the current routine, such that it can be withdrawn if
+// the routine gets cancelled. Hand-written suspension points should use these
+// rather than calling the runtime directly.
+template <class Ctx>
+void SuspendUntil(const Ctx* ctx, TimePoint when) {
+    if (ctx->cancel != nullptr) {
+        ctx->cancel->Arm(
+            [](void*, uintptr_t when, IRoutine* routine, IRuntime* rt) {
+                auto ticks = static_cast<Duration::rep>(when);
+                return rt->CancelAfter(TimePoint{Duration{ticks}}, routine);
+            },
+            nullptr, static_cast<uintptr_t>(when.time_since_epoch().count()));
+    }
+    RuntimeOf(ctx)->After(when, ctx->self);
+}
+
+template <class Ctx>
+void SuspendUntilReady(const Ctx* ctx, RawFd fd, InterestKind interest) {
+    if (ctx->cancel != nullptr) {
+        ctx->cancel->Arm(
+            [](void*, uintptr_t fd, IRoutine* routine, IRuntime* rt) {
+                return rt->CancelWhenReady(static_cast<RawFd>(fd), routine);
+            },
+            nullptr, static_cast<uintptr_t>(fd));
+    }
+    RuntimeOf(ctx)->WhenReady(fd, interest, ctx->self);
+}
+
+#define SLEEP_UNTIL(when) SUSPEND_AND({ SuspendUntil(CTX_VAR, when); })
 #define SLEEP_FOR(duration) SLEEP_UNTIL(Clock::now() + duration)
 
 #define WAIT_READY(fd, interest)                                               \
-    SUSPEND_AND({ CTX_VAR->rt->WhenReady(fd, interest, CTX_VAR->self); })
+    SUSPEND_AND({ SuspendUntilReady(CTX_VAR, fd, interest); })
+
+#define YIELD SUSPEND_AND({ RuntimeOf(CTX_VAR)->Submit(CTX_VAR->self); })
 
-#define YIELD SUSPEND_AND({ CTX_VAR->rt->Submit(CTX_VAR->self); })
+#define CANCELLED                                                              \
+    (CTX_VAR->cancel != nullptr && CTX_VAR->cancel->IsCancelled())
+
+// For steps that run long without suspending: once the routine is cancelled,
+// it yields here and its owner drops it
+#define CANCELLATION_POINT                                                     \
+    SUSPEND_IF(CANCELLED && (RuntimeOf(CTX_VAR)->Submit(CTX_VAR->self), true))
 
 template <class F>
 struct FMap {
@@ -56,11 +103,11 @@ template <class T, class F>
 auto operator|(T&& coro, FMap<F>&& f) {
     using Output = std::invoke_result_t<F, OutputOf<T>>;
 
-    struct FMapCoro : Pc {
+    struct FMapCoro : Pc, RuntimeOfCoro<T> {
         FMapCoro(T&& coro, F&& f) : inner(std::move(coro)), f(std::move(f)) {
         }
 
-        PROTO_CORO(Output) {
+        PROTO_CORO_LIKE(T, Output) {
             PC_BEGIN;
 
             {
@@ -89,21 +136,22 @@ auto operator|(T&& coro, AndThen<F>&& f) {
     using U = std::invoke_result_t<F, OutputOf<T>>;
     using Output = OutputOf<U>;
 
-    struct AndThenCoro : Pc {
+    struct AndThenCoro : Pc, RuntimeOfCoro<T> {
         AndThenCoro(T&& coro, F&& f) : first(std::move(coro)), f(std::move(f)) {
         }
 
-        PROTO_CORO(Output) {
+        PROTO_CORO_LIKE(T, Output) {
             PC_BEGIN;
 
             {
                 POLL_CORO(auto res, first);
                 new (second.template Get<U>()) U(f(std::move(*res)));
+                second.template Track<U>();
             }
 
             {
                 POLL(auto res, *reinterpret_cast<U*>(second.Get()));
-                reinterpret_cast<U*>(second.Get())->~U();
+                second.Destroy();
                 return res;
             }
 
@@ -112,7 +160,7 @@ auto operator|(T&& coro, AndThen<F>&& f) {
 
       private:
         T first;
-        StorageFor<U> second;
+        CalleeStorageFor<U> second;
         F f;
     };
 
@@ -129,7 +177,7 @@ struct DeletingCoro final : IRoutine {
     }
 
     void Step(IRuntime* rt) override {
-        Context ctx{this, rt};
+        auto ctx = MakeContext<T>(this, rt);
         if (inner_.Step(&ctx).has_value()) {
             delete this;
         }
@@ -138,3 +186,492 @@ struct DeletingCoro final : IRoutine {
   private:
     T inner_;
 };
+
+// Same as DeletingCoro, but allocated from a per-thread pool, so spawning one
+// per connection or per request does not go to the heap
+template <class T>
+struct PooledCoro final : IRoutine {
+    PooledCoro(T&& routine) : inner_(std::forward<T>(routine)) {
+    }
+
+    static void* operator new([[maybe_unused]] size_t size) {
+        assert(size == sizeof(PooledCoro));
+        return ObjectPool<PooledCoro>::Allocate();
+    }
+
+    static void operator delete(void* ptr) {
+        ObjectPool<PooledCoro>::Free(ptr);
+    }
+
+    T& GetInner() {
+        return inner_;
+    }
+
+    void Step(IRuntime* rt) override {
+        auto ctx = MakeContext<T>(this, rt);
+        if (inner_.Step(&ctx).has_value()) {
+            delete this;
+        }
+    }
+
+  private:
+    T inner_;
+};
+
+struct BranchBase;
+
+// The branches of a WhenAll or a WhenAny. The owner holds an arrival ticket of
+// its own, so no branch can resume it before it has started all of them.
+struct Fork {
+    static constexpr size_t kNoWinner = std::numeric_limits<size_t>::max();
+
+    Fork() = default;
+
+    // Only meaningful before the fork is started
+    Fork(Fork&&) noexcept {
+    }
+
+    // All branches are linked before any of them is started
+    void Link(BranchBase& branch, IRuntime* rt);
+
+    // If race is set, the first branch with an output cancels the rest
+    void Start(const Context* ctx, bool race);
+
+    // The arrival of the owner. Returns true if it has to wait for the
+    // branches, which resume it once the last of them arrives.
+    bool Wait(const Context* ctx) {
+        if (!Arrive()) {
+            return true;
+        }
+        if (ctx->cancel != nullptr) {
+            ctx->cancel->Disarm();
+        }
+        return false;
+    }
+
+    size_t Winner() const {
+        return winner_.load(std::memory_order_acquire);
+    }
+
+    void Cancel() {
+        CancelBranches(nullptr);
+    }
+
+  private:
+    friend struct BranchBase;
+
+    bool Arrive() {
+        return remaining_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    bool Elect(size_t index) {
+        auto none = kNoWinner;
+        return race_ && winner_.compare_exchange_strong(
+                            none, index, std::memory_order_acq_rel);
+    }
+
+    void CancelBranches(BranchBase* except);
+
+    BranchBase* head_ = nullptr;
+    BranchBase** tail_ = &head_;
+    size_t size_ = 0;
+
+    IRoutine* owner_ = nullptr;
+    bool race_ = false;
+    std::atomic<size_t> remaining_ = 0;
+    std::atomic<size_t> winner_ = kNoWinner;
+};
+
+// A coroutine running as a routine of its own on behalf of a fork. A cancelled
+// branch is never stepped again, yet it still arrives at the fork, once any
+// wakeup it was suspended on is either withdrawn or consumed.
+struct BranchBase : IRoutine {
+    BranchBase() = default;
+
+    // Only meaningful before the branch is started
+    BranchBase(BranchBase&&) noexcept {
+    }
+
+    void Cancel() {
+        if (cancel_.Cancel(this, rt_)) {
+            rt_->Submit(this);
+        }
+    }
+
+  protected:
+    // A wakeup may arrive before the step that suspended has returned, in
+    // which case that step goes on instead. Enter returns false then.
+    bool Enter() {
+        return activations_.fetch_add(1, std::memory_order_acq_rel) == 0;
+    }
+
+    // Returns false if the branch has to be stepped again
+    bool Leave() {
+        return activations_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+    }
+
+    // Must be the last thing the branch does
+    void Finish(IRuntime* rt, bool has_output) {
+        if (has_output && fork_->Elect(index_)) {
+            fork_->CancelBranches(this);
+        }
+        if (fork_->Arrive()) {
+            rt->Submit(fork_->owner_);
+        }
+    }
+
+    CancelState cancel_;
+
+  private:
+    friend struct Fork;
+
+    std::atomic<size_t> activations_ = 0;
+
+    Fork* fork_ = nullptr;
+    IRuntime* rt_ = nullptr;
+    BranchBase* next_ = nullptr;
+    size_t index_ = 0;
+};
+
+inline void Fork::Link(BranchBase& branch, IRuntime* rt) {
+    branch.fork_ = this;
+    branch.rt_ = rt;
+    branch.index_ = size_++;
+    *std::exchange(tail_, &branch.next_) = &branch;
+}
+
+inline void Fork::Start(const Context* ctx, bool race) {
+    owner_ = ctx->self;
+    race_ = race;
+    remaining_.store(size_ + 1, std::memory_order_relaxed);
+
+    if (ctx->cancel != nullptr) {
+        ctx->cancel->Arm(
+            [](void* fork, uintptr_t, IRoutine*, IRuntime*) {
+                static_cast<Fork*>(fork)->Cancel();
+                return false;
+            },
+            this);
+    }
+
+    for (auto* branch = head_; branch != nullptr; branch = branch->next_) {
+        ctx->rt->Submit(branch);
+    }
+}
+
+inline void Fork::CancelBranches(BranchBase* except) {
+    for (auto* branch = head_; branch != nullptr; branch = branch->next_) {
+        if (branch != except) {
+            branch->Cancel();
+        }
+    }
+}
+
+template <class T>
+struct Branch final : BranchBase {
+    explicit Branch(T&& coro) : coro_(std::move(coro)) {
+    }
+
+    Branch(Branch&& other) noexcept
+        : BranchBase(std::move(other)), coro_(std::move(other.coro_)) {
+    }
+
+    void Step(IRuntime* rt) override {
+        if (!Enter()) {
+            return;
+        }
+        do {
+            cancel_.Disarm();
+            if (cancel_.IsCancelled()) {
+                Finish(rt, false);
+                return;
+            }
+
+            auto ctx = MakeContext<T>(this, rt, &cancel_);
+            if (auto res = coro_.Step(&ctx)) {
+                output_.emplace(std::move(*res));
+                Finish(rt, true);
+                return;
+            }
+        } while (cancel_.Settle(this, rt) || !Leave());
+    }
+
+    bool HasOutput() const {
+        return output_.has_value();
+    }
+
+    OutputOf<T> TakeOutput() {
+        return std::move(*output_);
+    }
+
+  private:
+    T coro_;
+    std::optional<OutputOf<T>> output_;
+};
+
+template <bool Race, class... Ts>
+struct ForkCoro : Pc {
+    explicit ForkCoro(Ts... coros) : branches_(std::move(coros)...) {
+    }
+
+  protected:
+    void Link(const Context* ctx) {
+        std::apply(
+            [this, ctx](auto&... branch) {
+                (fork_.Link(branch, ctx->rt), ...);
+            },
+            branches_);
+    }
+
+    void Start(const Context* ctx) {
+        Link(ctx);
+        fork_.Start(ctx, Race);
+    }
+
+    std::tuple<Branch<Ts>...> branches_;
+    Fork fork_;
+};
+
+template <bool Race, class T>
+struct ForkRangeCoro : Pc {
+    explicit ForkRangeCoro(std::vector<T> coros) {
+        branches_.reserve(coros.size());
+        for (auto& coro : coros) {
+            branches_.emplace_back(std::move(coro));
+        }
+    }
+
+  protected:
+    void Start(const Context* ctx) {
+        for (auto& branch : branches_) {
+            fork_.Link(branch, ctx->rt);
+        }
+        fork_.Start(ctx, Race);
+    }
+
+    std::vector<Branch<T>> branches_;
+    Fork fork_;
+};
+
+template <class... Ts>
+struct WhenAllCoro : ForkCoro<false, Ts...> {
+    using Output = std::tuple<OutputOf<Ts>...>;
+    using ForkCoro<false, Ts...>::ForkCoro;
+
+    PROTO_CORO(Output) {
+        PC_BEGIN;
+
+        this->Start(CTX_VAR);
+        SUSPEND_IF(this->fork_.Wait(CTX_VAR));
+
+        return std::apply(
+            [](auto&... branch) {
+                return Output{branch.TakeOutput()...};
+            },
+            this->branches_);
+
+        PC_END;
+    }
+};
+
+template <class T>
+struct WhenAllRangeCoro : ForkRangeCoro<false, T> {
+    using Output = std::vector<OutputOf<T>>;
+    using ForkRangeCoro<false, T>::ForkRangeCoro;
+
+    PROTO_CORO(Output) {
+        PC_BEGIN;
+
+        this->Start(CTX_VAR);
+        SUSPEND_IF(this->fork_.Wait(CTX_VAR));
+
+        {
+            Output outputs;
+            outputs.reserve(this->branches_.size());
+            for (auto& branch : this->branches_) {
+                outputs.push_back(branch.TakeOutput());
+            }
+            return outputs;
+        }
+
+        PC_END;
+    }
+};
+
+template <class... Ts>
+struct WhenAnyCoro : ForkCoro<true, Ts...> {
+    using Output = std::variant<OutputOf<Ts>...>;
+    using ForkCoro<true, Ts...>::ForkCoro;
+
+    PROTO_CORO(Output) {
+        PC_BEGIN;
+
+        this->Start(CTX_VAR);
+        SUSPEND_IF(this->fork_.Wait(CTX_VAR));
+
+        return TakeWinner(std::index_sequence_for<Ts...>{});
+
+        PC_END;
+    }
+
+  private:
+    template <size_t... Is>
+    Output TakeWinner(std::index_sequence<Is...>) {
+        std::optional<Output> output;
+        auto winner = this->fork_.Winner();
+        ((winner == Is ? (void)output.emplace(
+                             std::in_place_index<Is>,
+                             std::get<Is>(this->branches_).TakeOutput())
+                       : (void)0),
+         ...);
+        return std::move(*output);
+    }
+};
+
+template <class T>
+struct WhenAnyRangeCoro : ForkRangeCoro<true, T> {
+    using Output = std::pair<size_t, OutputOf<T>>;
+
+    explicit WhenAnyRangeCoro(std::vector<T> coros)
+        : ForkRangeCoro<true, T>(std::move(coros)) {
+        assert(!this->branches_.empty());
+    }
+
+    PROTO_CORO(Output) {
+        PC_BEGIN;
+
+        this->Start(CTX_VAR);
+        SUSPEND_IF(this->fork_.Wait(CTX_VAR));
+
+        {
+            auto winner = this->fork_.Winner();
+            return Output{winner, this->branches_[winner].TakeOutput()};
+        }
+
+        PC_END;
+    }
+};
+
+// Runs the coroutines concurrently, each one as a routine of its own, and
+// completes with all of their outputs once the last of them is done.
+template <ProtoCoroutine... Ts>
+auto WhenAll(Ts&&... coros) {
+    return WhenAllCoro<std::remove_cvref_t<Ts>...>{std::forward<Ts>(coros)...};
+}
+
+template <ProtoCoroutine T>
+auto WhenAll(std::vector<T> coros) {
+    return WhenAllRangeCoro<T>{std::move(coros)};
+}
+
+// Runs the coroutines concurrently and completes with the output of the first
+// one to finish, tagged with its index. The rest are cancelled: the wakeups
+// they are suspended on are withdrawn and they are never stepped again.
+//
+// Completes only once every loser has settled, so the losers must suspend on
+// SLEEP_*, WAIT_READY or other points that can be withdrawn; a YIELD is fine
+// too, since its wakeup is already on the way.
+template <ProtoCoroutine... Ts>
+    requires(sizeof...(Ts) > 0)
+auto WhenAny(Ts&&... coros) {
+    return WhenAnyCoro<std::remove_cvref_t<Ts>...>{std::forward<Ts>(coros)...};
+}
+
+// The vector must not be empty, since there would be no winner. That is
+// checked in debug builds.
+template <ProtoCoroutine T>
+auto WhenAny(std::vector<T> coros) {
+    return WhenAnyRangeCoro<T>{std::move(coros)};
+}
+
+// Same as WhenAny, for coroutines with a common output that is all the caller
+// is interested in
+template <ProtoCoroutine... Ts>
+auto Race(Ts&&... coros) {
+    using Output = std::common_type_t<OutputOf<std::remove_cvref_t<Ts>>...>;
+    return WhenAny(std::forward<Ts>(coros)...) | FMap{[](auto res) {
+               return std::visit(
+                   [](auto& output) {
+                       return Output(std::move(output));
+                   },
+                   res);
+           }};
+}
+
+template <class T>
+struct WithCancelCoro : ForkCoro<false, T> {
+    using Output = std::optional<OutputOf<T>>;
+
+    WithCancelCoro(T coro, CancelToken token)
+        : ForkCoro<false, T>(std::move(coro)), token_(token) {
+    }
+
+    PROTO_CORO(Output) {
+        PC_BEGIN;
+
+        this->Link(CTX_VAR);
+        subscription_.on_cancel = [](void* fork) {
+            static_cast<Fork*>(fork)->Cancel();
+        };
+        subscription_.what = &this->fork_;
+        if (!token_.Source().Subscribe(&subscription_)) {
+            this->fork_.Cancel();
+        }
+        this->fork_.Start(CTX_VAR, false);
+        SUSPEND_IF(this->fork_.Wait(CTX_VAR));
+
+        token_.Source().Unsubscribe(&subscription_);
+        {
+            auto& branch = std::get<0>(this->branches_);
+            if (!branch.HasOutput()) {
+                return Output{std::nullopt};
+            }
+            return Output{branch.TakeOutput()};
+        }
+
+        PC_END;
+    }
+
+  private:
+    CancelToken token_;
+    CancelSubscription subscription_;
+};
+
+// Runs the coroutine as a routine of its own, which is dropped as soon as
+// the token is cancelled. Completes with nothing in that case.
+template <ProtoCoroutine T>
+auto WithCancel(T&& coro, CancelToken token) {
+    return WithCancelCoro<std::remove_cvref_t<T>>{std::forward<T>(coro),
+                                                  token};
+}
+
+struct Sleep : Pc {
+    explicit Sleep(Duration duration) : duration_(duration) {
+    }
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        SLEEP_FOR(duration_);
+        return Unit{};
+
+        PC_END;
+    }
+
+  private:
+    Duration duration_;
+};
+
+// Completes with nothing if the coroutine doesn't finish within duration, in
+// which case it is cancelled. The clock starts with the first step.
+template <ProtoCoroutine T>
+auto Timeout(T&& coro, Duration duration) {
+    using Output = std::optional<OutputOf<std::remove_cvref_t<T>>>;
+    return WhenAny(std::forward<T>(coro), Sleep{duration}) |
+           FMap{[](auto res) {
+               if (res.index() != 0) {
+                   return Output{std::nullopt};
+               }
+               return Output{std::get<0>(std::move(res))};
+           }};
+}
@@ -1,9 +1,36 @@
 #pragma once
 
+#include <memory_resource>
+
 struct IRuntime;
 struct IRoutine;
+struct CancelState;
 
 struct Context {
     IRoutine* self;
     IRuntime* rt;
+    // Set when the routine can be cancelled by its owner
+    CancelState* cancel = nullptr;
+    // Set when the routine runs with an arena of its own, see arena.hpp
+    std::pmr::memory_resource* arena = nullptr;
+};
+
+// A context of a routine known to run on a runtime of type Rt, so that calls
+// on the runtime are dispatched statically. Converts to a plain Context for
+// the coroutines that do not care.
+template <class Rt>
+struct TypedContext : Context {
+    Rt* Runtime() const {
+        return static_cast<Rt*>(rt);
+    }
 };
+
+// The runtime, of the most concrete type the context knows
+inline IRuntime* RuntimeOf(const Context* ctx) {
+    return ctx->rt;
+}
+
+template <class Rt>
+Rt* RuntimeOf(const TypedContext<Rt>* ctx) {
+    return ctx->Runtime();
+}
@@ -2,38 +2,20 @@
 
 #include "epoll.hpp"
 #include "fail.hpp"
+#include "fd-table.hpp"
 #include "mpmc-queue.hpp"
 #include "mpsc-timer-queue.hpp"
 
 #include <proto-coro/unused.hpp>
 
+#include <cassert>
 #include <sys/epoll.h>
 #include <thread>
 #include <vector>
 
-#ifdef TSAN
-extern "C" {
-void __tsan_acquire(void* ptr);
-void __tsan_release(void* ptr);
-}
-
-static void Acquire(void* ptr) {
-    __tsan_acquire(ptr);
-}
-
-static void Release(void* ptr) {
-    __tsan_release(ptr);
-}
-#else
-static void Acquire(void*) {
-}
-
-static void Release(void*) {
-}
-#endif
-
 struct EventLoop::Impl {
-    Impl(size_t num_workers) : workers_(num_workers) {
+    Impl(size_t num_workers, uint32_t budget)
+        : workers_(num_workers), budget_(budget) {
     }
 
     void Start(EventLoop* self) {
@@ -59,12 +41,21 @@ struct EventLoop::Impl {
         tasks_.Push(routine);
     }
 
+    size_t Concurrency() const {
+        return workers_.size();
+    }
+
     void After(TimePoint when, IRoutine* routine) {
         timers_.Push(when, routine);
     }
 
     void RegisterFd(int fd) {
-        if (epoll_.Register(fd, 0, nullptr) < 0) {
+        if (!FdTable::Fits(fd)) {
+            Fail("register fd");
+        }
+        auto& slot = fds_.Ensure(fd);
+        slot.waiter.store(nullptr, std::memory_order_relaxed);
+        if (epoll_.Register(fd, EPOLLONESHOT, &slot) < 0) {
             Fail("register fd");
         }
     }
@@ -76,7 +67,6 @@ struct EventLoop::Impl {
     }
 
     void WhenReady(int fd, InterestKind type, IRoutine* routine) {
-        Release(routine);
         uint32_t epoll_flags = EPOLLONESHOT;
         auto utype = static_cast<uint8_t>(type);
         if (utype & static_cast<uint8_t>(InterestKind::Readable)) {
@@ -86,14 +76,29 @@ struct EventLoop::Impl {
             epoll_flags |= EPOLLOUT;
         }
 
-        if (epoll_.Modify(fd, epoll_flags, routine) < 0) {
+        auto& slot = fds_.At(fd);
+        slot.waiter.store(routine, std::memory_order_release);
+        // An event left over from a cancelled wait may already have resumed
+        // the routine, which might even have closed the fd by now
+        if (epoll_.Modify(fd, epoll_flags, &slot) < 0 &&
+            slot.waiter.load(std::memory_order_relaxed) == routine) {
             Fail("modify fd");
         }
     }
 
+    bool CancelAfter(TimePoint when, IRoutine* routine) {
+        return timers_.Remove(when, routine);
+    }
+
+    bool CancelWhenReady(int fd, IRoutine* routine) {
+        return fds_.At(fd).waiter.compare_exchange_strong(
+            routine, nullptr, std::memory_order_acq_rel);
+    }
+
   private:
     void WorkerThread(EventLoop* self) {
         while (auto task = tasks_.Pop()) {
+            Budget::Reset(budget_);
             (*task)->Step(self);
         }
     }
@@ -109,13 +114,17 @@ struct EventLoop::Impl {
         auto s = std::span{buf};
         while (auto tasks = epoll_.Poll(-1, s)) {
             for (auto& task : s.first(*tasks)) {
-                Acquire(task.second);
-                Submit(static_cast<IRoutine*>(task.second));
+                auto* slot = static_cast<FdSlot*>(task.second);
+                if (auto* routine = slot->waiter.exchange(
+                        nullptr, std::memory_order_acq_rel)) {
+                    Submit(routine);
+                }
             }
         }
     }
 
     std::vector<std::thread> workers_;
+    uint32_t budget_;
     MPMCQueue<IRoutine*> tasks_;
 
     std::thread timer_thread_;
@@ -123,9 +132,12 @@ struct EventLoop::Impl {
 
     std::thread epoll_thread_;
     Epoll epoll_;
+    FdTable fds_;
 };
 
-EventLoop::EventLoop(size_t num_workers) : impl_(num_workers) {
+EventLoop::EventLoop(size_t num_workers, uint32_t budget)
+    : impl_(num_workers, budget) {
+    assert(budget > 0);
 }
 
 void EventLoop::Start() {
@@ -156,4 +168,16 @@ void EventLoop::WhenReady(int fd, InterestKind type, IRoutine* routine) {
     impl_->WhenReady(fd, type, routine);
 }
 
+bool EventLoop::CancelAfter(TimePoint when, IRoutine* routine) {
+    return impl_->CancelAfter(when, routine);
+}
+
+bool EventLoop::CancelWhenReady(int fd, IRoutine* routine) {
+    return impl_->CancelWhenReady(fd, routine);
+}
+
+size_t EventLoop::Concurrency() const {
+    return impl_->Concurrency();
+}
+
 EventLoop::~EventLoop() = default;
@@ -1,11 +1,16 @@
 #pragma once
 
+#include <proto-coro/budget.hpp>
 #include <proto-coro/fast-pimpl.hpp>
 #include <proto-coro/routine.hpp>
 #include <proto-coro/rt.hpp>
 
-struct EventLoop : IRuntime {
-    EventLoop(size_t num_workers);
+struct EventLoop final : IRuntime {
+    // Every step of a routine gets a budget of budget operations, see
+    // budget.hpp. With none, every operation would yield before trying, so it
+    // has to be at least 1, which is enough for a step to get an operation
+    // done. Budget::kUnlimited turns preemption off.
+    EventLoop(size_t num_workers, uint32_t budget = Budget::kDefault);
 
     void Start();
 
@@ -19,9 +24,14 @@ struct EventLoop : IRuntime {
     void DeregisterFd(int fd) override;
     void WhenReady(int fd, InterestKind type, IRoutine* routine) override;
 
+    bool CancelAfter(TimePoint when, IRoutine* routine) override;
+    bool CancelWhenReady(int fd, IRoutine* routine) override;
+
+    size_t Concurrency() const override;
+
     ~EventLoop();
 
   private:
     struct Impl;
-    FastPimpl<Impl, 360, 8> impl_;
+    FastPimpl<Impl, 512, 8> impl_;
 };
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <proto-coro/routine.hpp>
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+
+// The routine waiting on a registered fd. Whoever takes it out of the slot,
+// the epoll thread or a canceller, owns the wakeup.
+struct FdSlot {
+    std::atomic<IRoutine*> waiter = nullptr;
+};
+
+// Slots of registered fds, indexed by the fd itself. Chunks are only freed
+// along with the table, so looking a slot up needs no locking.
+struct FdTable {
+    static constexpr size_t kChunkSize = 1024;
+    static constexpr size_t kMaxChunks = 1024;
+
+    FdTable() : chunks_(std::make_unique<std::atomic<FdSlot*>[]>(kMaxChunks)) {
+    }
+
+    static bool Fits(int fd) {
+        return fd >= 0 && static_cast<size_t>(fd) < kChunkSize * kMaxChunks;
+    }
+
+    // The slot has to be created by Ensure beforehand
+    FdSlot& At(int fd) {
+        auto* chunk = chunks_[fd / kChunkSize].load(std::memory_order_acquire);
+        assert(chunk != nullptr);
+        return chunk[fd % kChunkSize];
+    }
+
+    FdSlot& Ensure(int fd) {
+        assert(Fits(fd));
+        auto& chunk = chunks_[fd / kChunkSize];
+        if (chunk.load(std::memory_order_acquire) == nullptr) {
+            std::lock_guard lk{m_};
+            if (chunk.load(std::memory_order_relaxed) == nullptr) {
+                chunk.store(new FdSlot[kChunkSize], std::memory_order_release);
+            }
+        }
+        return At(fd);
+    }
+
+    ~FdTable() {
+        for (size_t i = 0; i < kMaxChunks; ++i) {
+            delete[] chunks_[i].load(std::memory_order_relaxed);
+        }
+    }
+
+  private:
+    std::mutex m_;
+    std::unique_ptr<std::atomic<FdSlot*>[]> chunks_;
+};
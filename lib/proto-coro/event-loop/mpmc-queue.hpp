@@ -2,35 +2,75 @@
 
 #include <proto-coro/unused.hpp>
 
+#include <algorithm>
 #include <cassert>
 #include <condition_variable>
 #include <mutex>
 #include <optional>
-#include <queue>
 #include <utility>
+#include <vector>
 
+// Unlike std::deque, never allocates once it has grown to the largest size
+// it has to hold
 template <class T>
-class MPMCQueue {
+class GrowingRing {
   public:
+    bool Empty() const {
+        return size_ == 0;
+    }
+
     void Push(T value) {
-        {
-            std::lock_guard lk{m_};
-            queue_.push(std::move(value));
+        if (size_ == buf_.size()) {
+            Grow();
+        }
+        buf_[(head_ + size_++) & (buf_.size() - 1)] = std::move(value);
+    }
+
+    T Pop() {
+        auto value = std::move(buf_[head_]);
+        head_ = (head_ + 1) & (buf_.size() - 1);
+        --size_;
+        return value;
+    }
+
+  private:
+    static constexpr size_t kInitialCapacity = 64;
+
+    void Grow() {
+        std::vector<T> grown(std::max(buf_.size() * 2, kInitialCapacity));
+        for (size_t i = 0; i < size_; ++i) {
+            grown[i] = std::move(buf_[(head_ + i) & (buf_.size() - 1)]);
         }
+        buf_ = std::move(grown);
+        head_ = 0;
+    }
+
+    std::vector<T> buf_;
+    size_t head_ = 0;
+    size_t size_ = 0;
+};
+
+template <class T>
+class MPMCQueue {
+  public:
+    // Notifies under the lock: whoever submits from outside the loop, e.g. a
+    // thread of the blocking pool, may be waking up the last routine, after
+    // which the loop can be stopped and destroyed right away
+    void Push(T value) {
+        std::lock_guard lk{m_};
+        queue_.Push(std::move(value));
         has_items_or_closed_.notify_one();
     }
 
     std::optional<T> Pop() {
         std::unique_lock lk{m_};
         has_items_or_closed_.wait(lk, [this] {
-            return !queue_.empty() || closed_;
+            return !queue_.Empty() || closed_;
         });
-        if (queue_.empty()) {
+        if (queue_.Empty()) {
             return std::nullopt;
         }
-        auto value = std::move(queue_.front());
-        queue_.pop();
-        return value;
+        return queue_.Pop();
     }
 
     void Close() {
@@ -49,5 +89,5 @@ class MPMCQueue {
     std::condition_variable has_items_or_closed_;
 
     bool closed_ = false;
-    std::queue<T> queue_;
+    GrowingRing<T> queue_;
 };
@@ -2,28 +2,39 @@
 
 #include <proto-coro/rt.hpp>
 
+#include <algorithm>
 #include <cassert>
 #include <condition_variable>
+#include <map>
+#include <memory_resource>
 #include <mutex>
 #include <optional>
-#include <queue>
 
 template <class T>
 struct MPSCTimerQueue {
     void Push(TimePoint when, T value) {
         std::lock_guard lk{m_};
-        auto top_before = TopItem();
+        auto it = queue_.emplace(when, std::move(value));
 
-        queue_.push(Item{
-            .when = when,
-            .value = std::move(value),
-        });
-
-        if (when < top_before) {
+        if (it == queue_.begin()) {
             has_items_or_closed_.notify_one();
         }
     }
 
+    // Returns true if the item was still queued
+    bool Remove(TimePoint when, const T& value) {
+        std::lock_guard lk{m_};
+        auto [first, last] = queue_.equal_range(when);
+        auto it = std::find_if(first, last, [&value](const auto& item) {
+            return item.second == value;
+        });
+        if (it == last) {
+            return false;
+        }
+        queue_.erase(it);
+        return true;
+    }
+
     std::optional<T> Pop() {
         std::unique_lock lk{m_};
 
@@ -36,8 +47,9 @@ struct MPSCTimerQueue {
         if (queue_.empty()) {
             return std::nullopt;
         }
-        auto value = std::move(queue_.top().value);
-        queue_.pop();
+        auto it = queue_.begin();
+        auto value = std::move(it->second);
+        queue_.erase(it);
         return value;
     }
 
@@ -51,25 +63,19 @@ struct MPSCTimerQueue {
     }
 
   private:
-    struct Item {
-        TimePoint when;
-        mutable T value;
-
-        bool operator<(const Item& other) const {
-            return when < other.when;
-        }
-    };
-
     TimePoint TopItem() {
         if (queue_.empty()) {
             return TimePoint::max();
         }
-        return queue_.top().when;
+        return queue_.begin()->first;
     }
 
     std::mutex m_;
     std::condition_variable has_items_or_closed_;
 
     bool closed_ = false;
-    std::priority_queue<Item> queue_;
+    // Recycles the nodes of fired timers, so that a steady flow of timers
+    // doesn't go to the allocator
+    std::pmr::unsynchronized_pool_resource pool_;
+    std::pmr::multimap<TimePoint, T> queue_{&pool_};
 };
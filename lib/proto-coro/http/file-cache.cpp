@@ -0,0 +1,305 @@
+#include "file-cache.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <functional>
+#include <linux/openat2.h>
+#include <mutex>
+#include <shared_mutex>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <unordered_map>
+
+namespace {
+
+std::string_view ContentTypeOf(std::string_view path) {
+    constexpr std::pair<std::string_view, std::string_view> kTypes[] = {
+        {".html", "text/html; charset=utf-8"},
+        {".css", "text/css; charset=utf-8"},
+        {".js", "text/javascript; charset=utf-8"},
+        {".json", "application/json"},
+        {".txt", "text/plain; charset=utf-8"},
+        {".svg", "image/svg+xml"},
+        {".png", "image/png"},
+        {".jpg", "image/jpeg"},
+        {".gif", "image/gif"},
+        {".ico", "image/x-icon"},
+        {".wasm", "application/wasm"},
+    };
+    for (auto [ext, type] : kTypes) {
+        if (path.ends_with(ext)) {
+            return type;
+        }
+    }
+    return "application/octet-stream";
+}
+
+// The date format of HTTP, RFC 9110 section 5.6.7
+std::string HttpDate(time_t time) {
+    tm parts;
+    gmtime_r(&time, &parts);
+    char buf[64];
+    auto n = strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &parts);
+    return std::string(buf, n);
+}
+
+// Maps a request path to one under the root into full, refusing the ones
+// that would leave it. Paths that name the same file resolve the same.
+bool ResolvePath(const std::string& root, std::string_view path,
+                 std::string& full) {
+    full.assign(root);
+    size_t pos = 0;
+    while (pos <= path.size()) {
+        auto end = std::min(path.find('/', pos), path.size());
+        auto segment = path.substr(pos, end - pos);
+        pos = end + 1;
+        if (segment.empty() || segment == ".") {
+            continue;
+        }
+        if (segment == ".." || segment.find('\0') != std::string_view::npos) {
+            return false;
+        }
+        full.append("/").append(segment);
+    }
+    if (path.empty() || path.ends_with('/')) {
+        full.append("/index.html");
+    }
+    return true;
+}
+
+// Opens path, relative to the directory dir, without leaving it through ..
+// or through symlinks, failing with ENOENT for paths that would. Symlinks
+// that stay under dir are followed. Doesn't block on FIFOs, which are not
+// served anyway.
+std::expected<OwnedFd, int> OpenBeneath(const OwnedFd& dir,
+                                        const std::string& path) {
+    if (!dir.IsValid()) {
+        return std::unexpected(ENOENT);
+    }
+    open_how how{};
+    how.flags = O_RDONLY | O_CLOEXEC | O_NONBLOCK;
+    how.resolve = RESOLVE_BENEATH | RESOLVE_NO_MAGICLINKS;
+    int fd = static_cast<int>(
+        syscall(SYS_openat2, dir.AsRawFd(), path.c_str(), &how, sizeof(how)));
+    if (fd < 0) {
+        return std::unexpected(errno == EXDEV || errno == ELOOP ? ENOENT
+                                                                : errno);
+    }
+    return OwnedFd::FromRaw(fd);
+}
+
+}  // namespace
+
+StaticFile::~StaticFile() {
+    if (mapped_ && size_ > 0) {
+        munmap(data_, size_);
+    }
+}
+
+struct FileCache::Impl {
+    struct Hash {
+        using is_transparent = void;
+
+        size_t operator()(std::string_view s) const {
+            return std::hash<std::string_view>{}(s);
+        }
+    };
+
+    Impl(std::string root, Options options)
+        : root_(std::move(root)), options_(options),
+          root_fd_(OwnedFd::FromRaw(
+              ::open(root_.c_str(), O_PATH | O_DIRECTORY | O_CLOEXEC))) {
+    }
+
+    Entry Find(std::string_view path) const {
+        // Reused, so that lookups on the workers don't allocate
+        thread_local std::string full;
+        if (!ResolvePath(root_, path, full)) {
+            return nullptr;
+        }
+        std::shared_lock lk{m_};
+        auto it = entries_.find(full);
+        if (it == entries_.end()) {
+            return nullptr;
+        }
+        auto age = Clock::now().time_since_epoch().count() -
+                   it->second->checked_.load(std::memory_order_relaxed);
+        if (Duration{age} >= options_.revalidate_after) {
+            return nullptr;
+        }
+        return it->second;
+    }
+
+    std::expected<Entry, int> Load(std::string_view path) {
+        std::string full;
+        if (!ResolvePath(root_, path, full)) {
+            return std::unexpected(ENOENT);
+        }
+        auto file = LoadResolved(full);
+        if (!file.has_value()) {
+            // The file is gone, or can't be served anymore
+            Forget(full);
+        }
+        return file;
+    }
+
+    size_t TotalMapped() const {
+        std::shared_lock lk{m_};
+        return total_mapped_;
+    }
+
+    size_t Size() const {
+        std::shared_lock lk{m_};
+        return entries_.size();
+    }
+
+  private:
+    std::expected<Entry, int> LoadResolved(const std::string& full) {
+        // Opened rather than looked up by full, so that the file found is
+        // the one confined to the root
+        auto fd = OpenBeneath(root_fd_, full.substr(root_.size() + 1));
+        if (!fd.has_value()) {
+            return std::unexpected(fd.error());
+        }
+        struct stat st;
+        if (fstat(fd->AsRawFd(), &st) != 0) {
+            return std::unexpected(errno);
+        }
+        if (!S_ISREG(st.st_mode)) {
+            return std::unexpected(ENOENT);
+        }
+
+        auto now = Clock::now().time_since_epoch().count();
+        {
+            std::shared_lock lk{m_};
+            auto it = entries_.find(full);
+            if (it != entries_.end() && Unchanged(*it->second, st)) {
+                it->second->checked_.store(now, std::memory_order_relaxed);
+                return it->second;
+            }
+        }
+
+        auto file = std::make_shared<StaticFile>();
+        file->fd_ = std::move(*fd);
+        file->size_ = st.st_size;
+        file->mtime_ = st.st_mtim;
+        file->checked_.store(now, std::memory_order_relaxed);
+        file->headers_.append("Content-Type: ")
+            .append(ContentTypeOf(full))
+            .append("\r\nLast-Modified: ")
+            .append(HttpDate(st.st_mtim.tv_sec))
+            .append("\r\n");
+
+        if (file->size_ <= options_.max_mapped_size &&
+            ReserveMapped(file->size_)) {
+            if (file->size_ > 0) {
+                void* data =
+                    mmap(nullptr, file->size_, PROT_READ, MAP_PRIVATE,
+                         file->fd_.AsRawFd(), 0);
+                if (data == MAP_FAILED) {
+                    int error = errno;
+                    ReleaseMapped(file->size_);
+                    return std::unexpected(error);
+                }
+                file->data_ = data;
+            }
+            file->mapped_ = true;
+            file->fd_.Reset();
+        }
+
+        std::lock_guard lk{m_};
+        auto it = entries_.find(full);
+        if (it != entries_.end()) {
+            Unmapped(*it->second);
+            it->second = file;
+            return file;
+        }
+        if (entries_.size() >= std::max<size_t>(options_.max_entries, 1)) {
+            EvictStalest();
+        }
+        entries_.emplace(full, file);
+        return file;
+    }
+
+    void Forget(const std::string& full) {
+        std::lock_guard lk{m_};
+        auto it = entries_.find(full);
+        if (it != entries_.end()) {
+            Unmapped(*it->second);
+            entries_.erase(it);
+        }
+    }
+
+    // Makes room for an entry by dropping the one checked longest ago. Only
+    // happens once the cache is full, and on the blocking pool.
+    void EvictStalest() {
+        auto stalest = std::ranges::min_element(
+            entries_, std::less<>{}, [](const auto& entry) {
+                return entry.second->checked_.load(std::memory_order_relaxed);
+            });
+        Unmapped(*stalest->second);
+        entries_.erase(stalest);
+    }
+
+    // Holders of the entry keep its mapping until they let go, yet it no
+    // longer counts against the limit
+    void Unmapped(const StaticFile& file) {
+        if (file.IsMapped()) {
+            total_mapped_ -= file.Size();
+        }
+    }
+
+    static bool Unchanged(const StaticFile& file, const struct stat& st) {
+        return file.size_ == static_cast<size_t>(st.st_size) &&
+               file.mtime_.tv_sec == st.st_mtim.tv_sec &&
+               file.mtime_.tv_nsec == st.st_mtim.tv_nsec;
+    }
+
+    bool ReserveMapped(size_t size) {
+        std::lock_guard lk{m_};
+        if (total_mapped_ + size > options_.max_total_mapped) {
+            return false;
+        }
+        total_mapped_ += size;
+        return true;
+    }
+
+    void ReleaseMapped(size_t size) {
+        std::lock_guard lk{m_};
+        total_mapped_ -= size;
+    }
+
+    const std::string root_;
+    const Options options_;
+    // Opened once, paths are resolved beneath it
+    const OwnedFd root_fd_;
+
+    mutable std::shared_mutex m_;
+    std::unordered_map<std::string, Entry, Hash, std::equal_to<>> entries_;
+    size_t total_mapped_ = 0;
+};
+
+FileCache::FileCache(std::string root, Options options)
+    : impl_(std::move(root), options) {
+}
+
+FileCache::Entry FileCache::Find(std::string_view path) const {
+    return impl_->Find(path);
+}
+
+std::expected<FileCache::Entry, int> FileCache::Load(std::string_view path) {
+    return impl_->Load(path);
+}
+
+size_t FileCache::TotalMapped() const {
+    return impl_->TotalMapped();
+}
+
+size_t FileCache::Size() const {
+    return impl_->Size();
+}
+
+FileCache::~FileCache() = default;
@@ -0,0 +1,115 @@
+#pragma once
+
+#include <proto-coro/blocking/spawn-blocking.hpp>
+#include <proto-coro/event-loop/owned-fd.hpp>
+#include <proto-coro/fast-pimpl.hpp>
+#include <proto-coro/rt.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <expected>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+
+// A file of the cache, immutable once loaded. A changed file gets a new
+// entry, and the old one stays valid for as long as someone holds it.
+struct StaticFile {
+    StaticFile() = default;
+    StaticFile(const StaticFile&) = delete;
+    StaticFile& operator=(const StaticFile&) = delete;
+    ~StaticFile();
+
+    bool IsMapped() const {
+        return mapped_;
+    }
+
+    // The contents, if the file is small enough to be mapped
+    std::string_view Data() const {
+        return {static_cast<const char*>(data_), size_};
+    }
+
+    // Otherwise the file is open for sendfile
+    int Fd() const {
+        return fd_.AsRawFd();
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+    // Header lines for a response with the file, such as Content-Type and
+    // Last-Modified, each ending with CRLF
+    std::string_view Headers() const {
+        return headers_;
+    }
+
+  private:
+    friend struct FileCache;
+
+    void* data_ = nullptr;
+    bool mapped_ = false;
+    OwnedFd fd_;
+    size_t size_ = 0;
+    std::string headers_;
+    timespec mtime_{};
+    // When the file was last seen to be the same, in Clock ticks
+    mutable std::atomic<Clock::rep> checked_{0};
+};
+
+// Files under a root directory, for serving them. Files up to
+// max_mapped_size are mapped into memory, up to max_total_mapped in all;
+// the others stay open to be sent with sendfile. Entries are keyed by the
+// file rather than by the path it was asked for, and there are at most
+// max_entries of them: once full, the cache drops the one checked longest
+// ago. The entry of a file that is found missing is dropped as well. An
+// entry is checked against the mtime and size of its file once it is older
+// than revalidate_after. A mapping shows changes made to its file in place,
+// and faults on access once the file is truncated, so replace files by
+// renaming new ones over them.
+struct FileCache {
+    struct Options {
+        size_t max_mapped_size = 64 * 1024;
+        size_t max_total_mapped = 64 * 1024 * 1024;
+        size_t max_entries = 1024;
+        Duration revalidate_after = std::chrono::seconds{1};
+    };
+
+    using Entry = std::shared_ptr<const StaticFile>;
+
+    explicit FileCache(std::string root, Options options);
+    explicit FileCache(std::string root) : FileCache(std::move(root), {}) {
+    }
+
+    FileCache(const FileCache&) = delete;
+    FileCache& operator=(const FileCache&) = delete;
+
+    // The entry for path, relative to the root, if it is fresh. Doesn't
+    // touch the file system, so it is fine to call on a worker.
+    Entry Find(std::string_view path) const;
+
+    // Looks the file up, loading it unless the entry is still up to date.
+    // Blocks on the file system, so run it off the workers, see LoadFile.
+    // Fails with ENOENT for paths that would escape the root, through .. or
+    // through a symlink. Relies on openat2, so Linux 5.6 or later.
+    std::expected<Entry, int> Load(std::string_view path);
+
+    size_t TotalMapped() const;
+
+    // The number of entries
+    size_t Size() const;
+
+    ~FileCache();
+
+  private:
+    struct Impl;
+    FastPimpl<Impl, 192, 8> impl_;
+};
+
+// Load on the blocking pool
+inline auto LoadFile(FileCache& cache, std::string path) {
+    return SpawnBlocking(
+        [&cache, path = std::move(path)] { return cache.Load(path); });
+}
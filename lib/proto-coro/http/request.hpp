@@ -0,0 +1,193 @@
+#pragma once
+
+#include <algorithm>
+#include <charconv>
+#include <cstddef>
+#include <cstdint>
+#include <expected>
+#include <memory_resource>
+#include <optional>
+#include <string_view>
+#include <vector>
+
+// Ends the head of every HTTP/1.x message
+constexpr std::string_view kHttpHeadEnd = "\r\n\r\n";
+
+struct HttpHeader {
+    std::string_view name;
+    std::string_view value;
+};
+
+// Points into the buffer the head was parsed from, which has to stay put for
+// as long as the request is used
+struct HttpRequest {
+    using Headers = std::pmr::vector<HttpHeader>;
+
+    explicit HttpRequest(
+        std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+        : headers(memory) {
+    }
+
+    std::string_view method;
+    std::string_view target;
+    int minor_version = 1;
+    Headers headers;
+    size_t content_length = 0;
+    bool keep_alive = true;
+
+    // The value of the first header called name, in any case
+    std::optional<std::string_view> Find(std::string_view name) const;
+};
+
+namespace http_detail {
+
+// Folds ASCII letters only, so that e.g. '@' and '`' stay apart
+inline char ToLowerAscii(char c) {
+    return c >= 'A' && c <= 'Z' ? static_cast<char>(c | 0x20) : c;
+}
+
+inline bool EqualsIgnoreCase(std::string_view a, std::string_view b) {
+    return std::ranges::equal(a, b, [](char x, char y) {
+        return ToLowerAscii(x) == ToLowerAscii(y);
+    });
+}
+
+// The characters of a method or a header name, RFC 9110 section 5.6.2
+inline bool IsTokenChar(char c) {
+    if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+        (c >= '0' && c <= '9')) {
+        return true;
+    }
+    return std::string_view{"!#$%&'*+-.^_`|~"}.find(c) !=
+           std::string_view::npos;
+}
+
+inline bool IsToken(std::string_view s) {
+    return !s.empty() && std::ranges::all_of(s, IsTokenChar);
+}
+
+inline std::string_view TrimWhitespace(std::string_view s) {
+    while (!s.empty() && (s.front() == ' ' || s.front() == '\t')) {
+        s.remove_prefix(1);
+    }
+    while (!s.empty() && (s.back() == ' ' || s.back() == '\t')) {
+        s.remove_suffix(1);
+    }
+    return s;
+}
+
+// Whether the comma separated list has option, as Connection does
+inline bool HasOption(std::string_view list, std::string_view option) {
+    while (!list.empty()) {
+        auto comma = std::min(list.find(','), list.size());
+        if (EqualsIgnoreCase(TrimWhitespace(list.substr(0, comma)), option)) {
+            return true;
+        }
+        list.remove_prefix(std::min(comma + 1, list.size()));
+    }
+    return false;
+}
+
+// Cuts the line off the front of head, without its CRLF
+inline std::optional<std::string_view> TakeLine(std::string_view& head) {
+    auto end = head.find("\r\n");
+    if (end == std::string_view::npos) {
+        return std::nullopt;
+    }
+    auto line = head.substr(0, end);
+    head.remove_prefix(end + 2);
+    return line;
+}
+
+}  // namespace http_detail
+
+inline std::optional<std::string_view> HttpRequest::Find(
+    std::string_view name) const {
+    for (const auto& header : headers) {
+        if (http_detail::EqualsIgnoreCase(header.name, name)) {
+            return header.value;
+        }
+    }
+    return std::nullopt;
+}
+
+// Parses a complete head, up to and including kHttpHeadEnd, as
+// BufReader::PeekUntil gives it. Nothing is copied: the request refers to
+// head. On failure gives the status code to answer with.
+inline std::expected<void, uint16_t> ParseHttpRequest(std::string_view head,
+                                                      HttpRequest& request) {
+    using namespace http_detail;
+
+    if (!head.ends_with(kHttpHeadEnd)) {
+        return std::unexpected(400);
+    }
+    request.headers.clear();
+    request.content_length = 0;
+
+    {
+        auto line = *TakeLine(head);
+        auto sp1 = line.find(' ');
+        auto sp2 = line.find(' ', sp1 + 1);
+        if (sp1 == std::string_view::npos || sp2 == std::string_view::npos) {
+            return std::unexpected(400);
+        }
+        request.method = line.substr(0, sp1);
+        request.target = line.substr(sp1 + 1, sp2 - sp1 - 1);
+        auto version = line.substr(sp2 + 1);
+        if (!IsToken(request.method) || request.target.empty() ||
+            version.size() != 8 || !version.starts_with("HTTP/1.") ||
+            version[7] < '0' || version[7] > '9') {
+            return std::unexpected(400);
+        }
+        request.minor_version = version[7] - '0';
+    }
+
+    bool has_length = false;
+    std::optional<std::string_view> connection;
+    while (true) {
+        auto line = *TakeLine(head);
+        if (line.empty()) {
+            break;
+        }
+        auto colon = line.find(':');
+        if (colon == std::string_view::npos) {
+            return std::unexpected(400);
+        }
+        // Also rules out the obsolete folding of values onto more lines
+        HttpHeader header{line.substr(0, colon),
+                          TrimWhitespace(line.substr(colon + 1))};
+        if (!IsToken(header.name)) {
+            return std::unexpected(400);
+        }
+
+        if (EqualsIgnoreCase(header.name, "Content-Length")) {
+            size_t length = 0;
+            auto [end, ec] =
+                std::from_chars(header.value.data(),
+                                header.value.data() + header.value.size(),
+                                length);
+            if (ec != std::errc{} || header.value.empty() ||
+                end != header.value.data() + header.value.size() ||
+                (has_length && length != request.content_length)) {
+                return std::unexpected(400);
+            }
+            has_length = true;
+            request.content_length = length;
+        } else if (EqualsIgnoreCase(header.name, "Transfer-Encoding")) {
+            // Chunked bodies aren't supported
+            return std::unexpected(501);
+        } else if (EqualsIgnoreCase(header.name, "Connection")) {
+            connection = header.value;
+        }
+        request.headers.push_back(header);
+    }
+
+    if (request.minor_version == 0) {
+        request.keep_alive =
+            connection.has_value() && HasOption(*connection, "keep-alive");
+    } else {
+        request.keep_alive =
+            !connection.has_value() || !HasOption(*connection, "close");
+    }
+    return {};
+}
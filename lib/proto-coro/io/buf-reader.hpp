@@ -0,0 +1,467 @@
+#pragma once
+
+#include "find.hpp"
+#include "io.hpp"
+#include "stream-buffer.hpp"
+
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
+#include <expected>
+#include <limits>
+#include <memory_resource>
+#include <span>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+
+// Reads ahead from fd into a buffer of its own. Reads that are at least as
+// large as the buffer skip it and go straight into the memory of the caller.
+// With a BufferPool the buffer is taken from it only once data arrives and
+// returned as soon as it is all consumed. With a MirroredRing the buffered
+// bytes stay where they are until consumed, however many fills it takes to
+// get the rest of a message. Only one op may be in progress at a time.
+struct BufReader {
+    static constexpr size_t kDefaultCapacity = 8 * 1024;
+
+    using PeekResult = std::expected<std::string_view, int>;
+
+    explicit BufReader(
+        const RegisteredFd& fd, size_t capacity = kDefaultCapacity,
+        std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+        : fd_(fd), buf_(capacity, memory) {
+    }
+
+    // The capacity is rounded up to a size class of the pool
+    BufReader(const RegisteredFd& fd, BufferPool& pool,
+              size_t capacity = kDefaultCapacity)
+        : fd_(fd), buf_(capacity, pool) {
+    }
+
+    // The capacity is the size of the ring
+    BufReader(const RegisteredFd& fd, MirroredRing ring)
+        : fd_(fd), buf_(std::move(ring)) {
+    }
+
+    // Only while no op is in progress, as they point to the reader
+    BufReader(BufReader&&) = default;
+
+    // The bytes read ahead, valid until the next op or Consume
+    std::span<const char> Buffered() const {
+        return {buf_.Data() + pos_, end_ - pos_};
+    }
+
+    void Consume(size_t n) {
+        pos_ += std::min(n, end_ - pos_);
+        ReleaseIfDrained();
+    }
+
+    size_t Capacity() const {
+        return buf_.Capacity();
+    }
+
+    // Whether the reader holds memory, which it always does without a pool
+    bool HoldsBuffer() const {
+        return buf_.IsHeld();
+    }
+
+  private:
+    // A single attempt at filling the buffer, which is held just for that
+    // while there is nothing in it
+    struct FillCall {
+        ssize_t operator()() const {
+            reader->buf_.Hold();
+            auto spare = reader->Spare();
+            auto n =
+                ::read(reader->fd_.AsRawFd(), spare.data(), spare.size());
+            if (n > 0) {
+                reader->end_ += n;
+            } else {
+                int error = errno;
+                reader->ReleaseIfDrained();
+                errno = error;
+            }
+            return n;
+        }
+
+        BufReader* reader;
+    };
+
+  public:
+    // Reads more into the buffer, making room first. Gives the number of
+    // new bytes, zero at the end of the stream, and ENOBUFS if the buffer is
+    // full already.
+    struct FillOp : Pc {
+        explicit FillOp(BufReader* reader) : reader_(reader) {
+        }
+
+        PROTO_CORO(IoResult) {
+            PC_BEGIN;
+
+            reader_->Compact();
+            if (reader_->end_ - reader_->pos_ == reader_->Capacity()) {
+                return std::unexpected(ENOBUFS);
+            }
+            {
+                CALL(auto n, SyscallOp{reader_->fd_.AsRawFd(),
+                                       InterestKind::Readable,
+                                       FillCall{reader_}});
+                return n;
+            }
+
+            PC_END;
+        }
+
+      private:
+        BufReader* reader_;
+        CALLS(SyscallOp<FillCall>);
+    };
+
+    // Up to buf.size() bytes, zero only at the end of the stream
+    struct ReadOp : Pc {
+        ReadOp(BufReader* reader, std::span<char> buf)
+            : reader_(reader), buf_(buf) {
+        }
+
+        PROTO_CORO(IoResult) {
+            PC_BEGIN;
+
+            if (reader_->pos_ == reader_->end_ && !buf_.empty()) {
+                if (buf_.size() >= reader_->Capacity()) {
+                    CALL(auto n, ::Read(reader_->fd_, buf_));
+                    return n;
+                }
+                {
+                    CALL(auto n, reader_->Fill());
+                    if (!n.has_value() || *n == 0) {
+                        return n;
+                    }
+                }
+            }
+            return reader_->CopyOut(buf_);
+
+            PC_END;
+        }
+
+      private:
+        BufReader* reader_;
+        std::span<char> buf_;
+        CALLS(ReadSomeOp, FillOp);
+    };
+
+    // Fills buf, short only at the end of the stream
+    struct ReadExactOp : Pc {
+        ReadExactOp(BufReader* reader, std::span<char> buf)
+            : reader_(reader), buf_(buf) {
+        }
+
+        PROTO_CORO(IoResult) {
+            PC_BEGIN;
+
+            while (done_ < buf_.size()) {
+                CALL(auto n, reader_->Read(buf_.subspan(done_)));
+                if (!n.has_value()) {
+                    return n;
+                }
+                if (*n == 0) {
+                    break;
+                }
+                done_ += *n;
+            }
+            return done_;
+
+            PC_END;
+        }
+
+      private:
+        BufReader* reader_;
+        std::span<char> buf_;
+        size_t done_ = 0;
+        CALLS(ReadOp);
+    };
+
+    // Appends to out up to and including the first delim. Gives the number
+    // of bytes appended, which lack the delimiter only at the end of the
+    // stream. Fails with EMSGSIZE once more than limit bytes went by without
+    // one.
+    struct ReadUntilOp : Pc {
+        ReadUntilOp(BufReader* reader, std::string_view delim,
+                    std::pmr::string& out, size_t limit)
+            : reader_(reader), delim_(delim), out_(out), limit_(limit) {
+        }
+
+        PROTO_CORO(IoResult) {
+            PC_BEGIN;
+
+            start_ = out_.size();
+            while (!reader_->ScanUntil(delim_, out_, start_)) {
+                if (out_.size() - start_ > limit_) {
+                    return std::unexpected(EMSGSIZE);
+                }
+                CALL(auto n, reader_->Fill());
+                if (!n.has_value()) {
+                    return n;
+                }
+                if (*n == 0) {
+                    break;
+                }
+            }
+            return out_.size() - start_;
+
+            PC_END;
+        }
+
+      private:
+        BufReader* reader_;
+        std::string_view delim_;
+        std::pmr::string& out_;
+        size_t limit_;
+        size_t start_ = 0;
+        CALLS(FillOp);
+    };
+
+    // Reads until the buffered bytes hold delim, and gives a view of them up
+    // to and including it. The bytes stay buffered until they are Consumed,
+    // so the view is valid until then. It lacks the delimiter only at the
+    // end of the stream; EMSGSIZE means the buffer filled up without one.
+    struct PeekUntilOp : Pc {
+        PeekUntilOp(BufReader* reader, std::string_view delim)
+            : reader_(reader), delim_(delim) {
+        }
+
+        PROTO_CORO(PeekResult) {
+            PC_BEGIN;
+
+            while (true) {
+                {
+                    auto buffered = reader_->Buffered();
+                    std::string_view window{buffered.data(), buffered.size()};
+                    // Fills keep the window in place relative to its start,
+                    // so what was scanned before is never looked at again
+                    auto found = FindBytes(window.substr(scanned_), delim_);
+                    if (found != std::string_view::npos) {
+                        return window.substr(
+                            0, scanned_ + found + delim_.size());
+                    }
+                    if (window.size() >= delim_.size()) {
+                        scanned_ = window.size() - delim_.size() + 1;
+                    }
+                }
+                CALL(auto n, reader_->Fill());
+                if (!n.has_value()) {
+                    return std::unexpected(n.error() == ENOBUFS ? EMSGSIZE
+                                                                : n.error());
+                }
+                if (*n == 0) {
+                    auto rest = reader_->Buffered();
+                    return std::string_view{rest.data(), rest.size()};
+                }
+            }
+
+            PC_END;
+        }
+
+      private:
+        BufReader* reader_;
+        std::string_view delim_;
+        size_t scanned_ = 0;
+        CALLS(FillOp);
+    };
+
+    // Reads until at least n bytes are buffered and gives a view of the
+    // first n, short only at the end of the stream. EMSGSIZE if they can't
+    // fit into the buffer.
+    struct PeekOp : Pc {
+        PeekOp(BufReader* reader, size_t n) : reader_(reader), n_(n) {
+        }
+
+        PROTO_CORO(PeekResult) {
+            PC_BEGIN;
+
+            if (n_ > reader_->Capacity()) {
+                return std::unexpected(EMSGSIZE);
+            }
+            while (reader_->end_ - reader_->pos_ < n_) {
+                CALL(auto n, reader_->Fill());
+                if (!n.has_value()) {
+                    return std::unexpected(n.error());
+                }
+                if (*n == 0) {
+                    break;
+                }
+            }
+            {
+                auto buffered = reader_->Buffered();
+                return std::string_view{buffered.data(),
+                                        std::min(n_, buffered.size())};
+            }
+
+            PC_END;
+        }
+
+      private:
+        BufReader* reader_;
+        size_t n_;
+        CALLS(FillOp);
+    };
+
+    // Scatters into iov, zero only at the end of the stream
+    struct ReadVOp : Pc {
+        ReadVOp(BufReader* reader, std::span<const iovec> iov)
+            : reader_(reader), iov_(iov) {
+        }
+
+        PROTO_CORO(IoResult) {
+            PC_BEGIN;
+
+            if (reader_->pos_ == reader_->end_) {
+                if (TotalSize() >= reader_->Capacity()) {
+                    CALL(auto n, ::ReadV(reader_->fd_, iov_));
+                    return n;
+                }
+                {
+                    CALL(auto n, reader_->Fill());
+                    if (!n.has_value() || *n == 0) {
+                        return n;
+                    }
+                }
+            }
+            {
+                size_t copied = 0;
+                for (const auto& vec : iov_) {
+                    size_t n = reader_->CopyOut(
+                        std::span{static_cast<char*>(vec.iov_base),
+                                  vec.iov_len});
+                    copied += n;
+                    if (n < vec.iov_len) {
+                        break;
+                    }
+                }
+                return copied;
+            }
+
+            PC_END;
+        }
+
+      private:
+        size_t TotalSize() const {
+            size_t total = 0;
+            for (const auto& vec : iov_) {
+                total += vec.iov_len;
+            }
+            return total;
+        }
+
+        BufReader* reader_;
+        std::span<const iovec> iov_;
+        CALLS(::ReadVOp, FillOp);
+    };
+
+    FillOp Fill() {
+        return FillOp{this};
+    }
+
+    ReadOp Read(std::span<char> buf) {
+        return ReadOp{this, buf};
+    }
+
+    ReadExactOp ReadExact(std::span<char> buf) {
+        return ReadExactOp{this, buf};
+    }
+
+    // delim and out have to outlive the op
+    ReadUntilOp ReadUntil(
+        std::string_view delim, std::pmr::string& out,
+        size_t limit = std::numeric_limits<size_t>::max()) {
+        return ReadUntilOp{this, delim, out, limit};
+    }
+
+    // delim has to outlive the op
+    PeekUntilOp PeekUntil(std::string_view delim) {
+        return PeekUntilOp{this, delim};
+    }
+
+    PeekOp Peek(size_t n) {
+        return PeekOp{this, n};
+    }
+
+    ReadVOp ReadV(std::span<const iovec> iov) {
+        return ReadVOp{this, iov};
+    }
+
+  private:
+    std::span<char> Spare() {
+        if (buf_.IsMirrored()) {
+            return {buf_.Data() + end_, Capacity() - (end_ - pos_)};
+        }
+        return {buf_.Data() + end_, Capacity() - end_};
+    }
+
+    void Compact() {
+        if (buf_.IsMirrored()) {
+            // The same bytes, a ring size earlier
+            if (pos_ >= Capacity()) {
+                pos_ -= Capacity();
+                end_ -= Capacity();
+            }
+            return;
+        }
+        if (pos_ == 0) {
+            return;
+        }
+        std::memmove(buf_.Data(), buf_.Data() + pos_, end_ - pos_);
+        end_ -= pos_;
+        pos_ = 0;
+    }
+
+    // Rewinds an empty buffer, returning it to the pool if there is one
+    void ReleaseIfDrained() {
+        if (pos_ == end_) {
+            pos_ = end_ = 0;
+            buf_.Drop();
+        }
+    }
+
+    size_t CopyOut(std::span<char> buf) {
+        auto n = std::min(buf.size(), end_ - pos_);
+        if (n > 0) {
+            std::memcpy(buf.data(), buf_.Data() + pos_, n);
+            pos_ += n;
+            ReleaseIfDrained();
+        }
+        return n;
+    }
+
+    // Moves the buffered bytes to out, stopping right after delim if they
+    // have it. Only what was appended since start is searched, including the
+    // tail that a delimiter split by the previous fill may begin in.
+    bool ScanUntil(std::string_view delim, std::pmr::string& out,
+                   size_t start) {
+        size_t before = out.size();
+        out.append(buf_.Data() + pos_, end_ - pos_);
+
+        size_t overlap =
+            std::min(before - start, delim.empty() ? 0 : delim.size() - 1);
+        size_t from = before - overlap;
+        auto found = FindBytes(std::string_view{out}.substr(from), delim);
+        if (found == std::string_view::npos) {
+            pos_ = end_;
+            ReleaseIfDrained();
+            return false;
+        }
+        size_t keep = from + found + delim.size();
+        pos_ += keep - before;
+        ReleaseIfDrained();
+        out.resize(keep);
+        return true;
+    }
+
+    const RegisteredFd& fd_;
+    StreamBuffer buf_;
+    size_t pos_ = 0;
+    size_t end_ = 0;
+};
@@ -0,0 +1,255 @@
+#pragma once
+
+#include "io.hpp"
+#include "stream-buffer.hpp"
+
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstring>
+#include <memory_resource>
+#include <span>
+#include <sys/uio.h>
+
+// Gathers small writes into a buffer of its own. A write that doesn't fit
+// goes out together with what is buffered in a single writev, without being
+// copied. Nothing is flushed on destruction, so call Flush before dropping
+// the writer. With a BufferPool the buffer is taken from it only while
+// output is pending. Only one op may be in progress at a time.
+struct BufWriter {
+    static constexpr size_t kDefaultCapacity = 8 * 1024;
+
+    // The most iovecs of the caller a single WriteV passes on
+    static constexpr size_t kMaxIov = 15;
+
+    explicit BufWriter(
+        const RegisteredFd& fd, size_t capacity = kDefaultCapacity,
+        std::pmr::memory_resource* memory = std::pmr::get_default_resource())
+        : fd_(fd), buf_(capacity, memory) {
+    }
+
+    // The capacity is rounded up to a size class of the pool
+    BufWriter(const RegisteredFd& fd, BufferPool& pool,
+              size_t capacity = kDefaultCapacity)
+        : fd_(fd), buf_(capacity, pool) {
+    }
+
+    // Only while no op is in progress, as they point to the writer
+    BufWriter(BufWriter&&) = default;
+
+    size_t Buffered() const {
+        return end_ - pos_;
+    }
+
+    size_t Capacity() const {
+        return buf_.Capacity();
+    }
+
+    // Whether the writer holds memory, which it always does without a pool
+    bool HoldsBuffer() const {
+        return buf_.IsHeld();
+    }
+
+    // Writes out everything buffered, giving the number of bytes that took
+    struct FlushOp : Pc {
+        explicit FlushOp(BufWriter* writer) : writer_(writer) {
+        }
+
+        PROTO_CORO(IoResult) {
+            PC_BEGIN;
+
+            while (writer_->pos_ < writer_->end_) {
+                CALL(auto n, ::Write(writer_->fd_, writer_->Pending()));
+                if (!n.has_value()) {
+                    return n;
+                }
+                writer_->Drain(*n);
+                flushed_ += *n;
+            }
+            return flushed_;
+
+            PC_END;
+        }
+
+      private:
+        BufWriter* writer_;
+        size_t flushed_ = 0;
+        CALLS(WriteSomeOp);
+    };
+
+    // Takes a prefix of buf, all of it unless the fd is congested
+    struct WriteOp : Pc {
+        WriteOp(BufWriter* writer, std::span<const char> buf)
+            : writer_(writer), buf_(buf) {
+        }
+
+        PROTO_CORO(IoResult) {
+            PC_BEGIN;
+
+            if (buf_.size() <= writer_->Spare()) {
+                return writer_->CopyIn(buf_);
+            }
+            while (true) {
+                {
+                    auto head = writer_->Pending();
+                    iov_[0] = {const_cast<char*>(head.data()), head.size()};
+                    iov_[1] = {const_cast<char*>(buf_.data()), buf_.size()};
+                }
+                CALL(auto n, ::WriteV(writer_->fd_, iov_));
+                if (!n.has_value()) {
+                    return n;
+                }
+                size_t pending = writer_->Buffered();
+                writer_->Drain(*n);
+                if (*n < pending) {
+                    continue;
+                }
+                // Whatever is left of buf fits now, unless it is huge
+                size_t written = *n - pending;
+                return written + writer_->CopyIn(buf_.subspan(written));
+            }
+
+            PC_END;
+        }
+
+      private:
+        BufWriter* writer_;
+        std::span<const char> buf_;
+        std::array<iovec, 2> iov_;
+        CALLS(::WriteVOp);
+    };
+
+    struct WriteAllOp : Pc {
+        WriteAllOp(BufWriter* writer, std::span<const char> buf)
+            : writer_(writer), buf_(buf) {
+        }
+
+        PROTO_CORO(IoResult) {
+            PC_BEGIN;
+
+            while (done_ < buf_.size()) {
+                CALL(auto n, writer_->Write(buf_.subspan(done_)));
+                if (!n.has_value()) {
+                    return n;
+                }
+                done_ += *n;
+            }
+            return done_;
+
+            PC_END;
+        }
+
+      private:
+        BufWriter* writer_;
+        std::span<const char> buf_;
+        size_t done_ = 0;
+        CALLS(WriteOp);
+    };
+
+    // Gathers from iov, which is buffered if it fits and written out after
+    // the buffer otherwise. Gives the number of bytes taken from iov, which
+    // may fall short of all of them just like for writev.
+    struct WriteVOp : Pc {
+        WriteVOp(BufWriter* writer, std::span<const iovec> iov)
+            : writer_(writer), iov_(iov.first(std::min(iov.size(), kMaxIov))) {
+        }
+
+        PROTO_CORO(IoResult) {
+            PC_BEGIN;
+
+            {
+                size_t total = 0;
+                for (const auto& vec : iov_) {
+                    total += vec.iov_len;
+                }
+                if (total <= writer_->Spare()) {
+                    for (const auto& vec : iov_) {
+                        writer_->CopyIn(
+                            {static_cast<const char*>(vec.iov_base),
+                             vec.iov_len});
+                    }
+                    return total;
+                }
+            }
+            std::copy(iov_.begin(), iov_.end(), all_.begin() + 1);
+            while (true) {
+                {
+                    auto head = writer_->Pending();
+                    all_[0] = {const_cast<char*>(head.data()), head.size()};
+                }
+                CALL(auto n,
+                     ::WriteV(writer_->fd_,
+                              std::span{all_}.first(iov_.size() + 1)));
+                if (!n.has_value()) {
+                    return n;
+                }
+                size_t pending = writer_->Buffered();
+                writer_->Drain(*n);
+                if (*n < pending) {
+                    continue;
+                }
+                return *n - pending;
+            }
+
+            PC_END;
+        }
+
+      private:
+        BufWriter* writer_;
+        std::span<const iovec> iov_;
+        std::array<iovec, kMaxIov + 1> all_;
+        CALLS(::WriteVOp);
+    };
+
+    FlushOp Flush() {
+        return FlushOp{this};
+    }
+
+    WriteOp Write(std::span<const char> buf) {
+        return WriteOp{this, buf};
+    }
+
+    WriteAllOp WriteAll(std::span<const char> buf) {
+        return WriteAllOp{this, buf};
+    }
+
+    // Takes at most kMaxIov of the iovecs, which have to outlive the op
+    WriteVOp WriteV(std::span<const iovec> iov) {
+        return WriteVOp{this, iov};
+    }
+
+  private:
+    std::span<const char> Pending() const {
+        return {buf_.Data() + pos_, end_ - pos_};
+    }
+
+    size_t Spare() const {
+        return buf_.Capacity() - end_;
+    }
+
+    void Drain(size_t n) {
+        pos_ += std::min(n, end_ - pos_);
+        if (pos_ == end_) {
+            pos_ = end_ = 0;
+            buf_.Drop();
+        }
+    }
+
+    size_t CopyIn(std::span<const char> buf) {
+        auto n = std::min(buf.size(), Spare());
+        if (n > 0) {
+            buf_.Hold();
+            std::memcpy(buf_.Data() + end_, buf.data(), n);
+            end_ += n;
+        }
+        return n;
+    }
+
+    const RegisteredFd& fd_;
+    StreamBuffer buf_;
+    size_t pos_ = 0;
+    size_t end_ = 0;
+};
@@ -0,0 +1,190 @@
+#include "buffer-pool.hpp"
+
+#include <proto-coro/thread/spinlock.hpp>
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <utility>
+
+namespace {
+
+// Cached buffers are linked through their first bytes
+struct FreeBuffer {
+    FreeBuffer* next;
+};
+
+// Small indices of the threads that are alive, reused once they exit, so
+// that a pool can keep the caches of the threads in an array
+struct ThreadSlots {
+    static ThreadSlots& Instance() {
+        // Never destroyed, as threads may exit after the statics are gone
+        static auto* slots = new ThreadSlots;
+        return *slots;
+    }
+
+    size_t Take() {
+        std::lock_guard lk{m_};
+        if (free_.empty()) {
+            return next_++;
+        }
+        auto slot = free_.back();
+        free_.pop_back();
+        return slot;
+    }
+
+    void Give(size_t slot) {
+        std::lock_guard lk{m_};
+        free_.push_back(slot);
+    }
+
+  private:
+    std::mutex m_;
+    std::vector<size_t> free_;
+    size_t next_ = 0;
+};
+
+struct ThreadSlot {
+    size_t index = ThreadSlots::Instance().Take();
+
+    ~ThreadSlot() {
+        ThreadSlots::Instance().Give(index);
+    }
+};
+
+size_t LocalSlot() {
+    thread_local ThreadSlot slot;
+    return slot.index;
+}
+
+}  // namespace
+
+// The lock of a thread cache is only ever contended by CachedBytes
+struct alignas(64) BufferPool::Cache {
+    FreeBuffer* Pop(size_t index, size_t size) {
+        std::lock_guard lk{lock};
+        auto* head = free[index];
+        if (head != nullptr) {
+            free[index] = head->next;
+            cached -= size;
+        }
+        return head;
+    }
+
+    bool Push(char* data, size_t index, size_t size, size_t max_cached) {
+        std::lock_guard lk{lock};
+        if (cached + size > max_cached) {
+            return false;
+        }
+        free[index] = new (data) FreeBuffer{free[index]};
+        cached += size;
+        return true;
+    }
+
+    size_t Cached() {
+        std::lock_guard lk{lock};
+        return cached;
+    }
+
+    void FreeAll() {
+        for (auto* head : free) {
+            while (head != nullptr) {
+                ::operator delete(std::exchange(head, head->next));
+            }
+        }
+    }
+
+    SpinLock lock;
+    std::vector<FreeBuffer*> free;
+    size_t cached = 0;
+};
+
+BufferPool::BufferPool(Options options)
+    : classes_(std::move(options.size_classes)),
+      max_cached_per_thread_(options.max_cached_per_thread),
+      max_cached_shared_(options.max_cached_shared),
+      thread_caches_(std::make_unique<Cache[]>(kThreadCaches)),
+      shared_(std::make_unique<Cache>()) {
+    for (auto& size : classes_) {
+        size = std::max(size, sizeof(FreeBuffer));
+    }
+    std::sort(classes_.begin(), classes_.end());
+    classes_.erase(std::unique(classes_.begin(), classes_.end()),
+                   classes_.end());
+
+    for (size_t i = 0; i < kThreadCaches; ++i) {
+        thread_caches_[i].free.resize(classes_.size(), nullptr);
+    }
+    shared_->free.resize(classes_.size(), nullptr);
+}
+
+BufferPool::Buffer BufferPool::Acquire(size_t size) {
+    size = SizeFor(size);
+    auto index = ClassOf(size);
+    if (index != classes_.size()) {
+        FreeBuffer* head = nullptr;
+        if (auto* cache = LocalCache(); cache != nullptr) {
+            head = cache->Pop(index, size);
+        }
+        if (head == nullptr) {
+            head = shared_->Pop(index, size);
+        }
+        if (head != nullptr) {
+            return Buffer{this, reinterpret_cast<char*>(head), size};
+        }
+    }
+    return Buffer{this, static_cast<char*>(::operator new(size)), size};
+}
+
+size_t BufferPool::SizeFor(size_t size) const {
+    auto it = std::lower_bound(classes_.begin(), classes_.end(), size);
+    return it != classes_.end() ? *it : size;
+}
+
+size_t BufferPool::CachedBytes() const {
+    size_t total = shared_->Cached();
+    for (size_t i = 0; i < kThreadCaches; ++i) {
+        total += thread_caches_[i].Cached();
+    }
+    return total;
+}
+
+BufferPool& BufferPool::Default() {
+    static auto* pool = new BufferPool;
+    return *pool;
+}
+
+BufferPool::~BufferPool() {
+    for (size_t i = 0; i < kThreadCaches; ++i) {
+        thread_caches_[i].FreeAll();
+    }
+    shared_->FreeAll();
+}
+
+void BufferPool::Release(char* data, size_t size) {
+    auto index = ClassOf(size);
+    if (index != classes_.size()) {
+        auto* cache = LocalCache();
+        if (cache != nullptr &&
+            cache->Push(data, index, size, max_cached_per_thread_)) {
+            return;
+        }
+        if (shared_->Push(data, index, size, max_cached_shared_)) {
+            return;
+        }
+    }
+    ::operator delete(data);
+}
+
+BufferPool::Cache* BufferPool::LocalCache() const {
+    auto slot = LocalSlot();
+    return slot < kThreadCaches ? &thread_caches_[slot] : nullptr;
+}
+
+size_t BufferPool::ClassOf(size_t size) const {
+    auto it = std::lower_bound(classes_.begin(), classes_.end(), size);
+    if (it == classes_.end() || *it != size) {
+        return classes_.size();
+    }
+    return it - classes_.begin();
+}
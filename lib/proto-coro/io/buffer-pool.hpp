@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <utility>
+#include <vector>
+
+// Buffers of a few fixed sizes, cached for reuse. Every thread has a cache
+// of its own, which overflows into one shared by all of them, and takes
+// from the shared one once its own runs dry. A buffer may be returned on any
+// thread, it then goes to the cache of that one. Buffers must not outlive
+// the pool.
+//
+// A thread that exits leaves its cache to the next thread to start, so
+// short-lived threads don't pile up caches. Past kThreadCaches threads at
+// once, the rest only use the shared cache.
+struct BufferPool {
+    static constexpr size_t kThreadCaches = 256;
+
+    struct Options {
+        // The sizes handed out. A request gets the smallest one that fits
+        // it, larger requests are served by the heap and never cached.
+        std::vector<size_t> size_classes = {4 * 1024, 16 * 1024, 64 * 1024};
+        // Beyond that many bytes cached by a thread, buffers it returns go
+        // to the shared cache
+        size_t max_cached_per_thread = 1024 * 1024;
+        // And beyond that many there, back to the heap
+        size_t max_cached_shared = 16 * 1024 * 1024;
+    };
+
+    // Returns its memory to the pool once dropped
+    struct Buffer {
+        Buffer() = default;
+
+        Buffer(Buffer&& other) noexcept
+            : pool_(std::exchange(other.pool_, nullptr)),
+              data_(std::exchange(other.data_, nullptr)),
+              size_(std::exchange(other.size_, 0)) {
+        }
+
+        Buffer& operator=(Buffer&& other) noexcept {
+            Buffer tmp{std::move(other)};
+            Swap(tmp);
+            return *this;
+        }
+
+        void Swap(Buffer& other) noexcept {
+            std::swap(pool_, other.pool_);
+            std::swap(data_, other.data_);
+            std::swap(size_, other.size_);
+        }
+
+        char* Data() const {
+            return data_;
+        }
+
+        size_t Size() const {
+            return size_;
+        }
+
+        bool IsValid() const {
+            return data_ != nullptr;
+        }
+
+        void Reset() {
+            if (data_ != nullptr) {
+                pool_->Release(std::exchange(data_, nullptr), size_);
+                size_ = 0;
+            }
+        }
+
+        ~Buffer() {
+            Reset();
+        }
+
+      private:
+        friend struct BufferPool;
+
+        Buffer(BufferPool* pool, char* data, size_t size)
+            : pool_(pool), data_(data), size_(size) {
+        }
+
+        BufferPool* pool_ = nullptr;
+        char* data_ = nullptr;
+        size_t size_ = 0;
+    };
+
+    explicit BufferPool(Options options);
+    BufferPool() : BufferPool(Options{}) {
+    }
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // A buffer of SizeFor(size) bytes
+    Buffer Acquire(size_t size);
+
+    // The size of the class that takes size, or size itself if none does
+    size_t SizeFor(size_t size) const;
+
+    // Bytes cached by all the threads and the shared cache, for tests and
+    // metrics
+    size_t CachedBytes() const;
+
+    // Shared by whoever doesn't need a pool of their own. Never destroyed,
+    // so its buffers may be held until exit.
+    static BufferPool& Default();
+
+    ~BufferPool();
+
+  private:
+    struct Cache;
+
+    void Release(char* data, size_t size);
+    // The cache of the calling thread, if it has one
+    Cache* LocalCache() const;
+    // The index of the class of exactly that size, if any
+    size_t ClassOf(size_t size) const;
+
+    std::vector<size_t> classes_;
+    size_t max_cached_per_thread_;
+    size_t max_cached_shared_;
+    std::unique_ptr<Cache[]> thread_caches_;
+    std::unique_ptr<Cache> shared_;
+};
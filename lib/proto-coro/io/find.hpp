@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+// Position of the first needle in haystack, or npos. Checks the first and
+// the last byte of the needle for a whole vector of positions at once, and
+// compares the rest only where both match, which is rare in text such as
+// HTTP headers. Uses AVX2 or SSE2 as far as the target allows.
+inline size_t FindBytes(std::string_view haystack, std::string_view needle) {
+    if (needle.empty()) {
+        return 0;
+    }
+    if (needle.size() > haystack.size()) {
+        return std::string_view::npos;
+    }
+
+    const char* data = haystack.data();
+    const size_t last = needle.size() - 1;
+    // The positions where a needle may start
+    const size_t candidates = haystack.size() - last;
+    size_t i = 0;
+
+    [[maybe_unused]] auto check = [&](uint32_t mask) -> size_t {
+        for (; mask != 0; mask &= mask - 1) {
+            size_t at = i + __builtin_ctz(mask);
+            if (std::memcmp(data + at, needle.data(), needle.size()) == 0) {
+                return at;
+            }
+        }
+        return std::string_view::npos;
+    };
+
+#if defined(__AVX2__)
+    {
+        const auto first = _mm256_set1_epi8(needle.front());
+        const auto back = _mm256_set1_epi8(needle.back());
+        for (; i + 32 <= candidates; i += 32) {
+            auto head = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(data + i));
+            auto tail = _mm256_loadu_si256(
+                reinterpret_cast<const __m256i*>(data + i + last));
+            auto both = _mm256_and_si256(_mm256_cmpeq_epi8(head, first),
+                                         _mm256_cmpeq_epi8(tail, back));
+            if (auto at = check(_mm256_movemask_epi8(both));
+                at != std::string_view::npos) {
+                return at;
+            }
+        }
+    }
+#endif
+
+#if defined(__SSE2__)
+    {
+        const auto first = _mm_set1_epi8(needle.front());
+        const auto back = _mm_set1_epi8(needle.back());
+        for (; i + 16 <= candidates; i += 16) {
+            auto head =
+                _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+            auto tail = _mm_loadu_si128(
+                reinterpret_cast<const __m128i*>(data + i + last));
+            auto both = _mm_and_si128(_mm_cmpeq_epi8(head, first),
+                                      _mm_cmpeq_epi8(tail, back));
+            if (auto at = check(_mm_movemask_epi8(both));
+                at != std::string_view::npos) {
+                return at;
+            }
+        }
+    }
+#endif
+
+    // Whatever is left over for the vectors, if any
+    return haystack.find(needle, i);
+}
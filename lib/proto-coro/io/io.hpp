@@ -0,0 +1,264 @@
+#pragma once
+
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/pc.hpp>
+#include <proto-coro/rt.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstddef>
+#include <expected>
+#include <span>
+#include <sys/sendfile.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <utility>
+
+// Awaitable I/O on nonblocking fds registered with the runtime. Results are
+// byte counts, zero meaning the end of the stream for reads, or the errno of
+// the failed call.
+using IoResult = std::expected<size_t, int>;
+
+// Retries a nonblocking call until the fd is ready for it. Every attempt is
+// charged to the budget of the step, see budget.hpp.
+template <class F>
+struct SyscallOp : Pc {
+    SyscallOp(RawFd fd, InterestKind interest, F call)
+        : fd_(fd), interest_(interest), call_(std::move(call)) {
+    }
+
+    PROTO_CORO(IoResult) {
+        PC_BEGIN;
+
+        while (true) {
+            COOPERATE;
+            {
+                ssize_t n = call_();
+                if (n >= 0) {
+                    return static_cast<size_t>(n);
+                }
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EAGAIN) {
+                    return std::unexpected(errno);
+                }
+            }
+            WAIT_READY(fd_, interest_);
+        }
+
+        PC_END;
+    }
+
+  private:
+    RawFd fd_;
+    InterestKind interest_;
+    F call_;
+};
+
+inline auto Read(const RegisteredFd& fd, std::span<char> buf) {
+    return SyscallOp{fd.AsRawFd(), InterestKind::Readable,
+                     [fd = fd.AsRawFd(), buf] {
+                         return ::read(fd, buf.data(), buf.size());
+                     }};
+}
+
+inline auto Write(const RegisteredFd& fd, std::span<const char> buf) {
+    return SyscallOp{fd.AsRawFd(), InterestKind::Writable,
+                     [fd = fd.AsRawFd(), buf] {
+                         return ::write(fd, buf.data(), buf.size());
+                     }};
+}
+
+// Scatter-gather variants, the iovecs have to outlive the op
+inline auto ReadV(const RegisteredFd& fd, std::span<const iovec> iov) {
+    return SyscallOp{fd.AsRawFd(), InterestKind::Readable,
+                     [fd = fd.AsRawFd(), iov] {
+                         return ::readv(fd, iov.data(), iov.size());
+                     }};
+}
+
+inline auto WriteV(const RegisteredFd& fd, std::span<const iovec> iov) {
+    return SyscallOp{fd.AsRawFd(), InterestKind::Writable,
+                     [fd = fd.AsRawFd(), iov] {
+                         return ::writev(fd, iov.data(), iov.size());
+                     }};
+}
+
+// Sends up to count bytes of the file in_fd from offset, which is advanced,
+// straight out of the page cache. The offset has to outlive the op.
+inline auto SendFile(const RegisteredFd& out, int in_fd, off_t* offset,
+                     size_t count) {
+    return SyscallOp{out.AsRawFd(), InterestKind::Writable,
+                     [out = out.AsRawFd(), in_fd, offset, count] {
+                         return ::sendfile(out, in_fd, offset, count);
+                     }};
+}
+
+using ReadSomeOp = decltype(Read(std::declval<const RegisteredFd&>(), {}));
+using WriteSomeOp = decltype(Write(std::declval<const RegisteredFd&>(), {}));
+using ReadVOp = decltype(ReadV(std::declval<const RegisteredFd&>(), {}));
+using WriteVOp = decltype(WriteV(std::declval<const RegisteredFd&>(), {}));
+using SendFileOp =
+    decltype(SendFile(std::declval<const RegisteredFd&>(), 0, nullptr, 0));
+
+// Fills buf, short only at the end of the stream
+struct ReadExactOp : Pc {
+    ReadExactOp(const RegisteredFd& fd, std::span<char> buf)
+        : fd_(fd), buf_(buf) {
+    }
+
+    PROTO_CORO(IoResult) {
+        PC_BEGIN;
+
+        while (done_ < buf_.size()) {
+            CALL(auto n, Read(fd_, buf_.subspan(done_)));
+            if (!n.has_value()) {
+                return n;
+            }
+            if (*n == 0) {
+                break;
+            }
+            done_ += *n;
+        }
+        return done_;
+
+        PC_END;
+    }
+
+  private:
+    const RegisteredFd& fd_;
+    std::span<char> buf_;
+    size_t done_ = 0;
+    CALLS(ReadSomeOp);
+};
+
+struct WriteAllOp : Pc {
+    WriteAllOp(const RegisteredFd& fd, std::span<const char> buf)
+        : fd_(fd), buf_(buf) {
+    }
+
+    PROTO_CORO(IoResult) {
+        PC_BEGIN;
+
+        while (done_ < buf_.size()) {
+            CALL(auto n, Write(fd_, buf_.subspan(done_)));
+            if (!n.has_value()) {
+                return n;
+            }
+            done_ += *n;
+        }
+        return done_;
+
+        PC_END;
+    }
+
+  private:
+    const RegisteredFd& fd_;
+    std::span<const char> buf_;
+    size_t done_ = 0;
+    CALLS(WriteSomeOp);
+};
+
+// Writes out all of iov. Advances the iovecs past what went out, so a partial
+// write resumes where it stopped without anything being copied.
+struct WriteAllVOp : Pc {
+    WriteAllVOp(const RegisteredFd& fd, std::span<iovec> iov)
+        : fd_(fd), iov_(iov) {
+    }
+
+    PROTO_CORO(IoResult) {
+        PC_BEGIN;
+
+        while (!iov_.empty()) {
+            if (iov_.front().iov_len == 0) {
+                iov_ = iov_.subspan(1);
+                continue;
+            }
+            CALL(auto n, WriteV(fd_, iov_.first(std::min<size_t>(iov_.size(),
+                                                               IOV_MAX))));
+            if (!n.has_value()) {
+                return n;
+            }
+            done_ += *n;
+            Advance(*n);
+        }
+        return done_;
+
+        PC_END;
+    }
+
+  private:
+    void Advance(size_t n) {
+        while (n > 0) {
+            auto& vec = iov_.front();
+            auto taken = std::min(n, vec.iov_len);
+            vec.iov_base = static_cast<char*>(vec.iov_base) + taken;
+            vec.iov_len -= taken;
+            n -= taken;
+            if (vec.iov_len == 0) {
+                iov_ = iov_.subspan(1);
+            }
+        }
+    }
+
+    const RegisteredFd& fd_;
+    std::span<iovec> iov_;
+    size_t done_ = 0;
+    CALLS(WriteVOp);
+};
+
+// Sends count bytes of in_fd from offset, fewer only if the file is shorter.
+// The file position of in_fd is left alone, so sends may share the fd.
+struct SendFileAllOp : Pc {
+    SendFileAllOp(const RegisteredFd& out, int in_fd, off_t offset,
+                  size_t count)
+        : out_(out), in_fd_(in_fd), offset_(offset), count_(count) {
+    }
+
+    PROTO_CORO(IoResult) {
+        PC_BEGIN;
+
+        while (done_ < count_) {
+            CALL(auto n, SendFile(out_, in_fd_, &offset_, count_ - done_));
+            if (!n.has_value()) {
+                return n;
+            }
+            if (*n == 0) {
+                break;
+            }
+            done_ += *n;
+        }
+        return done_;
+
+        PC_END;
+    }
+
+  private:
+    const RegisteredFd& out_;
+    int in_fd_;
+    off_t offset_;
+    size_t count_;
+    size_t done_ = 0;
+    CALLS(SendFileOp);
+};
+
+inline ReadExactOp ReadExact(const RegisteredFd& fd, std::span<char> buf) {
+    return ReadExactOp{fd, buf};
+}
+
+inline WriteAllOp WriteAll(const RegisteredFd& fd, std::span<const char> buf) {
+    return WriteAllOp{fd, buf};
+}
+
+inline WriteAllVOp WriteAllV(const RegisteredFd& fd, std::span<iovec> iov) {
+    return WriteAllVOp{fd, iov};
+}
+
+inline SendFileAllOp SendFileAll(const RegisteredFd& out, int in_fd,
+                                 off_t offset, size_t count) {
+    return SendFileAllOp{out, in_fd, offset, count};
+}
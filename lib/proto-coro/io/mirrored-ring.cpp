@@ -0,0 +1,46 @@
+#include "mirrored-ring.hpp"
+
+#include <proto-coro/event-loop/owned-fd.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <sys/mman.h>
+#include <unistd.h>
+
+std::expected<MirroredRing, int> MirroredRing::Create(size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    size = (std::max<size_t>(size, 1) + page - 1) / page * page;
+
+    // The fd is only needed for mapping the pages, which keep them alive
+    auto fd = OwnedFd::FromRaw(memfd_create("mirrored-ring", MFD_CLOEXEC));
+    if (!fd.IsValid()) {
+        return std::unexpected(errno);
+    }
+    if (ftruncate(fd.AsRawFd(), size) != 0) {
+        return std::unexpected(errno);
+    }
+
+    // Reserves the address range first, so that no one else maps into the
+    // second half in between
+    void* base =
+        mmap(nullptr, 2 * size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        return std::unexpected(errno);
+    }
+    auto* data = static_cast<char*>(base);
+    for (char* half : {data, data + size}) {
+        if (mmap(half, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED,
+                 fd.AsRawFd(), 0) == MAP_FAILED) {
+            int error = errno;
+            munmap(base, 2 * size);
+            return std::unexpected(error);
+        }
+    }
+    return MirroredRing{data, size};
+}
+
+MirroredRing::~MirroredRing() {
+    if (data_ != nullptr) {
+        munmap(data_, 2 * size_);
+    }
+}
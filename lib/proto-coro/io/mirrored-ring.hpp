@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <expected>
+#include <utility>
+
+// A buffer whose pages are mapped twice, back to back, so that the byte at
+// Data()[i + Size()] is the one at Data()[i]. Any window of up to Size()
+// bytes starting in the first half is then contiguous, however it wraps
+// around the end, and a ring over it never has to move data to keep it so.
+struct MirroredRing {
+    MirroredRing() = default;
+
+    MirroredRing(MirroredRing&& other) noexcept
+        : data_(std::exchange(other.data_, nullptr)),
+          size_(std::exchange(other.size_, 0)) {
+    }
+
+    MirroredRing& operator=(MirroredRing&& other) noexcept {
+        MirroredRing tmp{std::move(other)};
+        std::swap(data_, tmp.data_);
+        std::swap(size_, tmp.size_);
+        return *this;
+    }
+
+    // At least size bytes, rounded up to whole pages. Fails with the errno
+    // of the call that did.
+    static std::expected<MirroredRing, int> Create(size_t size);
+
+    // Size() bytes, mirrored by the Size() after them
+    char* Data() const {
+        return data_;
+    }
+
+    size_t Size() const {
+        return size_;
+    }
+
+    bool IsValid() const {
+        return data_ != nullptr;
+    }
+
+    ~MirroredRing();
+
+  private:
+    MirroredRing(char* data, size_t size) : data_(data), size_(size) {
+    }
+
+    char* data_ = nullptr;
+    size_t size_ = 0;
+};
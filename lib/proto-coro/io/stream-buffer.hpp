@@ -0,0 +1,79 @@
+#pragma once
+
+#include "buffer-pool.hpp"
+#include "mirrored-ring.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <memory_resource>
+#include <utility>
+#include <vector>
+
+// The memory of a BufReader or a BufWriter. Either it is allocated up front
+// from a memory resource, or it comes from a pool and is held only while
+// there is data in it, so that idle streams hold none, or it is a
+// MirroredRing, which the data never has to be moved to the front of.
+struct StreamBuffer {
+    StreamBuffer(size_t capacity, std::pmr::memory_resource* memory)
+        : owned_(std::max<size_t>(capacity, 1), memory),
+          capacity_(owned_.size()) {
+    }
+
+    StreamBuffer(size_t capacity, BufferPool& pool)
+        : pool_(&pool), capacity_(pool.SizeFor(std::max<size_t>(capacity, 1))) {
+    }
+
+    explicit StreamBuffer(MirroredRing ring)
+        : ring_(std::move(ring)), capacity_(ring_.Size()) {
+    }
+
+    StreamBuffer(StreamBuffer&&) = default;
+
+    // Null while nothing is held
+    char* Data() {
+        if (ring_.IsValid()) {
+            return ring_.Data();
+        }
+        return pool_ != nullptr ? pooled_.Data() : owned_.data();
+    }
+
+    const char* Data() const {
+        if (ring_.IsValid()) {
+            return ring_.Data();
+        }
+        return pool_ != nullptr ? pooled_.Data() : owned_.data();
+    }
+
+    size_t Capacity() const {
+        return capacity_;
+    }
+
+    // Capacity() bytes past the Data() + offset are valid for any offset up
+    // to Capacity()
+    bool IsMirrored() const {
+        return ring_.IsValid();
+    }
+
+    bool IsHeld() const {
+        return pool_ == nullptr || pooled_.IsValid();
+    }
+
+    // Takes a buffer from the pool unless one is held already
+    void Hold() {
+        if (pool_ != nullptr && !pooled_.IsValid()) {
+            pooled_ = pool_->Acquire(capacity_);
+        }
+    }
+
+    // Returns the buffer to the pool, the data in it is gone
+    void Drop() {
+        pooled_.Reset();
+    }
+
+  private:
+    std::pmr::vector<char> owned_;
+    BufferPool* pool_ = nullptr;
+    BufferPool::Buffer pooled_;
+    MirroredRing ring_;
+    size_t capacity_;
+};
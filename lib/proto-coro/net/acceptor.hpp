@@ -0,0 +1,163 @@
+#pragma once
+
+#include "address.hpp"
+#include "socket-option.hpp"
+
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/owned-fd.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <expected>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <vector>
+
+struct ListenOptions {
+    int backlog = SOMAXCONN;
+    bool reuse_addr = true;
+    // Lets several sockets listen on the same port, the kernel spreading the
+    // connections between them
+    bool reuse_port = false;
+    // Seconds the kernel holds a connection back until its first data
+    // arrives, zero to hand it out right away
+    int defer_accept = 0;
+    // For the accepted sockets
+    bool no_delay = true;
+    // The most connections a single Accept takes
+    size_t accept_batch = 64;
+};
+
+// A nonblocking socket listening on addr. Fails with the errno of the call
+// that did.
+inline std::expected<OwnedFd, int> Listen(const SocketAddress& addr,
+                                          const ListenOptions& options = {}) {
+    int raw =
+        socket(addr.Family(), SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (raw < 0) {
+        return std::unexpected(errno);
+    }
+    auto fd = OwnedFd::FromRaw(raw);
+
+    if ((options.reuse_addr &&
+         !SetSocketOption(raw, SOL_SOCKET, SO_REUSEADDR, 1)) ||
+        (options.reuse_port &&
+         !SetSocketOption(raw, SOL_SOCKET, SO_REUSEPORT, 1)) ||
+        (options.defer_accept > 0 &&
+         !SetSocketOption(raw, IPPROTO_TCP, TCP_DEFER_ACCEPT,
+                          options.defer_accept))) {
+        return std::unexpected(errno);
+    }
+    if (bind(raw, addr.Get(), addr.Size()) != 0 ||
+        listen(raw, options.backlog) != 0) {
+        return std::unexpected(errno);
+    }
+    return fd;
+}
+
+// count sockets on the same port with SO_REUSEPORT, so that as many
+// routines can accept in parallel. Port 0 is resolved by the first one.
+inline std::expected<std::vector<OwnedFd>, int> ListenShared(
+    SocketAddress addr, size_t count, ListenOptions options = {}) {
+    options.reuse_port = true;
+    std::vector<OwnedFd> fds;
+    for (size_t i = 0; i < count; ++i) {
+        auto fd = Listen(addr, options);
+        if (!fd.has_value()) {
+            return std::unexpected(fd.error());
+        }
+        if (addr.Port() == 0) {
+            auto local = SocketAddress::LocalOf(fd->AsRawFd());
+            if (!local.has_value()) {
+                return std::unexpected(errno);
+            }
+            addr.SetPort(local->Port());
+        }
+        fds.push_back(std::move(*fd));
+    }
+    return fds;
+}
+
+// Takes the connections of a listening socket off its queue a batch at a
+// time, so that a burst of them costs a single wakeup of the loop
+struct Acceptor {
+    using AcceptResult = std::expected<size_t, int>;
+
+    Acceptor(RegisteredFd listener, const ListenOptions& options = {})
+        : listener_(std::move(listener)), no_delay_(options.no_delay),
+          batch_(std::max<size_t>(options.accept_batch, 1)) {
+    }
+
+    // Appends the connections that are there to out, at most a batch of
+    // them, waiting for one if there are none. Gives their number; fails
+    // only if there were none, e.g. with EMFILE once out of fds.
+    struct AcceptOp : Pc {
+        AcceptOp(Acceptor* acceptor, std::vector<OwnedFd>& out)
+            : acceptor_(acceptor), out_(out) {
+        }
+
+        PROTO_CORO(AcceptResult) {
+            PC_BEGIN;
+
+            while (true) {
+                COOPERATE;
+                {
+                    auto accepted = acceptor_->Drain(out_);
+                    if (!accepted.has_value() || *accepted > 0) {
+                        return accepted;
+                    }
+                }
+                WAIT_READY(acceptor_->listener_.AsRawFd(),
+                           InterestKind::Readable);
+            }
+
+            PC_END;
+        }
+
+      private:
+        Acceptor* acceptor_;
+        std::vector<OwnedFd>& out_;
+    };
+
+    AcceptOp Accept(std::vector<OwnedFd>& out) {
+        return AcceptOp{this, out};
+    }
+
+    const RegisteredFd& Listener() const {
+        return listener_;
+    }
+
+  private:
+    AcceptResult Drain(std::vector<OwnedFd>& out) {
+        size_t accepted = 0;
+        while (accepted < batch_) {
+            int fd = accept4(listener_.AsRawFd(), nullptr, nullptr,
+                             SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                // The client gave up while in the queue
+                if (errno == EINTR || errno == ECONNABORTED) {
+                    continue;
+                }
+                if (errno == EAGAIN || accepted > 0) {
+                    break;
+                }
+                return std::unexpected(errno);
+            }
+            if (no_delay_) {
+                // Fails for anything but TCP, which is fine
+                SetSocketOption(fd, IPPROTO_TCP, TCP_NODELAY, 1);
+            }
+            out.push_back(OwnedFd::FromRaw(fd));
+            ++accepted;
+        }
+        return accepted;
+    }
+
+    RegisteredFd listener_;
+    bool no_delay_;
+    size_t batch_;
+};
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include <netinet/in.h>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+
+// An IPv4 or IPv6 address with a port, as the socket calls take it
+struct SocketAddress {
+    static SocketAddress Ipv4(in_addr_t host, uint16_t port) {
+        SocketAddress addr;
+        auto* sin = reinterpret_cast<sockaddr_in*>(&addr.storage_);
+        sin->sin_family = AF_INET;
+        sin->sin_port = htons(port);
+        sin->sin_addr.s_addr = htonl(host);
+        addr.size_ = sizeof(sockaddr_in);
+        return addr;
+    }
+
+    static SocketAddress Loopback(uint16_t port) {
+        return Ipv4(INADDR_LOOPBACK, port);
+    }
+
+    static SocketAddress Any(uint16_t port) {
+        return Ipv4(INADDR_ANY, port);
+    }
+
+    // A numeric host and a port, as in "127.0.0.1:80" or "[::1]:80". Names
+    // aren't resolved.
+    static std::optional<SocketAddress> Parse(std::string_view host_port) {
+        auto colon = host_port.rfind(':');
+        if (colon == std::string_view::npos) {
+            return std::nullopt;
+        }
+        auto host = host_port.substr(0, colon);
+        auto port_str = host_port.substr(colon + 1);
+        uint16_t port = 0;
+        auto [end, ec] = std::from_chars(
+            port_str.data(), port_str.data() + port_str.size(), port);
+        if (ec != std::errc{} || end != port_str.data() + port_str.size()) {
+            return std::nullopt;
+        }
+
+        SocketAddress addr;
+        if (host.starts_with('[') && host.ends_with(']')) {
+            std::string ip{host.substr(1, host.size() - 2)};
+            auto* sin6 = reinterpret_cast<sockaddr_in6*>(&addr.storage_);
+            if (inet_pton(AF_INET6, ip.c_str(), &sin6->sin6_addr) != 1) {
+                return std::nullopt;
+            }
+            sin6->sin6_family = AF_INET6;
+            sin6->sin6_port = htons(port);
+            addr.size_ = sizeof(sockaddr_in6);
+        } else {
+            std::string ip{host};
+            auto* sin = reinterpret_cast<sockaddr_in*>(&addr.storage_);
+            if (inet_pton(AF_INET, ip.c_str(), &sin->sin_addr) != 1) {
+                return std::nullopt;
+            }
+            sin->sin_family = AF_INET;
+            sin->sin_port = htons(port);
+            addr.size_ = sizeof(sockaddr_in);
+        }
+        return addr;
+    }
+
+    // As a socket call filled it in
+    static SocketAddress FromRaw(const sockaddr* raw, socklen_t size) {
+        SocketAddress addr;
+        addr.size_ = std::min<socklen_t>(size, sizeof(addr.storage_));
+        std::memcpy(&addr.storage_, raw, addr.size_);
+        return addr;
+    }
+
+    // What fd is bound to, which tells the port the kernel picked for 0
+    static std::optional<SocketAddress> LocalOf(int fd) {
+        SocketAddress addr;
+        addr.size_ = sizeof(addr.storage_);
+        if (getsockname(fd, addr.Get(), &addr.size_) != 0) {
+            return std::nullopt;
+        }
+        return addr;
+    }
+
+    int Family() const {
+        return storage_.ss_family;
+    }
+
+    uint16_t Port() const {
+        if (Family() == AF_INET6) {
+            return ntohs(
+                reinterpret_cast<const sockaddr_in6*>(&storage_)->sin6_port);
+        }
+        return ntohs(reinterpret_cast<const sockaddr_in*>(&storage_)->sin_port);
+    }
+
+    void SetPort(uint16_t port) {
+        if (Family() == AF_INET6) {
+            reinterpret_cast<sockaddr_in6*>(&storage_)->sin6_port = htons(port);
+        } else {
+            reinterpret_cast<sockaddr_in*>(&storage_)->sin_port = htons(port);
+        }
+    }
+
+    const sockaddr* Get() const {
+        return reinterpret_cast<const sockaddr*>(&storage_);
+    }
+
+    sockaddr* Get() {
+        return reinterpret_cast<sockaddr*>(&storage_);
+    }
+
+    socklen_t Size() const {
+        return size_;
+    }
+
+    bool operator==(const SocketAddress& other) const {
+        return size_ == other.size_ &&
+               std::memcmp(&storage_, &other.storage_, size_) == 0;
+    }
+
+  private:
+    sockaddr_storage storage_{};
+    socklen_t size_ = 0;
+};
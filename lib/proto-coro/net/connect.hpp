@@ -0,0 +1,80 @@
+#pragma once
+
+#include "address.hpp"
+#include "socket-option.hpp"
+
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/owned-fd.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <cerrno>
+#include <expected>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <optional>
+#include <sys/socket.h>
+
+struct ConnectOptions {
+    bool no_delay = true;
+};
+
+using ConnectResult = std::expected<RegisteredFd, int>;
+
+// Opens a nonblocking TCP connection to addr, registered with the runtime
+// of the routine. Fails with the errno of the call that did, or the error
+// the connection attempt ended with, e.g. ECONNREFUSED.
+struct ConnectOp : Pc {
+    explicit ConnectOp(const SocketAddress& addr, ConnectOptions options = {})
+        : addr_(addr), options_(options) {
+    }
+
+    PROTO_CORO(ConnectResult) {
+        PC_BEGIN;
+
+        COOPERATE;
+        {
+            int raw = socket(addr_.Family(),
+                             SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (raw < 0) {
+                return std::unexpected(errno);
+            }
+            fd_.emplace(OwnedFd::FromRaw(raw), CTX_VAR->rt);
+            if (options_.no_delay) {
+                SetSocketOption(raw, IPPROTO_TCP, TCP_NODELAY, 1);
+            }
+            if (connect(raw, addr_.Get(), addr_.Size()) == 0) {
+                return std::move(*fd_);
+            }
+            // Interrupted, the attempt goes on in the background all the same
+            if (errno != EINPROGRESS && errno != EINTR) {
+                return std::unexpected(errno);
+            }
+        }
+        WAIT_READY(fd_->AsRawFd(), InterestKind::Writable);
+        {
+            int error = 0;
+            socklen_t len = sizeof(error);
+            if (getsockopt(fd_->AsRawFd(), SOL_SOCKET, SO_ERROR, &error,
+                           &len) != 0) {
+                error = errno;
+            }
+            if (error != 0) {
+                return std::unexpected(error);
+            }
+            return std::move(*fd_);
+        }
+
+        PC_END;
+    }
+
+  private:
+    SocketAddress addr_;
+    ConnectOptions options_;
+    std::optional<RegisteredFd> fd_;
+};
+
+inline ConnectOp Connect(const SocketAddress& addr,
+                         ConnectOptions options = {}) {
+    return ConnectOp{addr, options};
+}
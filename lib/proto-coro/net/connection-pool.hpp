@@ -0,0 +1,225 @@
+#pragma once
+
+#include "address.hpp"
+#include "connect.hpp"
+
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/pc.hpp>
+#include <proto-coro/rt.hpp>
+#include <proto-coro/sync/semaphore.hpp>
+#include <proto-coro/thread/spinlock.hpp>
+
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <deque>
+#include <expected>
+#include <mutex>
+#include <optional>
+#include <sys/socket.h>
+#include <utility>
+#include <vector>
+
+// Connections to a single destination, kept open between uses. The most
+// recently returned idle connection is reused first, so the least used ones
+// are left to expire. Leases must not outlive the pool.
+struct ConnectionPool {
+    struct Options {
+        // Open at once, the ones lent out included. Acquire waits for a
+        // connection to come back beyond that.
+        size_t max_connections = 64;
+        // Idle connections kept for reuse, the ones returned beyond that
+        // are closed
+        size_t max_idle = 16;
+        // Idle connections older than that are closed rather than reused
+        Duration idle_timeout = std::chrono::seconds{30};
+        ConnectOptions connect = {};
+    };
+
+    ConnectionPool(const SocketAddress& destination, Options options)
+        : destination_(destination), options_(options),
+          permits_(options.max_connections) {
+    }
+
+    explicit ConnectionPool(const SocketAddress& destination)
+        : ConnectionPool(destination, {}) {
+    }
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    // A connection lent out by the pool. It goes back to the pool once
+    // Released, and is closed if dropped without, as it should be after an
+    // error leaves it in an unknown state.
+    struct Lease {
+        Lease(Lease&& other) noexcept
+            : pool_(std::exchange(other.pool_, nullptr)),
+              fd_(std::move(other.fd_)), reused_(other.reused_) {
+        }
+
+        Lease& operator=(Lease&&) = delete;
+
+        const RegisteredFd& Fd() const {
+            return *fd_;
+        }
+
+        // Whether the connection was used before
+        bool IsReused() const {
+            return reused_;
+        }
+
+        // Only once the last exchange on it is complete
+        void Release() {
+            std::exchange(pool_, nullptr)->Return(std::move(*fd_), true);
+        }
+
+        ~Lease() {
+            if (pool_ != nullptr) {
+                pool_->Return(std::move(*fd_), false);
+            }
+        }
+
+      private:
+        friend struct ConnectionPool;
+
+        Lease(ConnectionPool* pool, RegisteredFd fd, bool reused)
+            : pool_(pool), fd_(std::move(fd)), reused_(reused) {
+        }
+
+        ConnectionPool* pool_;
+        std::optional<RegisteredFd> fd_;
+        bool reused_;
+    };
+
+    using AcquireResult = std::expected<Lease, int>;
+
+    // An idle connection if there is one that is still open, a new one
+    // otherwise
+    struct AcquireOp : Pc {
+        explicit AcquireOp(ConnectionPool* pool) : pool_(pool) {
+        }
+
+        AcquireOp(AcquireOp&& other) noexcept : pool_(other.pool_) {
+        }
+
+        PROTO_CORO(AcquireResult) {
+            PC_BEGIN;
+
+            CALL_DISCARD(pool_->permits_.Acquire());
+            permit_ = true;
+            {
+                auto idle = pool_->TakeIdle();
+                if (idle.has_value()) {
+                    permit_ = false;
+                    return Lease{pool_, std::move(*idle), true};
+                }
+            }
+            {
+                CALL(auto fd,
+                     Connect(pool_->destination_, pool_->options_.connect));
+                permit_ = false;
+                if (!fd.has_value()) {
+                    pool_->permits_.Release();
+                    return std::unexpected(fd.error());
+                }
+                return Lease{pool_, std::move(*fd), false};
+            }
+
+            PC_END;
+        }
+
+        // Cancelled while connecting
+        ~AcquireOp() {
+            if (permit_) {
+                pool_->permits_.Release();
+            }
+        }
+
+      private:
+        ConnectionPool* pool_;
+        bool permit_ = false;
+        CALLS(Semaphore::AcquireOp, ConnectOp);
+    };
+
+    AcquireOp Acquire() {
+        return AcquireOp{this};
+    }
+
+    // Closes the idle connections that have expired, which otherwise
+    // happens as connections are acquired and returned
+    void EvictIdle() {
+        // Closed once the lock is released
+        std::vector<RegisteredFd> evicted;
+        std::lock_guard lk{lock_};
+        EvictExpired(Clock::now(), evicted);
+    }
+
+    size_t IdleCount() const {
+        std::lock_guard lk{lock_};
+        return idle_.size();
+    }
+
+  private:
+    struct IdleConnection {
+        RegisteredFd fd;
+        TimePoint since;
+    };
+
+    std::optional<RegisteredFd> TakeIdle() {
+        // Closed once the lock is released
+        std::vector<RegisteredFd> closed;
+        while (true) {
+            std::optional<RegisteredFd> fd;
+            {
+                std::lock_guard lk{lock_};
+                EvictExpired(Clock::now(), closed);
+                if (idle_.empty()) {
+                    return std::nullopt;
+                }
+                fd.emplace(std::move(idle_.back().fd));
+                idle_.pop_back();
+            }
+            if (IsOpen(*fd)) {
+                return fd;
+            }
+            closed.push_back(std::move(*fd));
+        }
+    }
+
+    void Return(RegisteredFd fd, bool reuse) {
+        std::vector<RegisteredFd> evicted;
+        {
+            std::lock_guard lk{lock_};
+            auto now = Clock::now();
+            EvictExpired(now, evicted);
+            if (reuse && idle_.size() < options_.max_idle) {
+                idle_.push_back({std::move(fd), now});
+            } else {
+                evicted.push_back(std::move(fd));
+            }
+        }
+        permits_.Release();
+    }
+
+    void EvictExpired(TimePoint now, std::vector<RegisteredFd>& evicted) {
+        while (!idle_.empty() &&
+               now - idle_.front().since >= options_.idle_timeout) {
+            evicted.push_back(std::move(idle_.front().fd));
+            idle_.pop_front();
+        }
+    }
+
+    // Not closed by the peer, and with nothing unexpected to read either
+    static bool IsOpen(const RegisteredFd& fd) {
+        char byte;
+        auto n = recv(fd.AsRawFd(), &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+        return n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+    }
+
+    const SocketAddress destination_;
+    const Options options_;
+    Semaphore permits_;
+
+    mutable SpinLock lock_;
+    std::deque<IdleConnection> idle_;
+};
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <sys/socket.h>
+
+// Sets an option that takes an int, such as TCP_NODELAY. False with errno
+// set on failure.
+inline bool SetSocketOption(int fd, int level, int name, int value) {
+    return setsockopt(fd, level, name, &value, sizeof(value)) == 0;
+}
@@ -0,0 +1,303 @@
+#pragma once
+
+#include "address.hpp"
+#include "socket-option.hpp"
+
+#include <proto-coro/event-loop/owned-fd.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/io/io.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <expected>
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <span>
+#include <sys/socket.h>
+#include <vector>
+
+struct UdpOptions {
+    bool reuse_port = false;
+    // Lets the kernel hand over a run of datagrams of the same size from the
+    // same peer as a single one, see DatagramBatch::SegmentSize
+    bool gro = false;
+    // SO_RCVBUF and SO_SNDBUF, the system defaults if zero
+    int recv_buffer = 0;
+    int send_buffer = 0;
+};
+
+// A nonblocking UDP socket bound to addr. Fails with the errno of the call
+// that did.
+inline std::expected<OwnedFd, int> BindUdp(const SocketAddress& addr,
+                                           const UdpOptions& options = {}) {
+    int raw =
+        socket(addr.Family(), SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (raw < 0) {
+        return std::unexpected(errno);
+    }
+    auto fd = OwnedFd::FromRaw(raw);
+
+    if ((options.reuse_port &&
+         !SetSocketOption(raw, SOL_SOCKET, SO_REUSEPORT, 1)) ||
+        (options.gro && !SetSocketOption(raw, SOL_UDP, UDP_GRO, 1)) ||
+        (options.recv_buffer > 0 &&
+         !SetSocketOption(raw, SOL_SOCKET, SO_RCVBUF, options.recv_buffer)) ||
+        (options.send_buffer > 0 &&
+         !SetSocketOption(raw, SOL_SOCKET, SO_SNDBUF, options.send_buffer))) {
+        return std::unexpected(errno);
+    }
+    if (bind(raw, addr.Get(), addr.Size()) != 0) {
+        return std::unexpected(errno);
+    }
+    return fd;
+}
+
+// Datagrams to be sent or received with a single syscall, in memory that is
+// allocated once up front and reused from batch to batch
+struct DatagramBatch {
+    // A datagram as large as UDP allows, which is what a coalesced one may
+    // take with GRO
+    static constexpr size_t kMaxDatagram = 65535;
+
+    DatagramBatch(size_t capacity, size_t max_size)
+        : max_size_(std::max<size_t>(max_size, 1)),
+          data_(capacity * max_size_), msgs_(capacity), iov_(capacity),
+          names_(capacity), control_(capacity * kControlSize) {
+        for (size_t i = 0; i < capacity; ++i) {
+            iov_[i].iov_base = data_.data() + i * max_size_;
+            auto& hdr = msgs_[i].msg_hdr;
+            hdr.msg_name = &names_[i];
+            hdr.msg_iov = &iov_[i];
+            hdr.msg_iovlen = 1;
+            hdr.msg_control = control_.data() + i * kControlSize;
+        }
+    }
+
+    // Pointed to by the kernel while an op is in progress
+    DatagramBatch(const DatagramBatch&) = delete;
+    DatagramBatch& operator=(const DatagramBatch&) = delete;
+
+    size_t Capacity() const {
+        return msgs_.size();
+    }
+
+    size_t MaxSize() const {
+        return max_size_;
+    }
+
+    // The datagrams received, or queued to be sent
+    size_t Size() const {
+        return size_;
+    }
+
+    bool Full() const {
+        return size_ == Capacity();
+    }
+
+    std::span<const char> Data(size_t i) const {
+        return {static_cast<const char*>(iov_[i].iov_base), iov_[i].iov_len};
+    }
+
+    SocketAddress Peer(size_t i) const {
+        return SocketAddress::FromRaw(
+            static_cast<const sockaddr*>(msgs_[i].msg_hdr.msg_name),
+            msgs_[i].msg_hdr.msg_namelen);
+    }
+
+    // Non-zero if the datagram is a run of ones of this size, the last one
+    // of which may be shorter, coalesced by GRO or to be split up by GSO
+    size_t SegmentSize(size_t i) const {
+        return segments_.empty() ? 0 : segments_[i];
+    }
+
+    // Didn't fit into MaxSize, the rest of it is lost
+    bool IsTruncated(size_t i) const {
+        return (msgs_[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+    }
+
+    void Clear() {
+        size_ = 0;
+    }
+
+    // Queues a datagram to be sent to peer, or with a segment_size a run of
+    // them that the kernel splits data into (GSO), which takes a single pass
+    // through the stack for all of them. False if the batch is full or data
+    // doesn't fit.
+    bool Push(std::span<const char> data, const SocketAddress& peer,
+              size_t segment_size = 0) {
+        if (Full() || data.size() > max_size_) {
+            return false;
+        }
+        auto i = size_++;
+        std::memcpy(iov_[i].iov_base, data.data(), data.size());
+        iov_[i].iov_len = data.size();
+        std::memcpy(&names_[i], peer.Get(), peer.Size());
+        msgs_[i].msg_hdr.msg_namelen = peer.Size();
+        SetSegmentSize(i, segment_size);
+        return true;
+    }
+
+    // Turns the datagrams received into ones to be sent back to where they
+    // came from, as they are, coalesced ones included
+    void PrepareReplies() {
+        for (size_t i = 0; i < size_; ++i) {
+            SetSegmentSize(i, SegmentSize(i));
+        }
+    }
+
+  private:
+    friend struct RecvBatchCall;
+    friend struct SendBatchCall;
+
+    static constexpr size_t kControlSize = CMSG_SPACE(sizeof(int));
+
+    mmsghdr* Msgs() {
+        return msgs_.data();
+    }
+
+    void PrepareRecv() {
+        for (size_t i = 0; i < Capacity(); ++i) {
+            iov_[i].iov_len = max_size_;
+            auto& hdr = msgs_[i].msg_hdr;
+            hdr.msg_namelen = sizeof(sockaddr_storage);
+            hdr.msg_controllen = kControlSize;
+            hdr.msg_flags = 0;
+        }
+        size_ = 0;
+    }
+
+    void FinishRecv(size_t received) {
+        size_ = received;
+        for (size_t i = 0; i < received; ++i) {
+            iov_[i].iov_len = msgs_[i].msg_len;
+            size_t segment = 0;
+            auto* hdr = &msgs_[i].msg_hdr;
+            for (auto* cmsg = CMSG_FIRSTHDR(hdr); cmsg != nullptr;
+                 cmsg = CMSG_NXTHDR(hdr, cmsg)) {
+                if (cmsg->cmsg_level == SOL_UDP && cmsg->cmsg_type == UDP_GRO) {
+                    int size;
+                    std::memcpy(&size, CMSG_DATA(cmsg), sizeof(size));
+                    segment = size;
+                }
+            }
+            if (segment != 0 && segments_.empty()) {
+                segments_.resize(Capacity());
+            }
+            if (!segments_.empty()) {
+                segments_[i] = segment;
+            }
+        }
+    }
+
+    void SetSegmentSize(size_t i, size_t segment_size) {
+        auto& hdr = msgs_[i].msg_hdr;
+        if (segment_size == 0 || segment_size >= iov_[i].iov_len) {
+            hdr.msg_controllen = 0;
+            if (!segments_.empty()) {
+                segments_[i] = 0;
+            }
+            return;
+        }
+        if (segments_.empty()) {
+            segments_.resize(Capacity());
+        }
+        segments_[i] = segment_size;
+        hdr.msg_controllen = CMSG_SPACE(sizeof(uint16_t));
+        auto* cmsg = CMSG_FIRSTHDR(&hdr);
+        cmsg->cmsg_level = SOL_UDP;
+        cmsg->cmsg_type = UDP_SEGMENT;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+        uint16_t size = segment_size;
+        std::memcpy(CMSG_DATA(cmsg), &size, sizeof(size));
+    }
+
+    size_t max_size_;
+    std::vector<char> data_;
+    std::vector<mmsghdr> msgs_;
+    std::vector<iovec> iov_;
+    std::vector<sockaddr_storage> names_;
+    // Aligned for cmsghdr, as operator new aligns for any fundamental type
+    std::vector<char> control_;
+    // Allocated once a datagram has a segment size
+    std::vector<size_t> segments_;
+    size_t size_ = 0;
+};
+
+struct RecvBatchCall {
+    ssize_t operator()() const {
+        batch->PrepareRecv();
+        int n = recvmmsg(fd, batch->Msgs(), batch->Capacity(), 0, nullptr);
+        if (n > 0) {
+            batch->FinishRecv(n);
+        }
+        return n;
+    }
+
+    int fd;
+    DatagramBatch* batch;
+};
+
+struct SendBatchCall {
+    ssize_t operator()() const {
+        return sendmmsg(fd, batch->Msgs() + from, batch->Size() - from, 0);
+    }
+
+    int fd;
+    DatagramBatch* batch;
+    size_t from;
+};
+
+using RecvBatchOp = SyscallOp<RecvBatchCall>;
+using SendBatchOp = SyscallOp<SendBatchCall>;
+
+// Fills batch with the datagrams that have arrived, as many as it takes,
+// waiting for one if there are none. Gives their number.
+inline RecvBatchOp RecvBatch(const RegisteredFd& fd, DatagramBatch& batch) {
+    return SyscallOp{fd.AsRawFd(), InterestKind::Readable,
+                     RecvBatchCall{fd.AsRawFd(), &batch}};
+}
+
+// Sends the datagrams of batch from the one at from on, as many as the
+// socket takes at once. Gives their number.
+inline SendBatchOp SendBatch(const RegisteredFd& fd, DatagramBatch& batch,
+                             size_t from = 0) {
+    return SyscallOp{fd.AsRawFd(), InterestKind::Writable,
+                     SendBatchCall{fd.AsRawFd(), &batch, from}};
+}
+
+// Sends all of the datagrams of batch
+struct SendBatchAllOp : Pc {
+    SendBatchAllOp(const RegisteredFd& fd, DatagramBatch& batch)
+        : fd_(fd), batch_(batch) {
+    }
+
+    PROTO_CORO(IoResult) {
+        PC_BEGIN;
+
+        while (sent_ < batch_.Size()) {
+            CALL(auto n, SendBatch(fd_, batch_, sent_));
+            if (!n.has_value()) {
+                return n;
+            }
+            sent_ += *n;
+        }
+        return sent_;
+
+        PC_END;
+    }
+
+  private:
+    const RegisteredFd& fd_;
+    DatagramBatch& batch_;
+    size_t sent_ = 0;
+    CALLS(SendBatchOp);
+};
+
+inline SendBatchAllOp SendBatchAll(const RegisteredFd& fd,
+                                   DatagramBatch& batch) {
+    return SendBatchAllOp{fd, batch};
+}
@@ -0,0 +1,344 @@
+#pragma once
+
+#include "budget.hpp"
+#include "cancel.hpp"
+#include "concur-util.hpp"
+#include "pc.hpp"
+#include "routine.hpp"
+#include "rt.hpp"
+#include "thread/event.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// Data parallelism over a range of indices. The range is split into chunks
+// that are claimed one at a time by the caller and by helper routines
+// submitted to the runtime, so idle workers join in while busy ones get to
+// the helpers only once they run out of other work. The caller keeps working
+// through chunks as well, so the job completes even if no helper ever runs.
+//
+// Helpers charge every chunk to the budget of their step, see budget.hpp,
+// and so does a caller that is a coroutine.
+//
+// Helpers point into the job until the last of them is done, so a coroutine
+// caller never yields while they are out: once its budget is spent, it leaves
+// the rest to them and waits. Cancelling it stops the helpers from claiming
+// more chunks, and it is dropped once they are done.
+
+// Hands out [begin, end) in chunks of about remaining / (2 * participants),
+// so that they get smaller as the work runs out and the participants finish
+// at about the same time, but never smaller than the grain.
+struct ChunkSplitter {
+    ChunkSplitter(size_t begin, size_t end, size_t grain, size_t participants)
+        : next_(begin), end_(end), grain_(std::max<size_t>(grain, 1)),
+          divisor_(2 * participants) {
+    }
+
+    bool Claim(size_t& begin, size_t& end) {
+        auto next = next_.load(std::memory_order_relaxed);
+        while (next < end_) {
+            auto left = end_ - next;
+            auto chunk = std::max(grain_, left / divisor_);
+            auto stop = chunk >= left ? end_ : next + chunk;
+            if (next_.compare_exchange_weak(next, stop,
+                                            std::memory_order_relaxed)) {
+                begin = next;
+                end = stop;
+                return true;
+            }
+        }
+        return false;
+    }
+
+  private:
+    std::atomic<size_t> next_;
+    size_t end_;
+    size_t grain_;
+    size_t divisor_;
+};
+
+// A body tells what to do with a chunk and how to combine the results of the
+// participants, each of which accumulates its own
+template <class F>
+struct ForBody {
+    using Acc = Unit;
+
+    Unit Identity() const {
+        return {};
+    }
+
+    void Run(size_t begin, size_t end, Unit&) {
+        for (size_t i = begin; i < end; ++i) {
+            fn(i);
+        }
+    }
+
+    Unit Combine(Unit, Unit) const {
+        return {};
+    }
+
+    F fn;
+};
+
+template <class T, class M, class C>
+struct ReduceBody {
+    using Acc = T;
+
+    T Identity() const {
+        return identity;
+    }
+
+    void Run(size_t begin, size_t end, T& acc) {
+        for (size_t i = begin; i < end; ++i) {
+            acc = combine(std::move(acc), map(i));
+        }
+    }
+
+    T Combine(T lhs, T rhs) {
+        return combine(std::move(lhs), std::move(rhs));
+    }
+
+    T identity;
+    M map;
+    C combine;
+};
+
+template <class Body>
+struct ParallelJob {
+    using Acc = typename Body::Acc;
+
+    ParallelJob(Body& body, size_t begin, size_t end, size_t grain,
+                IRuntime* rt)
+        : body_(body), helpers_(HelpersFor(begin, end, grain, rt)),
+          splitter_(begin, end, grain, helpers_.size() + 1),
+          acc_(body.Identity()), left_(helpers_.size() + 1), rt_(rt) {
+        for (auto& helper : helpers_) {
+            helper.job = this;
+            helper.acc.emplace(body.Identity());
+        }
+    }
+
+    ParallelJob(const ParallelJob&) = delete;
+    ParallelJob& operator=(const ParallelJob&) = delete;
+
+    // The waiter is submitted to the runtime once the last helper is done,
+    // if the caller has to wait for it
+    void Start(IRoutine* waiter) {
+        waiter_ = waiter;
+        for (auto& helper : helpers_) {
+            rt_->Submit(&helper);
+        }
+    }
+
+    // Runs a chunk on behalf of the caller. Returns false once there are none
+    // left.
+    bool Help() {
+        return RunChunk(acc_);
+    }
+
+    // Whether no helper ever points into the job
+    bool Alone() const {
+        return helpers_.empty();
+    }
+
+    // Makes everyone stop claiming chunks, leaving the result incomplete
+    void Stop() {
+        stopped_.store(true, std::memory_order_relaxed);
+    }
+
+    // Returns true if some helper is still busy, and will submit the waiter
+    // when done. The state is to be saved beforehand.
+    bool Leave() {
+        return left_.fetch_sub(1, std::memory_order_acq_rel) != 1;
+    }
+
+    Acc TakeResult() {
+        auto result = std::move(acc_);
+        for (auto& helper : helpers_) {
+            result = body_.Combine(std::move(result), std::move(*helper.acc));
+        }
+        return result;
+    }
+
+  private:
+    struct Helper final : IRoutine {
+        void Step(IRuntime* rt) override {
+            while (true) {
+                if (!Budget::Charge()) {
+                    rt->Submit(this);
+                    return;
+                }
+                if (!job->RunChunk(*acc)) {
+                    break;
+                }
+            }
+            // The job may be gone as soon as the last helper is out
+            if (job->left_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                job->rt_->Submit(job->waiter_);
+            }
+        }
+
+        ParallelJob* job = nullptr;
+        std::optional<Acc> acc;
+    };
+
+    // The caller counts as one of the participants. There is no use in more
+    // of them than the runtime has workers.
+    static size_t HelpersFor(size_t begin, size_t end, size_t grain,
+                             IRuntime* rt) {
+        if (begin >= end) {
+            return 0;
+        }
+        grain = std::max<size_t>(grain, 1);
+        auto chunks = (end - begin - 1) / grain + 1;
+        size_t threads = rt->Concurrency();
+        if (threads == 0) {
+            threads = std::max(std::thread::hardware_concurrency(), 1u);
+        }
+        return std::min(chunks, threads) - 1;
+    }
+
+    bool RunChunk(Acc& acc) {
+        size_t begin;
+        size_t end;
+        if (stopped_.load(std::memory_order_relaxed) ||
+            !splitter_.Claim(begin, end)) {
+            return false;
+        }
+        body_.Run(begin, end, acc);
+        return true;
+    }
+
+    Body& body_;
+    std::vector<Helper> helpers_;
+    ChunkSplitter splitter_;
+    Acc acc_;
+    std::atomic<size_t> left_;
+    std::atomic<bool> stopped_ = false;
+
+    IRuntime* rt_;
+    IRoutine* waiter_ = nullptr;
+};
+
+template <class Body>
+struct ParallelOp : Pc {
+    ParallelOp(Body body, size_t begin, size_t end, size_t grain)
+        : body_(std::move(body)), begin_(begin), end_(end), grain_(grain) {
+    }
+
+    // Only meaningful before the op is started, as the job stays in place
+    ParallelOp(ParallelOp&& other)
+        : body_(std::move(other.body_)), begin_(other.begin_),
+          end_(other.end_), grain_(other.grain_) {
+    }
+
+    PROTO_CORO(typename Body::Acc) {
+        PC_BEGIN;
+
+        job_.emplace(body_, begin_, end_, grain_, CTX_VAR->rt);
+        job_->Start(CTX_VAR->self);
+        while (!CANCELLED && job_->Help()) {
+            if (job_->Alone()) {
+                COOPERATE;
+            } else if (!Budget::Charge()) {
+                break;
+            }
+        }
+        SUSPEND_IF(Wait(CTX_VAR));
+        // Not to complete with a partial result
+        CANCELLATION_POINT;
+        return job_->TakeResult();
+
+        PC_END;
+    }
+
+  private:
+    // Cancellation doesn't withdraw the wakeup, which only the last helper
+    // may send, but stops the helpers so that it comes sooner
+    bool Wait(const Context* ctx) {
+        if (ctx->cancel != nullptr) {
+            ctx->cancel->Arm(
+                [](void* job, uintptr_t, IRoutine*, IRuntime*) {
+                    static_cast<ParallelJob<Body>*>(job)->Stop();
+                    return false;
+                },
+                &*job_);
+        }
+        if (job_->Leave()) {
+            return true;
+        }
+        if (ctx->cancel != nullptr) {
+            ctx->cancel->Disarm();
+        }
+        return false;
+    }
+
+    Body body_;
+    size_t begin_;
+    size_t end_;
+    size_t grain_;
+    std::optional<ParallelJob<Body>> job_;
+};
+
+// Must not be called from a routine, which would block its worker: the
+// coroutines below are for them
+template <class Body>
+typename Body::Acc BlockingParallel(IRuntime* rt, Body body, size_t begin,
+                                    size_t end, size_t grain) {
+    struct Wakeup final : IRoutine {
+        void Step(IRuntime*) override {
+            done.Fire();
+        }
+
+        ThreadOneshotEvent done;
+    } wakeup;
+
+    ParallelJob<Body> job{body, begin, end, grain, rt};
+    job.Start(&wakeup);
+    while (job.Help()) {
+    }
+    if (job.Leave()) {
+        wakeup.done.Wait();
+    }
+    return job.TakeResult();
+}
+
+// Calls fn(i) for every i in [begin, end), in chunks of at least grain
+// indices, some of which may run in parallel
+template <class F>
+auto ParallelFor(size_t begin, size_t end, size_t grain, F fn) {
+    return ParallelOp<ForBody<F>>{ForBody<F>{std::move(fn)}, begin, end,
+                                  grain};
+}
+
+template <class F>
+void BlockingParallelFor(IRuntime* rt, size_t begin, size_t end, size_t grain,
+                         F fn) {
+    BlockingParallel(rt, ForBody<F>{std::move(fn)}, begin, end, grain);
+}
+
+// Folds map(i) for every i in [begin, end) with combine, which has to be
+// associative and commutative, starting from identity in every participant
+template <class T, class M, class C>
+auto ParallelReduce(size_t begin, size_t end, size_t grain, T identity, M map,
+                    C combine) {
+    using Body = ReduceBody<T, M, C>;
+    return ParallelOp<Body>{
+        Body{std::move(identity), std::move(map), std::move(combine)}, begin,
+        end, grain};
+}
+
+template <class T, class M, class C>
+T BlockingParallelReduce(IRuntime* rt, size_t begin, size_t end, size_t grain,
+                         T identity, M map, C combine) {
+    using Body = ReduceBody<T, M, C>;
+    return BlockingParallel(
+        rt, Body{std::move(identity), std::move(map), std::move(combine)},
+        begin, end, grain);
+}
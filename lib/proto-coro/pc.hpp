@@ -1,10 +1,14 @@
 #pragma once
 
+#include "budget.hpp"
 #include "ctx.hpp"
+#include "rt.hpp"
 
 #include <algorithm>
+#include <cassert>
 #include <cstdint>
 #include <memory>  // IWYU pragma: keep  // std::destroy_at is used in macro expansion
+#include <optional>
 #include <type_traits>
 #include <utility>
 
@@ -13,9 +17,67 @@ using State = uint16_t;
 template <class T>
 using InnerOptional = std::remove_cvref_t<decltype(*std::declval<T>())>;
 
+// Coroutines declared with PROTO_CORO_ON name the runtime they run on
+template <class T>
+struct ContextForImpl {
+    using Type = Context;
+};
+
+template <class T>
+    requires requires { typename T::pc_runtime; }
+struct ContextForImpl<T> {
+    using Type = TypedContext<typename T::pc_runtime>;
+};
+
+// The context a coroutine has to be stepped with
+template <class T>
+using ContextFor = typename ContextForImpl<std::remove_cvref_t<T>>::Type;
+
+// A coroutine bound to a runtime type must be submitted to a runtime of that
+// type, which is checked in debug builds
+template <class T>
+ContextFor<T> MakeContext(IRoutine* self, IRuntime* rt,
+                          CancelState* cancel = nullptr) {
+    if constexpr (requires { typename std::remove_cvref_t<T>::pc_runtime; }) {
+        assert(dynamic_cast<typename std::remove_cvref_t<T>::pc_runtime*>(
+                   rt) != nullptr);
+    }
+    ContextFor<T> ctx{};
+    ctx.self = self;
+    ctx.rt = rt;
+    ctx.cancel = cancel;
+    return ctx;
+}
+
+// Charges the budget of the step for one operation. Once the budget is spent,
+// resubmits the routine, which then has to suspend.
+template <class Ctx>
+bool BudgetSpent(const Ctx* ctx) {
+    if (Budget::Charge()) {
+        return false;
+    }
+    RuntimeOf(ctx)->Submit(ctx->self);
+    return true;
+}
+
+// Lets a wrapper run on the same runtime as the coroutine it wraps
+template <class T>
+struct RuntimeOfCoro {};
+
+template <class T>
+    requires requires { typename T::pc_runtime; }
+struct RuntimeOfCoro<T> {
+    using pc_runtime = typename T::pc_runtime;
+};
+
 template <class T>
 using OutputOf = std::remove_cvref_t<decltype(*std::declval<T>().Step(
-    std::declval<const Context*>()))>;
+    std::declval<const ContextFor<T>*>()))>;
+
+template <class T>
+concept ProtoCoroutine = requires(T& coro, const ContextFor<T>* ctx) {
+    { *coro.Step(ctx) };
+};
 
 constexpr State kInitialState = 0;
 
@@ -44,6 +106,16 @@ struct Unit {};
 #define SUSPEND_AND(block) _SUSPEND_IMPL(__COUNTER__, block)
 #define SUSPEND SUSPEND_AND({})
 
+// Suspends only if cond holds. The state is saved before cond is evaluated,
+// so cond may hand the routine over to someone who resumes it right away.
+#define _SUSPEND_IF_IMPL(label, cond)                                          \
+    _SUSPEND_START(label);                                                     \
+    if (cond) {                                                                \
+        _SUSPEND_END(label);                                                   \
+    }
+
+#define SUSPEND_IF(cond) _SUSPEND_IF_IMPL(__COUNTER__, cond)
+
 #define PC_BEGIN                                                               \
     switch (this->pc_state) {                                                  \
     case kInitialState:
@@ -69,15 +141,15 @@ struct Unit {};
 #define READY_DISCARD(expr)                                                    \
     READY([[maybe_unused]] auto UNIQUE_ID(discard), expr)
 
-#define _POLL(label, result_storage, result_t, result, expr)                   \
+// With charge, every attempt is charged to the budget of the step, and is
+// skipped for a yield once the budget is spent
+#define _POLL(label, result_storage, result_t, result, expr, charge)           \
     StorageFor<result_t> result_storage;                                       \
     _SUSPEND_START(label);                                                     \
     while (true) {                                                             \
-        bool finished;                                                         \
-        {                                                                      \
+        if (!(charge) || !BudgetSpent(CTX_VAR)) {                              \
             auto res = expr;                                                   \
-            finished = res.has_value();                                        \
-            if (finished) {                                                    \
+            if (res.has_value()) {                                             \
                 new (result_storage.template Get<result_t>())                  \
                     result_t(std::move(*res));                                 \
                 break;                                                         \
@@ -88,24 +160,39 @@ struct Unit {};
     result = std::move(*_RESULT_PTR(result_storage, result_t));                \
     std::destroy_at(_RESULT_PTR(result_storage, result_t))
 
+// Polls an operation, which counts against the budget of the step
 #define POLL(result, expr)                                                     \
     _POLL(__COUNTER__, UNIQUE_ID(result_storage),                              \
-          InnerOptional<decltype(expr)>, result, expr)
+          InnerOptional<decltype(expr)>, result, expr, true)
 
 #define POLL_DISCARD(expr)                                                     \
     {                                                                          \
         POLL([[maybe_unused]] auto UNIQUE_ID(discard), expr);                  \
     }
 
-#define POLL_CORO(result, coro) POLL(result, (coro).Step(CTX_VAR))
+// Steps a coroutine, which charges the budget for the operations it does
+// itself. So going through the levels of a call tree is free, and a deep one
+// gets to its leaves on any budget.
+#define POLL_CORO(result, coro)                                                \
+    _POLL(__COUNTER__, UNIQUE_ID(result_storage),                              \
+          InnerOptional<decltype((coro).Step(CTX_VAR))>, result,               \
+          (coro).Step(CTX_VAR), false)
+
+// For loops that get work done without polling anything, and for the
+// operations that may complete without suspending, once per attempt
+#define COOPERATE SUSPEND_IF(BudgetSpent(CTX_VAR))
 
 #define _CALLEE_PTR(callable_t)                                                \
     reinterpret_cast<callable_t*>(this->pc_callee_storage.Get())
 
+// The callee may be any expression, e.g. a call of a factory function: it is
+// constructed in place either way
 #define _CALL(callable_t, result, ...)                                         \
-    new (this->pc_callee_storage.Get<callable_t>()) __VA_ARGS__;               \
+    new (this->pc_callee_storage.template Get<callable_t>())                   \
+        callable_t(__VA_ARGS__);                                               \
+    this->pc_callee_storage.template Track<callable_t>();                      \
     POLL_CORO(result, *_CALLEE_PTR(callable_t));                               \
-    std::destroy_at(_CALLEE_PTR(callable_t))
+    this->pc_callee_storage.Destroy()
 
 #define CALL(result, ...) _CALL(decltype(__VA_ARGS__), result, __VA_ARGS__)
 
@@ -121,6 +208,17 @@ struct Unit {};
 
 #define PROTO_CORO(ret) PROTO_CORO_IMPL(ret, EMPTY)
 
+// A coroutine that only runs on a runtime of type runtime, which the macros
+// then call without going through IRuntime
+#define PROTO_CORO_ON(runtime, ret)                                            \
+    using pc_runtime = runtime;                                                \
+    std::optional<ret> Step(                                                   \
+        [[maybe_unused]] const TypedContext<runtime>* CTX_VAR)
+
+// A wrapper of a coroutine of type inner, running on the same runtime
+#define PROTO_CORO_LIKE(inner, ret)                                            \
+    std::optional<ret> Step([[maybe_unused]] const ContextFor<inner>* CTX_VAR)
+
 // A-la aligned union
 template <class... Ts>
 struct StorageFor {
@@ -145,6 +243,36 @@ struct CalleeStorageFor : StorageFor<Ts...> {
     CalleeStorageFor() {
         std::ranges::fill(this->data_, 0);
     }
+
+    // Coroutines are only moved before they start, so there is no callee yet
+    CalleeStorageFor(const CalleeStorageFor&) : CalleeStorageFor() {
+    }
+
+    CalleeStorageFor& operator=(const CalleeStorageFor&) {
+        return *this;
+    }
+
+    template <class T>
+    void Track() {
+        destroy_ = [](void* callee) {
+            std::destroy_at(static_cast<T*>(callee));
+        };
+    }
+
+    void Destroy() {
+        std::exchange(destroy_, nullptr)(this->Get());
+    }
+
+    // A coroutine that is cancelled in the middle of a call still has to
+    // destroy its callee
+    ~CalleeStorageFor() {
+        if (destroy_ != nullptr) {
+            destroy_(this->Get());
+        }
+    }
+
+  private:
+    void (*destroy_)(void*) = nullptr;
 };
 
 #define CALLS(...) CalleeStorageFor<__VA_ARGS__> pc_callee_storage
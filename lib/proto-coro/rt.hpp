@@ -3,6 +3,7 @@
 #include "ctx.hpp"
 
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 
 using RawFd = int;
@@ -30,4 +31,14 @@ struct IRuntime {
     virtual void RegisterFd(RawFd fd) = 0;
     virtual void DeregisterFd(RawFd fd) = 0;
     virtual void WhenReady(RawFd fd, InterestKind type, IRoutine* routine) = 0;
+
+    // Withdraw a registration made by After or WhenReady. Return true if it
+    // had not fired yet: then it never will, and the caller owns the wakeup.
+    virtual bool CancelAfter(TimePoint when, IRoutine* routine) = 0;
+    virtual bool CancelWhenReady(RawFd fd, IRoutine* routine) = 0;
+
+    // How many routines may be stepped at the same time, 0 if unknown
+    virtual size_t Concurrency() const {
+        return 0;
+    }
 };
@@ -0,0 +1,279 @@
+#pragma once
+
+#include "pc.hpp"
+
+#include <cstddef>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+// Streams are coroutines that produce any number of items, possibly
+// suspending in between. Next returns nothing while the stream is suspended,
+// same as Step, and an empty item once the stream is over:
+//
+//     struct Countdown : Pc {
+//         PROTO_STREAM(int) {
+//             PC_BEGIN;
+//
+//             for (; n > 0; --n) {
+//                 EMIT(n);
+//                 SLEEP_FOR(1s);
+//             }
+//             STREAM_END;
+//
+//             PC_END;
+//         }
+//
+//         int n = 10;
+//     };
+//
+// A stream that is over keeps saying so. Coroutines consume streams with
+// NEXT, and the combinators below wrap them lazily: no item is produced
+// before it is asked for, and a chain of them is stepped as a single state
+// machine.
+
+template <class T>
+using StreamPoll = std::optional<std::optional<T>>;
+
+template <class S>
+using ItemOf = InnerOptional<InnerOptional<decltype(std::declval<S&>().Next(
+    std::declval<const Context*>()))>>;
+
+template <class S>
+concept ProtoStream = requires(S& stream, const Context* ctx) {
+    { **stream.Next(ctx) };
+};
+
+#define PROTO_STREAM(item)                                                     \
+    using pc_item = item;                                                      \
+    StreamPoll<item> Next([[maybe_unused]] const Context* CTX_VAR)
+
+#define _EMIT(label, ...)                                                      \
+    this->pc_state = label + 1;                                                \
+    return StreamPoll<pc_item>{std::in_place, __VA_ARGS__};                    \
+    case label + 1:
+
+// Hands out an item, the stream goes on from here when asked for the next one
+#define EMIT(...) _EMIT(__COUNTER__, __VA_ARGS__)
+
+#define _STREAM_END(label)                                                     \
+    this->pc_state = label + 1;                                                \
+    [[fallthrough]];                                                           \
+    case label + 1:                                                            \
+        return StreamPoll<pc_item>{std::in_place}
+
+#define STREAM_END _STREAM_END(__COUNTER__)
+
+// Waits for the next item of a stream, which is empty once it is over
+#define NEXT(item, stream) POLL(item, (stream).Next(CTX_VAR))
+
+template <class F>
+struct Map {
+    F f;
+};
+
+template <class F>
+Map(F&&) -> Map<F>;
+
+template <ProtoStream S, class F>
+auto operator|(S&& stream, Map<F>&& map) {
+    using Inner = std::remove_cvref_t<S>;
+    using Item = std::invoke_result_t<F, ItemOf<Inner>>;
+
+    struct MapStream {
+        MapStream(Inner inner, F&& f)
+            : inner(std::move(inner)), f(std::move(f)) {
+        }
+
+        StreamPoll<Item> Next(const Context* ctx) {
+            READY(auto item, inner.Next(ctx));
+            if (!item.has_value()) {
+                return StreamPoll<Item>{std::in_place};
+            }
+            return StreamPoll<Item>{std::in_place, f(std::move(*item))};
+        }
+
+      private:
+        Inner inner;
+        F f;
+    };
+
+    return MapStream{std::forward<S>(stream), std::move(map.f)};
+}
+
+template <class F>
+struct Filter {
+    F pred;
+};
+
+template <class F>
+Filter(F&&) -> Filter<F>;
+
+// Skipping items counts against the budget of the step, so that a filter
+// that drops everything a busy stream produces still lets others run
+template <ProtoStream S, class F>
+auto operator|(S&& stream, Filter<F>&& filter) {
+    using Inner = std::remove_cvref_t<S>;
+    using Item = ItemOf<Inner>;
+
+    struct FilterStream {
+        FilterStream(Inner inner, F&& pred)
+            : inner(std::move(inner)), pred(std::move(pred)) {
+        }
+
+        StreamPoll<Item> Next(const Context* ctx) {
+            while (true) {
+                READY(auto item, inner.Next(ctx));
+                if (!item.has_value() || pred(std::as_const(*item))) {
+                    return StreamPoll<Item>{std::in_place, std::move(item)};
+                }
+                if (BudgetSpent(ctx)) {
+                    return std::nullopt;
+                }
+            }
+        }
+
+      private:
+        Inner inner;
+        F pred;
+    };
+
+    return FilterStream{std::forward<S>(stream), std::move(filter.pred)};
+}
+
+// Ends the stream after the first count items, the rest are never produced
+struct Take {
+    size_t count;
+};
+
+template <ProtoStream S>
+auto operator|(S&& stream, Take take) {
+    using Inner = std::remove_cvref_t<S>;
+    using Item = ItemOf<Inner>;
+
+    struct TakeStream {
+        StreamPoll<Item> Next(const Context* ctx) {
+            if (left == 0) {
+                return StreamPoll<Item>{std::in_place};
+            }
+            READY(auto item, inner.Next(ctx));
+            if (item.has_value()) {
+                --left;
+            } else {
+                left = 0;
+            }
+            return StreamPoll<Item>{std::in_place, std::move(item)};
+        }
+
+        Inner inner;
+        size_t left;
+    };
+
+    return TakeStream{std::forward<S>(stream), take.count};
+}
+
+// Groups the items into vectors of count, the last one may be shorter
+struct Chunks {
+    size_t count;
+};
+
+// Groups the items the stream produces without suspending, up to count at a
+// time, so that they can be handled in one go. A group cut short by a
+// suspension is handed out as soon as the stream is resumed, before it is
+// stepped any further.
+struct Batch {
+    size_t count;
+};
+
+template <class Inner, bool WaitForFull>
+struct GroupStream {
+    using Item = ItemOf<Inner>;
+
+    GroupStream(Inner inner, size_t count)
+        : inner_(std::move(inner)), count_(count) {
+        group_.reserve(count_);
+    }
+
+    PROTO_STREAM(std::vector<Item>) {
+        if (!WaitForFull && suspended_ && !group_.empty()) {
+            suspended_ = false;
+            return Flush();
+        }
+        while (!finished_ && group_.size() < count_) {
+            // Set beforehand, since the stream may be resumed on another
+            // thread as soon as the inner one suspends
+            suspended_ = true;
+            auto item = inner_.Next(CTX_VAR);
+            if (!item.has_value()) {
+                return std::nullopt;
+            }
+            if (!item->has_value()) {
+                finished_ = true;
+                break;
+            }
+            group_.push_back(std::move(**item));
+        }
+        suspended_ = false;
+        if (group_.empty()) {
+            return StreamPoll<std::vector<Item>>{std::in_place};
+        }
+        return Flush();
+    }
+
+  private:
+    StreamPoll<std::vector<Item>> Flush() {
+        std::vector<Item> group;
+        group.reserve(count_);
+        group.swap(group_);
+        return StreamPoll<std::vector<Item>>{std::in_place, std::move(group)};
+    }
+
+    Inner inner_;
+    size_t count_;
+    std::vector<Item> group_;
+    bool suspended_ = false;
+    bool finished_ = false;
+};
+
+template <ProtoStream S>
+auto operator|(S&& stream, Chunks chunks) {
+    return GroupStream<std::remove_cvref_t<S>, true>{std::forward<S>(stream),
+                                                     chunks.count};
+}
+
+template <ProtoStream S>
+auto operator|(S&& stream, Batch batch) {
+    return GroupStream<std::remove_cvref_t<S>, false>{std::forward<S>(stream),
+                                                      batch.count};
+}
+
+template <class S>
+struct CollectCoro : Pc {
+    explicit CollectCoro(S stream) : stream_(std::move(stream)) {
+    }
+
+    PROTO_CORO(std::vector<ItemOf<S>>) {
+        PC_BEGIN;
+
+        while (true) {
+            NEXT(auto item, stream_);
+            if (!item.has_value()) {
+                return std::move(items_);
+            }
+            items_.push_back(std::move(*item));
+        }
+
+        PC_END;
+    }
+
+  private:
+    S stream_;
+    std::vector<ItemOf<S>> items_;
+};
+
+// A coroutine that runs the stream to its end, completing with every item
+template <ProtoStream S>
+auto Collect(S&& stream) {
+    return CollectCoro<std::remove_cvref_t<S>>{std::forward<S>(stream)};
+}
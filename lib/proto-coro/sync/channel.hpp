@@ -0,0 +1,279 @@
+#pragma once
+
+#include "wait-queue.hpp"
+
+#include <proto-coro/pc.hpp>
+#include <proto-coro/thread/mpmc-ring.hpp>
+#include <proto-coro/thread/spinlock.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <optional>
+#include <span>
+#include <utility>
+
+// Bounded multi-producer multi-consumer channel. Senders suspend while it is
+// full and receivers while it is empty; neither takes a lock unless someone
+// is waiting on the other side.
+//
+// Once closed, sends fail and receivers drain what is left. A value sent
+// concurrently with Close may be left in the channel.
+//
+// Every operation is charged to the budget of the step once, before its
+// first attempt, and not again once woken up: a wakeup is not to be lost to
+// a yield.
+template <class T>
+struct Channel {
+    explicit Channel(size_t capacity) : ring_(capacity) {
+    }
+
+    Channel(const Channel&) = delete;
+    Channel& operator=(const Channel&) = delete;
+
+    size_t Capacity() const {
+        return ring_.Capacity();
+    }
+
+    // Moves out of value only on success
+    bool TrySend(T& value) {
+        if (IsClosed() || !ring_.TryPush(value)) {
+            return false;
+        }
+        recv_waiters_.WakeIfWaiting();
+        return true;
+    }
+
+    std::optional<T> TryRecv() {
+        auto value = ring_.TryPop();
+        if (value.has_value()) {
+            send_waiters_.WakeIfWaiting();
+        }
+        return value;
+    }
+
+    void Close() {
+        closed_.store(true, std::memory_order_release);
+        send_waiters_.Wake(kAll);
+        recv_waiters_.Wake(kAll);
+    }
+
+    bool IsClosed() const {
+        return closed_.load(std::memory_order_acquire);
+    }
+
+    // Completes with false if the channel is closed
+    struct SendOp : Pc {
+        SendOp(Channel* channel, T value)
+            : channel_(channel), value_(std::move(value)) {
+        }
+
+        PROTO_CORO(bool) {
+            PC_BEGIN;
+
+            COOPERATE;
+            while (true) {
+                if (channel_->IsClosed()) {
+                    return false;
+                }
+                if (channel_->TrySend(value_)) {
+                    return true;
+                }
+                SUSPEND_IF(channel_->ParkSender(CTX_VAR, &waiter_));
+                waiter_.notified = false;
+            }
+
+            PC_END;
+        }
+
+        ~SendOp() {
+            channel_->PassOn(channel_->send_waiters_, waiter_);
+        }
+
+      private:
+        Channel* channel_;
+        T value_;
+        Waiter waiter_;
+    };
+
+    // Completes with nullopt once the channel is closed and drained
+    struct RecvOp : Pc {
+        explicit RecvOp(Channel* channel) : channel_(channel) {
+        }
+
+        PROTO_CORO(std::optional<T>) {
+            PC_BEGIN;
+
+            COOPERATE;
+            while (true) {
+                if (auto value = channel_->TryRecv()) {
+                    return value;
+                }
+                if (channel_->IsClosed() && !channel_->ring_.CanPop()) {
+                    return std::optional<T>{};
+                }
+                SUSPEND_IF(channel_->ParkReceiver(CTX_VAR, &waiter_));
+                waiter_.notified = false;
+            }
+
+            PC_END;
+        }
+
+        ~RecvOp() {
+            channel_->PassOn(channel_->recv_waiters_, waiter_);
+        }
+
+      private:
+        Channel* channel_;
+        Waiter waiter_;
+    };
+
+    // Sends all of values in order, suspending whenever the channel is full.
+    // Completes with the number of values sent, which is short only if the
+    // channel gets closed.
+    struct SendManyOp : Pc {
+        SendManyOp(Channel* channel, std::span<T> values)
+            : channel_(channel), values_(values) {
+        }
+
+        PROTO_CORO(size_t) {
+            PC_BEGIN;
+
+            COOPERATE;
+            while (sent_ < values_.size()) {
+                if (channel_->IsClosed()) {
+                    return sent_;
+                }
+                if (size_t pushed = Push(); pushed > 0) {
+                    sent_ += pushed;
+                    channel_->recv_waiters_.WakeIfWaiting(pushed);
+                    continue;
+                }
+                SUSPEND_IF(channel_->ParkSender(CTX_VAR, &waiter_));
+                waiter_.notified = false;
+            }
+            return sent_;
+
+            PC_END;
+        }
+
+        ~SendManyOp() {
+            channel_->PassOn(channel_->send_waiters_, waiter_);
+        }
+
+      private:
+        size_t Push() {
+            size_t pushed = 0;
+            while (sent_ + pushed < values_.size() &&
+                   channel_->ring_.TryPush(values_[sent_ + pushed])) {
+                ++pushed;
+            }
+            return pushed;
+        }
+
+        Channel* channel_;
+        std::span<T> values_;
+        size_t sent_ = 0;
+        Waiter waiter_;
+    };
+
+    // Receives at least one value, suspending while the channel is empty,
+    // and then as many as are available, up to out.size(). Completes with the
+    // number of values received, which is 0 once the channel is closed and
+    // drained.
+    struct RecvManyOp : Pc {
+        RecvManyOp(Channel* channel, std::span<T> out)
+            : channel_(channel), out_(out) {
+        }
+
+        PROTO_CORO(size_t) {
+            PC_BEGIN;
+
+            COOPERATE;
+            while (!out_.empty()) {
+                if (size_t popped = Pop(); popped > 0) {
+                    channel_->send_waiters_.WakeIfWaiting(popped);
+                    return popped;
+                }
+                if (channel_->IsClosed() && !channel_->ring_.CanPop()) {
+                    return size_t{0};
+                }
+                SUSPEND_IF(channel_->ParkReceiver(CTX_VAR, &waiter_));
+                waiter_.notified = false;
+            }
+            return size_t{0};
+
+            PC_END;
+        }
+
+        ~RecvManyOp() {
+            channel_->PassOn(channel_->recv_waiters_, waiter_);
+        }
+
+      private:
+        size_t Pop() {
+            size_t popped = 0;
+            while (popped < out_.size()) {
+                auto value = channel_->ring_.TryPop();
+                if (!value.has_value()) {
+                    break;
+                }
+                out_[popped++] = std::move(*value);
+            }
+            return popped;
+        }
+
+        Channel* channel_;
+        std::span<T> out_;
+        Waiter waiter_;
+    };
+
+    SendOp Send(T value) {
+        return SendOp{this, std::move(value)};
+    }
+
+    RecvOp Recv() {
+        return RecvOp{this};
+    }
+
+    // values have to outlive the operation
+    SendManyOp SendMany(std::span<T> values) {
+        return SendManyOp{this, values};
+    }
+
+    // out has to outlive the operation
+    RecvManyOp RecvMany(std::span<T> out) {
+        return RecvManyOp{this, out};
+    }
+
+  private:
+    bool ParkSender(const Context* ctx, Waiter* waiter) {
+        return send_waiters_.Park(ctx, waiter, [this] {
+            return ring_.CanPush() || IsClosed();
+        });
+    }
+
+    bool ParkReceiver(const Context* ctx, Waiter* waiter) {
+        return recv_waiters_.Park(ctx, waiter, [this] {
+            return ring_.CanPop() || IsClosed();
+        });
+    }
+
+    // An operation destroyed after being woken but before it got to run
+    // hands the wakeup to the next waiter
+    static void PassOn(WaitQueue& waiters, const Waiter& waiter) {
+        if (waiter.notified) {
+            waiters.WakeIfWaiting();
+        }
+    }
+
+    static constexpr size_t kAll = std::numeric_limits<size_t>::max();
+
+    MPMCRing<T> ring_;
+    std::atomic<bool> closed_ = false;
+
+    SpinLock send_lock_;
+    WaitQueue send_waiters_{send_lock_};
+    SpinLock recv_lock_;
+    WaitQueue recv_waiters_{recv_lock_};
+};
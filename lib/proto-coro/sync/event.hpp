@@ -0,0 +1,58 @@
+#pragma once
+
+#include "waiter-stack.hpp"
+
+#include <proto-coro/pc.hpp>
+
+// Oneshot event. Routines wait for it by suspending, foreign threads by
+// blocking, and anyone can fire it.
+struct Event {
+    Event() = default;
+
+    Event(const Event&) = delete;
+    Event& operator=(const Event&) = delete;
+
+    void Fire() {
+        waiters_.WakeAll(/*close=*/true);
+    }
+
+    bool IsFired() const {
+        return waiters_.IsClosed();
+    }
+
+    void BlockingWait() {
+        waiters_.Block([] {
+            return false;
+        });
+    }
+
+    struct WaitOp : Pc {
+        explicit WaitOp(Event* event) : event_(event) {
+        }
+
+        PROTO_CORO(Unit) {
+            PC_BEGIN;
+
+            COOPERATE;
+            if (!event_->IsFired()) {
+                SUSPEND_IF(event_->waiters_.Park(CTX_VAR, &waiter_, [] {
+                    return false;
+                }));
+            }
+            return Unit{};
+
+            PC_END;
+        }
+
+      private:
+        Event* event_;
+        WaiterStack::RoutineWaiter waiter_;
+    };
+
+    WaitOp Wait() {
+        return WaitOp{this};
+    }
+
+  private:
+    WaiterStack waiters_;
+};
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "event.hpp"
+
+#include <atomic>
+#include <cstddef>
+
+// Opens once counted down to zero, and stays open
+struct Latch {
+    explicit Latch(size_t count) : count_(count) {
+        if (count == 0) {
+            open_.Fire();
+        }
+    }
+
+    void CountDown(size_t n = 1) {
+        if (count_.fetch_sub(n, std::memory_order_acq_rel) == n) {
+            open_.Fire();
+        }
+    }
+
+    bool TryWait() const {
+        return open_.IsFired();
+    }
+
+    void BlockingWait() {
+        open_.BlockingWait();
+    }
+
+    Event::WaitOp Wait() {
+        return open_.Wait();
+    }
+
+  private:
+    std::atomic<size_t> count_;
+    Event open_;
+};
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "semaphore.hpp"
+
+// Mutex for routines: Lock suspends instead of blocking the worker. Unlock
+// hands the mutex over to the longest waiting routine.
+struct Mutex {
+    using LockOp = Semaphore::AcquireOp;
+
+    bool TryLock() {
+        return semaphore_.TryAcquire();
+    }
+
+    LockOp Lock() {
+        return semaphore_.Acquire();
+    }
+
+    void Unlock() {
+        semaphore_.Release();
+    }
+
+  private:
+    Semaphore semaphore_{1};
+};
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "wait-queue.hpp"
+
+#include <proto-coro/pc.hpp>
+#include <proto-coro/thread/spinlock.hpp>
+
+#include <atomic>
+#include <cstdint>
+
+// Readers-writer lock for routines. Writers are preferred: once a writer
+// waits, new readers queue behind it. A writer unlocking hands the lock to
+// the next writer if there is one, and to all the waiting readers otherwise.
+struct RwLock {
+    RwLock() = default;
+
+    RwLock(const RwLock&) = delete;
+    RwLock& operator=(const RwLock&) = delete;
+
+    bool TryLockShared() {
+        return !writers_.HasWaiters() && TryTakeShared();
+    }
+
+    bool TryLock() {
+        return !writers_.HasWaiters() && TryTakeExclusive();
+    }
+
+    void UnlockShared() {
+        if (state_.fetch_sub(1, std::memory_order_release) == 1) {
+            Dispatch();
+        }
+    }
+
+    void Unlock() {
+        state_.store(0, std::memory_order_release);
+        Dispatch();
+    }
+
+    template <bool Exclusive>
+    struct LockOp : Pc {
+        explicit LockOp(RwLock* lock) : lock_(lock) {
+        }
+
+        PROTO_CORO(Unit) {
+            PC_BEGIN;
+
+            COOPERATE;
+            if (Exclusive ? lock_->TryLock() : lock_->TryLockShared()) {
+                return Unit{};
+            }
+            // Once woken up, the lock is already ours
+            SUSPEND_IF(lock_->Park<Exclusive>(CTX_VAR, &waiter_));
+            waiter_.notified = false;
+            return Unit{};
+
+            PC_END;
+        }
+
+        // Was handed the lock, but cancelled before it got to run
+        ~LockOp() {
+            if (!waiter_.notified) {
+                return;
+            }
+            if constexpr (Exclusive) {
+                lock_->Unlock();
+            } else {
+                lock_->UnlockShared();
+            }
+        }
+
+      private:
+        RwLock* lock_;
+        Waiter waiter_;
+    };
+
+    using ReadLockOp = LockOp<false>;
+    using WriteLockOp = LockOp<true>;
+
+    ReadLockOp LockShared() {
+        return ReadLockOp{this};
+    }
+
+    WriteLockOp Lock() {
+        return WriteLockOp{this};
+    }
+
+  private:
+    static constexpr int64_t kWriter = -1;
+
+    bool TryTakeShared() {
+        auto state = state_.load(std::memory_order_relaxed);
+        while (state != kWriter) {
+            if (state_.compare_exchange_weak(state, state + 1,
+                                             std::memory_order_acquire,
+                                             std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    bool TryTakeExclusive() {
+        int64_t free = 0;
+        return state_.compare_exchange_strong(free, kWriter,
+                                              std::memory_order_acquire,
+                                              std::memory_order_relaxed);
+    }
+
+    template <bool Exclusive>
+    bool Park(const Context* ctx, Waiter* waiter) {
+        if constexpr (Exclusive) {
+            return writers_.Park(ctx, waiter, [this] {
+                return TryTakeExclusive();
+            });
+        } else {
+            // Both queues share the lock, so a writer cannot be queued while
+            // this is checked
+            return readers_.Park(ctx, waiter, [this] {
+                return writers_.Empty() && TryTakeShared();
+            });
+        }
+    }
+
+    // Hands the lock that has just been released to the waiters
+    void Dispatch() {
+        if (writers_.MaybeWaiting()) {
+            bool handed = false;
+            writers_.WakeWhile([this, &handed] {
+                return !handed && (handed = TryTakeExclusive());
+            });
+            if (handed) {
+                return;
+            }
+        }
+        if (readers_.MaybeWaiting()) {
+            readers_.WakeWhile([this] {
+                return writers_.Empty() && TryTakeShared();
+            });
+        }
+    }
+
+    std::atomic<int64_t> state_ = 0;
+
+    SpinLock lock_;
+    WaitQueue readers_{lock_};
+    WaitQueue writers_{lock_};
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "wait-queue.hpp"
+
+#include <proto-coro/pc.hpp>
+#include <proto-coro/thread/spinlock.hpp>
+
+#include <atomic>
+#include <cstddef>
+
+// Counting semaphore for routines. A routine that has to wait is queued and
+// suspended; a released permit is handed over to the longest waiting one.
+struct Semaphore {
+    explicit Semaphore(size_t permits) : permits_(permits) {
+    }
+
+    Semaphore(const Semaphore&) = delete;
+    Semaphore& operator=(const Semaphore&) = delete;
+
+    // Does not jump the queue
+    bool TryAcquire() {
+        return !waiters_.HasWaiters() && TryTake();
+    }
+
+    void Release(size_t permits = 1) {
+        permits_.fetch_add(permits, std::memory_order_release);
+        if (waiters_.MaybeWaiting()) {
+            waiters_.WakeWhile([this] {
+                return TryTake();
+            });
+        }
+    }
+
+    struct AcquireOp : Pc {
+        explicit AcquireOp(Semaphore* semaphore) : semaphore_(semaphore) {
+        }
+
+        PROTO_CORO(Unit) {
+            PC_BEGIN;
+
+            COOPERATE;
+            if (semaphore_->TryAcquire()) {
+                return Unit{};
+            }
+            // Once woken up, the permit is already ours
+            SUSPEND_IF(semaphore_->waiters_.Park(CTX_VAR, &waiter_, [this] {
+                return semaphore_->TryTake();
+            }));
+            waiter_.notified = false;
+            return Unit{};
+
+            PC_END;
+        }
+
+        // Was handed a permit, but cancelled before it got to run
+        ~AcquireOp() {
+            if (waiter_.notified) {
+                semaphore_->Release();
+            }
+        }
+
+      private:
+        Semaphore* semaphore_;
+        Waiter waiter_;
+    };
+
+    AcquireOp Acquire() {
+        return AcquireOp{this};
+    }
+
+  private:
+    bool TryTake() {
+        auto permits = permits_.load(std::memory_order_relaxed);
+        while (permits > 0) {
+            if (permits_.compare_exchange_weak(permits, permits - 1,
+                                               std::memory_order_acquire,
+                                               std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    std::atomic<size_t> permits_;
+
+    SpinLock lock_;
+    WaitQueue waiters_{lock_};
+};
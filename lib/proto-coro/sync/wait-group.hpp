@@ -0,0 +1,70 @@
+#pragma once
+
+#include "waiter-stack.hpp"
+
+#include <proto-coro/pc.hpp>
+
+#include <atomic>
+#include <cstddef>
+
+// Waits for a group of tasks to finish. Unlike a latch, it can be reused: the
+// waiters are released every time the counter drops to zero.
+struct WaitGroup {
+    WaitGroup() = default;
+
+    WaitGroup(const WaitGroup&) = delete;
+    WaitGroup& operator=(const WaitGroup&) = delete;
+
+    void Add(size_t n = 1) {
+        count_.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void Done() {
+        if (count_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            waiters_.WakeAll(/*close=*/false);
+        }
+    }
+
+    bool IsIdle() const {
+        return count_.load(std::memory_order_acquire) == 0;
+    }
+
+    void BlockingWait() {
+        if (!IsIdle()) {
+            waiters_.Block([this] {
+                return IsIdle();
+            });
+        }
+    }
+
+    struct WaitOp : Pc {
+        explicit WaitOp(WaitGroup* group) : group_(group) {
+        }
+
+        PROTO_CORO(Unit) {
+            PC_BEGIN;
+
+            COOPERATE;
+            if (!group_->IsIdle()) {
+                SUSPEND_IF(group_->waiters_.Park(CTX_VAR, &waiter_, [this] {
+                    return group_->IsIdle();
+                }));
+            }
+            return Unit{};
+
+            PC_END;
+        }
+
+      private:
+        WaitGroup* group_;
+        WaiterStack::RoutineWaiter waiter_;
+    };
+
+    WaitOp Wait() {
+        return WaitOp{this};
+    }
+
+  private:
+    std::atomic<size_t> count_ = 0;
+    WaiterStack waiters_;
+};
@@ -0,0 +1,172 @@
+#pragma once
+
+#include <proto-coro/cancel.hpp>
+#include <proto-coro/ctx.hpp>
+#include <proto-coro/routine.hpp>
+#include <proto-coro/rt.hpp>
+#include <proto-coro/thread/spinlock.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <utility>
+
+// A routine suspended on a synchronization primitive. Lives in the frame of
+// the coroutine that waits, and stays there until it is woken.
+struct Waiter {
+    IRoutine* routine = nullptr;
+    IRuntime* rt = nullptr;
+
+    // Set once the waiter is popped off the queue to be woken. A routine that
+    // is cancelled before it gets to act on the wakeup has to pass it on.
+    bool notified = false;
+
+    // Must be the last thing to touch the waiter
+    void Wake() {
+        notified = true;
+        rt->Submit(routine);
+    }
+
+  private:
+    friend struct WaitQueue;
+
+    Waiter* prev_ = nullptr;
+    Waiter* next_ = nullptr;
+    bool linked_ = false;
+};
+
+// Waiters in FIFO order, guarded by a lock of the primitive owning the queue.
+// A waiter that gets cancelled is unlinked by its owner.
+struct WaitQueue {
+    explicit WaitQueue(SpinLock& lock) : lock_(lock) {
+    }
+
+    WaitQueue(const WaitQueue&) = delete;
+    WaitQueue& operator=(const WaitQueue&) = delete;
+
+    // Queues the current routine unless ready() holds once it is queued, in
+    // which case it is unlinked again. Returns true if the routine is queued
+    // and has to suspend. Takes the lock, so must be called without it.
+    template <class F>
+    bool Park(const Context* ctx, Waiter* waiter, F ready) {
+        Prepare(ctx, waiter);
+        {
+            std::lock_guard lk{lock_};
+            Push(waiter);
+            if (!ready()) {
+                return true;
+            }
+            Remove(waiter);
+        }
+        if (ctx->cancel != nullptr) {
+            ctx->cancel->Disarm();
+        }
+        return false;
+    }
+
+    // Wakes waiters from the head for as long as grant() holds, returns how
+    // many. grant is called with the lock held, each time there is a waiter
+    // to be woken, and may hand it whatever it is waiting for.
+    template <class F>
+    size_t WakeWhile(F grant) {
+        Waiter* woken = nullptr;
+        Waiter** tail = &woken;
+        size_t count = 0;
+        {
+            std::lock_guard lk{lock_};
+            while (head_ != nullptr && grant()) {
+                auto* waiter = Pop();
+                *std::exchange(tail, &waiter->next_) = waiter;
+                ++count;
+            }
+            *tail = nullptr;
+        }
+        while (woken != nullptr) {
+            std::exchange(woken, woken->next_)->Wake();
+        }
+        return count;
+    }
+
+    // Wakes up to n waiters, returns how many
+    size_t Wake(size_t n = 1) {
+        return WakeWhile([&n] {
+            return n > 0 && (--n, true);
+        });
+    }
+
+    // Whether there might be waiters. Goes through a read-modify-write, so
+    // that either the waiter that has just been queued is seen, or its
+    // ready() check sees what the caller has done before.
+    bool MaybeWaiting() {
+        return size_.fetch_add(0, std::memory_order_acq_rel) != 0;
+    }
+
+    // A hint for the fast paths, which need not see the latest waiter
+    bool HasWaiters() const {
+        return size_.load(std::memory_order_relaxed) != 0;
+    }
+
+    // Same as Wake, but only takes the lock if there are waiters
+    size_t WakeIfWaiting(size_t n = 1) {
+        return MaybeWaiting() ? Wake(n) : 0;
+    }
+
+    // The rest is to be called with the lock held
+
+    void Push(Waiter* waiter) {
+        waiter->prev_ = tail_;
+        waiter->next_ = nullptr;
+        (tail_ != nullptr ? tail_->next_ : head_) = waiter;
+        tail_ = waiter;
+        waiter->linked_ = true;
+        size_.fetch_add(1, std::memory_order_acq_rel);
+    }
+
+    Waiter* Pop() {
+        auto* waiter = head_;
+        if (waiter != nullptr) {
+            Remove(waiter);
+        }
+        return waiter;
+    }
+
+    bool Remove(Waiter* waiter) {
+        if (!waiter->linked_) {
+            return false;
+        }
+        (waiter->prev_ != nullptr ? waiter->prev_->next_ : head_) =
+            waiter->next_;
+        (waiter->next_ != nullptr ? waiter->next_->prev_ : tail_) =
+            waiter->prev_;
+        waiter->linked_ = false;
+        size_.fetch_sub(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool Empty() const {
+        return head_ == nullptr;
+    }
+
+  private:
+    // Lets the owner of the routine withdraw the waiter
+    void Prepare(const Context* ctx, Waiter* waiter) {
+        waiter->routine = ctx->self;
+        waiter->rt = ctx->rt;
+        waiter->notified = false;
+        if (ctx->cancel != nullptr) {
+            ctx->cancel->Arm(
+                [](void* queue, uintptr_t waiter, IRoutine*, IRuntime*) {
+                    auto* self = static_cast<WaitQueue*>(queue);
+                    std::lock_guard lk{self->lock_};
+                    return self->Remove(reinterpret_cast<Waiter*>(waiter));
+                },
+                this, reinterpret_cast<uintptr_t>(waiter));
+        }
+    }
+
+    SpinLock& lock_;
+    Waiter* head_ = nullptr;
+    Waiter* tail_ = nullptr;
+    std::atomic<size_t> size_ = 0;
+};
@@ -0,0 +1,178 @@
+#pragma once
+
+#include <proto-coro/cancel.hpp>
+#include <proto-coro/ctx.hpp>
+#include <proto-coro/routine.hpp>
+#include <proto-coro/rt.hpp>
+#include <proto-coro/thread/futex.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+// Lock-free stack of routines and threads waiting for something to happen,
+// for the primitives that wake all of their waiters at once. Can be closed,
+// so that nobody waits any more.
+//
+// Only withdrawing a waiter of a cancelled routine takes a lock, which is a
+// bit in the stack word.
+struct WaiterStack {
+    struct Node {
+        void (*wake)(Node* self) = nullptr;
+        Node* next = nullptr;
+    };
+
+    struct RoutineWaiter : Node {
+        IRoutine* routine = nullptr;
+        IRuntime* rt = nullptr;
+    };
+
+    WaiterStack() = default;
+
+    WaiterStack(const WaiterStack&) = delete;
+    WaiterStack& operator=(const WaiterStack&) = delete;
+
+    bool IsClosed() const {
+        return (state_.load(std::memory_order_acquire) & kClosed) != 0;
+    }
+
+    // Pushes the current routine unless the stack is closed or ready() holds
+    // once it is pushed. Returns true if the routine has to suspend.
+    template <class F>
+    bool Park(const Context* ctx, RoutineWaiter* waiter, F ready) {
+        waiter->routine = ctx->self;
+        waiter->rt = ctx->rt;
+        waiter->wake = [](Node* self) {
+            auto* waiter = static_cast<RoutineWaiter*>(self);
+            waiter->rt->Submit(waiter->routine);
+        };
+        if (ctx->cancel != nullptr) {
+            ctx->cancel->Arm(
+                [](void* stack, uintptr_t node, IRoutine*, IRuntime*) {
+                    return static_cast<WaiterStack*>(stack)->Remove(
+                        reinterpret_cast<Node*>(node));
+                },
+                this, reinterpret_cast<uintptr_t>(waiter));
+        }
+        if (Push(waiter) && !(ready() && Remove(waiter))) {
+            return true;
+        }
+        if (ctx->cancel != nullptr) {
+            ctx->cancel->Disarm();
+        }
+        return false;
+    }
+
+    // Blocks the calling thread until it is woken up or ready() holds
+    template <class F>
+    void Block(F ready) {
+        ThreadWaiter waiter;
+        if (!Push(&waiter) || (ready() && Remove(&waiter))) {
+            return;
+        }
+        while (waiter.woken.load(std::memory_order_acquire) == 0) {
+            FutexWait(waiter.woken, 0);
+        }
+    }
+
+    // Wakes everyone pushed so far, closing the stack if asked to. Goes
+    // through a read-modify-write, so either a waiter that is being pushed
+    // is woken, or its ready() check sees what the caller has done before.
+    void WakeAll(bool close) {
+        auto state = state_.load(std::memory_order_relaxed);
+        while (true) {
+            if ((state & kClosed) != 0) {
+                return;
+            }
+            if ((state & kLocked) != 0) {
+                std::this_thread::yield();
+                state = state_.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (state_.compare_exchange_weak(state, close ? kClosed : 0,
+                                             std::memory_order_acq_rel,
+                                             std::memory_order_relaxed)) {
+                break;
+            }
+        }
+        for (auto* node = reinterpret_cast<Node*>(state); node != nullptr;) {
+            auto* woken = std::exchange(node, node->next);
+            // Must be the last thing to touch the node
+            woken->wake(woken);
+        }
+    }
+
+  private:
+    struct ThreadWaiter : Node {
+        ThreadWaiter() {
+            wake = [](Node* self) {
+                auto* word = &static_cast<ThreadWaiter*>(self)->woken;
+                word->store(1, std::memory_order_release);
+                FutexWakeAll(word);
+            };
+        }
+
+        std::atomic<uint32_t> woken = 0;
+    };
+
+    // Returns false if the stack is closed
+    bool Push(Node* node) {
+        auto state = state_.load(std::memory_order_relaxed);
+        while (true) {
+            if ((state & kClosed) != 0) {
+                return false;
+            }
+            if ((state & kLocked) != 0) {
+                std::this_thread::yield();
+                state = state_.load(std::memory_order_relaxed);
+                continue;
+            }
+            node->next = reinterpret_cast<Node*>(state);
+            if (state_.compare_exchange_weak(
+                    state, reinterpret_cast<uintptr_t>(node),
+                    std::memory_order_acq_rel, std::memory_order_relaxed)) {
+                return true;
+            }
+        }
+    }
+
+    // Returns false if the node has already been taken to be woken up
+    bool Remove(Node* node) {
+        auto state = state_.load(std::memory_order_relaxed);
+        while (true) {
+            if ((state & kClosed) != 0) {
+                return false;
+            }
+            if ((state & kLocked) != 0) {
+                std::this_thread::yield();
+                state = state_.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (state_.compare_exchange_weak(state, state | kLocked,
+                                             std::memory_order_acquire,
+                                             std::memory_order_relaxed)) {
+                break;
+            }
+        }
+
+        auto* head = reinterpret_cast<Node*>(state);
+        bool found = false;
+        for (Node** link = &head; *link != nullptr; link = &(*link)->next) {
+            if (*link == node) {
+                *link = node->next;
+                found = true;
+                break;
+            }
+        }
+        state_.store(reinterpret_cast<uintptr_t>(head),
+                     std::memory_order_release);
+        return found;
+    }
+
+    static constexpr uintptr_t kClosed = 1;
+    static constexpr uintptr_t kLocked = 2;
+
+    // Head of the stack, unless closed
+    std::atomic<uintptr_t> state_ = 0;
+};
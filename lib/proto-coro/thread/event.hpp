@@ -1,25 +1,36 @@
 #pragma once
 
-#include <condition_variable>
-#include <mutex>
+#include "futex.hpp"
+
+#include <atomic>
+#include <cstdint>
 
 struct ThreadOneshotEvent {
     void Fire() {
-        std::lock_guard lk{m_};
-        fired_ = true;
-        cv_.notify_all();
+        // Once fired, the waiters are free to destroy the event
+        auto* word = &state_;
+        if (state_.exchange(kFired, std::memory_order_release) == kWaited) {
+            FutexWakeAll(word);
+        }
     }
 
     void Wait() {
-        std::unique_lock lk{m_};
-        cv_.wait(lk, [this] {
-            return fired_;
-        });
+        auto state = state_.load(std::memory_order_acquire);
+        while (state != kFired) {
+            if (state == kWaited ||
+                state_.compare_exchange_weak(state, kWaited,
+                                             std::memory_order_acquire)) {
+                FutexWait(state_, kWaited);
+            }
+            state = state_.load(std::memory_order_acquire);
+        }
     }
 
   private:
-    bool fired_ = false;
+    // Fire only makes a syscall if someone is waiting
+    static constexpr uint32_t kIdle = 0;
+    static constexpr uint32_t kWaited = 1;
+    static constexpr uint32_t kFired = 2;
 
-    std::mutex m_;
-    std::condition_variable cv_;
+    std::atomic<uint32_t> state_ = kIdle;
 };
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <atomic>
+#include <climits>
+#include <cstdint>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Blocks while word holds expected. May return spuriously.
+inline void FutexWait(std::atomic<uint32_t>& word, uint32_t expected) {
+    syscall(SYS_futex, &word, FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr,
+            0);
+}
+
+// Takes an address, since the word may be gone by the time the threads are
+// woken up: the kernel does not mind
+inline void FutexWakeAll(std::atomic<uint32_t>* word) {
+    syscall(SYS_futex, word, FUTEX_WAKE_PRIVATE, INT_MAX, nullptr, nullptr, 0);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <optional>
+#include <utility>
+
+// Bounded lock-free MPMC queue by D. Vyukov. Every cell carries a sequence
+// number telling whether it is ready to be written or read on the current lap.
+// The sequence of a cell is twice the position it is ready for, plus one once
+// it holds a value, so that the two states don't meet even with a single
+// cell. It holds exactly capacity values.
+template <class T>
+struct MPMCRing {
+    explicit MPMCRing(size_t capacity)
+        : capacity_(capacity), cells_(std::make_unique<Cell[]>(capacity)) {
+        assert(capacity > 0);
+        for (size_t i = 0; i < capacity_; ++i) {
+            cells_[i].seq.store(Writable(i), std::memory_order_relaxed);
+        }
+    }
+
+    MPMCRing(const MPMCRing&) = delete;
+    MPMCRing& operator=(const MPMCRing&) = delete;
+
+    size_t Capacity() const {
+        return capacity_;
+    }
+
+    // Moves out of value only on success
+    bool TryPush(T& value) {
+        auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+        while (true) {
+            auto& cell = cells_[pos % capacity_];
+            auto seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq - Writable(pos));
+            if (diff == 0) {
+                if (enqueue_pos_.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    new (cell.storage) T(std::move(value));
+                    cell.seq.store(Readable(pos), std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;
+            } else {
+                pos = enqueue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    std::optional<T> TryPop() {
+        auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+        while (true) {
+            auto& cell = cells_[pos % capacity_];
+            auto seq = cell.seq.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(seq - Readable(pos));
+            if (diff == 0) {
+                if (dequeue_pos_.compare_exchange_weak(
+                        pos, pos + 1, std::memory_order_relaxed)) {
+                    auto* item =
+                        std::launder(reinterpret_cast<T*>(cell.storage));
+                    std::optional<T> value{std::move(*item)};
+                    std::destroy_at(item);
+                    cell.seq.store(Writable(pos + capacity_),
+                                   std::memory_order_release);
+                    return value;
+                }
+            } else if (diff < 0) {
+                return std::nullopt;
+            } else {
+                pos = dequeue_pos_.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Whether a TryPush might succeed now
+    bool CanPush() const {
+        auto pos = enqueue_pos_.load(std::memory_order_relaxed);
+        auto seq = cells_[pos % capacity_].seq.load(std::memory_order_acquire);
+        return static_cast<intptr_t>(seq - Writable(pos)) >= 0;
+    }
+
+    // Whether a TryPop might succeed now
+    bool CanPop() const {
+        auto pos = dequeue_pos_.load(std::memory_order_relaxed);
+        auto seq = cells_[pos % capacity_].seq.load(std::memory_order_acquire);
+        return static_cast<intptr_t>(seq - Readable(pos)) >= 0;
+    }
+
+    ~MPMCRing() {
+        while (TryPop()) {
+        }
+    }
+
+  private:
+    static constexpr size_t kCacheLine = 64;
+
+    static size_t Writable(size_t pos) {
+        return pos * 2;
+    }
+
+    static size_t Readable(size_t pos) {
+        return pos * 2 + 1;
+    }
+
+    struct Cell {
+        std::atomic<size_t> seq;
+        alignas(T) std::byte storage[sizeof(T)];
+    };
+
+    const size_t capacity_;
+    std::unique_ptr<Cell[]> cells_;
+
+    alignas(kCacheLine) std::atomic<size_t> enqueue_pos_ = 0;
+    alignas(kCacheLine) std::atomic<size_t> dequeue_pos_ = 0;
+};
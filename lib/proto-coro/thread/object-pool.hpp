@@ -0,0 +1,194 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+// Per-thread freelists of memory blocks fitting a T. A block freed on the
+// thread that allocated it goes straight back to its freelist; one freed on
+// another thread is pushed onto a lock-free return queue of the owner, which
+// the owner takes over in one go once its freelist runs dry. Either way, a
+// thread caches no more than kMaxCached blocks.
+//
+// A thread that exits frees what it has cached. The blocks it still has out
+// are freed to the heap when they come back.
+template <class T>
+struct ObjectPool {
+    // Beyond that, a thread frees the blocks that come back to the heap
+    static constexpr size_t kMaxCached = 1024;
+
+    static void* Allocate() {
+        auto* cache = LocalCache();
+        auto* block = cache->Pop();
+        if (block == nullptr) {
+            block = cache->NewBlock();
+        }
+        return block->Object();
+    }
+
+    static void Free(void* object) {
+        auto* block = Block::Of(object);
+        auto* cache = LocalCache();
+        if (block->owner == cache) {
+            cache->PushLocal(block);
+        } else {
+            block->owner->PushRemote(block);
+        }
+    }
+
+    // Blocks cached by the calling thread, for tests and metrics
+    static size_t Cached() {
+        return LocalCache()->Cached();
+    }
+
+  private:
+    struct Cache;
+
+    struct Block {
+        static constexpr size_t kAlign =
+            std::max(alignof(T), alignof(std::max_align_t));
+        static constexpr size_t kHeader =
+            (sizeof(Cache*) + sizeof(Block*) + kAlign - 1) / kAlign * kAlign;
+
+        Cache* owner;
+        Block* next;
+
+        static Block* Allocate(Cache* owner) {
+            auto* block = static_cast<Block*>(::operator new(
+                kHeader + sizeof(T), std::align_val_t{kAlign}));
+            block->owner = owner;
+            return block;
+        }
+
+        static void Deallocate(Block* block) {
+            ::operator delete(block, std::align_val_t{kAlign});
+        }
+
+        static Block* Of(void* object) {
+            return reinterpret_cast<Block*>(static_cast<std::byte*>(object) -
+                                            kHeader);
+        }
+
+        void* Object() {
+            return reinterpret_cast<std::byte*>(this) + kHeader;
+        }
+    };
+
+    // Lives on until the thread exits and all of its blocks are freed
+    struct Cache {
+        Block* Pop() {
+            if (local_ == nullptr) {
+                Adopt(TakeRemote());
+            }
+            if (local_ == nullptr) {
+                return nullptr;
+            }
+            --cached_;
+            auto* block = local_;
+            local_ = block->next;
+            return block;
+        }
+
+        Block* NewBlock() {
+            refs_.fetch_add(1, std::memory_order_relaxed);
+            return Block::Allocate(this);
+        }
+
+        void PushLocal(Block* block) {
+            if (cached_ >= kMaxCached) {
+                Release(block);
+                return;
+            }
+            block->next = local_;
+            local_ = block;
+            ++cached_;
+        }
+
+        void PushRemote(Block* block) {
+            auto* head = remote_.load(std::memory_order_relaxed);
+            do {
+                if (head == Dead()) {
+                    Release(block);
+                    return;
+                }
+                block->next = head;
+            } while (!remote_.compare_exchange_weak(head, block,
+                                                    std::memory_order_release,
+                                                    std::memory_order_relaxed));
+        }
+
+        size_t Cached() const {
+            return cached_;
+        }
+
+        // Called by the owning thread on exit
+        void Retire() {
+            ReleaseAll(std::exchange(local_, nullptr));
+            ReleaseAll(remote_.exchange(Dead(), std::memory_order_acquire));
+            Unref();
+        }
+
+      private:
+        static Block* Dead() {
+            return reinterpret_cast<Block*>(uintptr_t{1});
+        }
+
+        Block* TakeRemote() {
+            return remote_.exchange(nullptr, std::memory_order_acquire);
+        }
+
+        // Keeps up to the cap of a list taken over from the return queue,
+        // which has no bound, and frees the rest. Every block is walked once
+        // here and is then either popped or freed, so it is O(1) per block.
+        void Adopt(Block* list) {
+            local_ = list;
+            cached_ = 0;
+            auto** tail = &local_;
+            while (*tail != nullptr && cached_ < kMaxCached) {
+                tail = &(*tail)->next;
+                ++cached_;
+            }
+            ReleaseAll(std::exchange(*tail, nullptr));
+        }
+
+        void ReleaseAll(Block* list) {
+            while (list != nullptr) {
+                Release(std::exchange(list, list->next));
+            }
+        }
+
+        void Release(Block* block) {
+            Block::Deallocate(block);
+            Unref();
+        }
+
+        void Unref() {
+            if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+                delete this;
+            }
+        }
+
+        Block* local_ = nullptr;
+        size_t cached_ = 0;
+
+        alignas(64) std::atomic<Block*> remote_ = nullptr;
+        // Held by the thread and by every block allocated
+        std::atomic<size_t> refs_ = 1;
+    };
+
+    struct CacheHandle {
+        Cache* cache = new Cache;
+
+        ~CacheHandle() {
+            cache->Retire();
+        }
+    };
+
+    static Cache* LocalCache() {
+        thread_local CacheHandle handle;
+        return handle.cache;
+    }
+};
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/pc.hpp>
+#include <proto-coro/thread/event.hpp>
+
+#include <optional>
+#include <utility>
+
+// Runs the coroutine as a routine on the loop and blocks until it completes
+template <class T>
+OutputOf<T> RunOnLoop(EventLoop& loop, T coro) {
+    ThreadOneshotEvent done;
+    std::optional<OutputOf<T>> result;
+
+    auto routine = Spawn{std::move(coro) | FMap{[&](auto res) {
+                             result.emplace(std::move(res));
+                             done.Fire();
+                             return Unit{};
+                         }}};
+
+    loop.Submit(&routine);
+    done.Wait();
+
+    return std::move(*result);
+}
+
+// Same, on a loop of its own that lives only for this run
+template <class T>
+OutputOf<T> RunOnLoop(T coro) {
+    EventLoop loop{2};
+    loop.Start();
+    auto result = RunOnLoop(loop, std::move(coro));
+    loop.Stop();
+
+    return result;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/event-loop/owned-fd.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <fcntl.h>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <utility>
+
+// A connected pair of stream sockets: a non-blocking end registered on the
+// loop and a blocking peer for the test thread
+inline std::pair<RegisteredFd, OwnedFd> MakePair(EventLoop& loop) {
+    int fds[2];
+    REQUIRE(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+    REQUIRE(fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+    return {RegisteredFd{OwnedFd::FromRaw(fds[0]), &loop},
+            OwnedFd::FromRaw(fds[1])};
+}
+
+// Doesn't use Catch, so it is fine to call from helper threads. Returns whether
+// all of the data was written
+inline bool WriteBlocking(int fd, std::string_view data) {
+    while (!data.empty()) {
+        auto n = write(fd, data.data(), data.size());
+        if (n <= 0) {
+            return false;
+        }
+        data.remove_prefix(n);
+    }
+    return true;
+}
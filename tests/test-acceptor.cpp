@@ -0,0 +1,157 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/event-loop/owned-fd.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/net/acceptor.hpp>
+#include <proto-coro/net/address.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "run-on-loop.hpp"
+
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+OwnedFd ConnectTo(const SocketAddress& addr) {
+    auto fd = OwnedFd::FromRaw(socket(addr.Family(), SOCK_STREAM, 0));
+    if (connect(fd.AsRawFd(), addr.Get(), addr.Size()) != 0) {
+        return OwnedFd{};
+    }
+    return fd;
+}
+
+int GetIntOption(int fd, int level, int name) {
+    int value = 0;
+    socklen_t len = sizeof(value);
+    REQUIRE(getsockopt(fd, level, name, &value, &len) == 0);
+    return value;
+}
+
+// Accepts until it has count connections
+struct AcceptCount : Pc {
+    AcceptCount(Acceptor& acceptor, std::vector<OwnedFd>& out, size_t count)
+        : acceptor_(acceptor), out_(out), count_(count) {
+    }
+
+    PROTO_CORO(std::vector<size_t>) {
+        PC_BEGIN;
+
+        while (out_.size() < count_) {
+            CALL(auto n, acceptor_.Accept(out_));
+            if (!n.has_value()) {
+                return batches_;
+            }
+            batches_.push_back(*n);
+        }
+        return batches_;
+
+        PC_END;
+    }
+
+  private:
+    Acceptor& acceptor_;
+    std::vector<OwnedFd>& out_;
+    size_t count_;
+    std::vector<size_t> batches_;
+    CALLS(Acceptor::AcceptOp);
+};
+
+}  // namespace
+
+TEST_CASE("SocketAddress parses numeric hosts") {
+    auto v4 = SocketAddress::Parse("127.0.0.1:8080");
+    REQUIRE(v4.has_value());
+    REQUIRE(v4->Family() == AF_INET);
+    REQUIRE(v4->Port() == 8080);
+    REQUIRE(*v4 == SocketAddress::Loopback(8080));
+
+    auto v6 = SocketAddress::Parse("[::1]:443");
+    REQUIRE(v6.has_value());
+    REQUIRE(v6->Family() == AF_INET6);
+    REQUIRE(v6->Port() == 443);
+
+    REQUIRE_FALSE(SocketAddress::Parse("localhost:80").has_value());
+    REQUIRE_FALSE(SocketAddress::Parse("127.0.0.1").has_value());
+    REQUIRE_FALSE(SocketAddress::Parse("127.0.0.1:").has_value());
+    REQUIRE_FALSE(SocketAddress::Parse("127.0.0.1:70000").has_value());
+    REQUIRE_FALSE(SocketAddress::Parse("::1:80").has_value());
+}
+
+TEST_CASE("Acceptor takes connections in batches") {
+    EventLoop loop{2};
+    loop.Start();
+
+    ListenOptions options{.backlog = 64, .accept_batch = 4};
+    auto listener = Listen(SocketAddress::Loopback(0), options);
+    REQUIRE(listener.has_value());
+    auto addr = SocketAddress::LocalOf(listener->AsRawFd());
+    REQUIRE(addr.has_value());
+    REQUIRE(addr->Port() != 0);
+
+    // Queued before anyone accepts, so the first batches are full
+    constexpr size_t kClients = 10;
+    std::vector<OwnedFd> clients;
+    for (size_t i = 0; i < kClients; ++i) {
+        clients.push_back(ConnectTo(*addr));
+        REQUIRE(clients.back().IsValid());
+    }
+
+    Acceptor acceptor{RegisteredFd{std::move(*listener), &loop}, options};
+    std::vector<OwnedFd> accepted;
+    auto batches =
+        RunOnLoop(loop, AcceptCount{acceptor, accepted, kClients});
+    REQUIRE(accepted.size() == kClients);
+    REQUIRE(batches == std::vector<size_t>{4, 4, 2});
+    for (auto& fd : accepted) {
+        REQUIRE(GetIntOption(fd.AsRawFd(), IPPROTO_TCP, TCP_NODELAY) != 0);
+    }
+
+    // Waits for a connection that comes later
+    std::thread client{[&] {
+        std::this_thread::sleep_for(10ms);
+        clients.push_back(ConnectTo(*addr));
+    }};
+    accepted.clear();
+    batches = RunOnLoop(loop, AcceptCount{acceptor, accepted, 1});
+    client.join();
+    REQUIRE(batches == std::vector<size_t>{1});
+
+    loop.Stop();
+}
+
+TEST_CASE("Listen applies the socket options") {
+    auto listener = Listen(SocketAddress::Loopback(0),
+                           {.reuse_port = true, .defer_accept = 5});
+    REQUIRE(listener.has_value());
+    int fd = listener->AsRawFd();
+    REQUIRE(GetIntOption(fd, SOL_SOCKET, SO_REUSEADDR) != 0);
+    REQUIRE(GetIntOption(fd, SOL_SOCKET, SO_REUSEPORT) != 0);
+    REQUIRE(GetIntOption(fd, IPPROTO_TCP, TCP_DEFER_ACCEPT) > 0);
+
+    // Taken without SO_REUSEPORT
+    auto port = SocketAddress::LocalOf(fd)->Port();
+    auto taken = Listen(SocketAddress::Loopback(port));
+    REQUIRE_FALSE(taken.has_value());
+    REQUIRE(taken.error() == EADDRINUSE);
+}
+
+TEST_CASE("ListenShared binds every listener to the same port") {
+    auto listeners = ListenShared(SocketAddress::Loopback(0), 3);
+    REQUIRE(listeners.has_value());
+    REQUIRE(listeners->size() == 3);
+
+    auto port = SocketAddress::LocalOf((*listeners)[0].AsRawFd())->Port();
+    REQUIRE(port != 0);
+    for (auto& fd : *listeners) {
+        REQUIRE(SocketAddress::LocalOf(fd.AsRawFd())->Port() == port);
+    }
+}
@@ -0,0 +1,97 @@
+#include <proto-coro/arena.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cstddef>
+#include <memory_resource>
+#include <optional>
+#include <vector>
+
+namespace {
+
+struct CountingResource : std::pmr::memory_resource {
+    size_t allocations = 0;
+
+  private:
+    void* do_allocate(size_t bytes, size_t align) override {
+        ++allocations;
+        return std::pmr::new_delete_resource()->allocate(bytes, align);
+    }
+
+    void do_deallocate(void* ptr, size_t bytes, size_t align) override {
+        std::pmr::new_delete_resource()->deallocate(ptr, bytes, align);
+    }
+
+    bool do_is_equal(const memory_resource& other) const noexcept override {
+        return this == &other;
+    }
+};
+
+// Makes the heap allocations through the default resource countable
+struct CountDefault {
+    CountDefault() : previous(std::pmr::set_default_resource(&counting)) {
+    }
+
+    ~CountDefault() {
+        std::pmr::set_default_resource(previous);
+    }
+
+    CountingResource counting;
+    std::pmr::memory_resource* previous;
+};
+
+struct Collect : Pc {
+    explicit Collect(int count) : count_(count) {
+    }
+
+    PROTO_CORO(int) {
+        PC_BEGIN;
+
+        values_.emplace(ARENA);
+        for (int i = 0; i < count_; ++i) {
+            values_->push_back(i);
+        }
+        return static_cast<int>(values_->size());
+
+        PC_END;
+    }
+
+  private:
+    int count_;
+    std::optional<std::pmr::vector<int>> values_;
+};
+
+template <class T>
+OutputOf<T> StepOnce(T& coro) {
+    Context ctx{nullptr, nullptr};
+    auto res = coro.Step(&ctx);
+    REQUIRE(res.has_value());
+    return *res;
+}
+
+}  // namespace
+
+TEST_CASE("Without an arena, ARENA is the default resource") {
+    CountDefault count;
+
+    Collect coro{100};
+    REQUIRE(StepOnce(coro) == 100);
+    REQUIRE(count.counting.allocations > 0);
+}
+
+TEST_CASE("Small allocations stay in the inline buffer of the arena") {
+    CountDefault count;
+
+    WithArena coro{Collect{100}};
+    REQUIRE(StepOnce(coro) == 100);
+    REQUIRE(count.counting.allocations == 0);
+}
+
+TEST_CASE("An arena spills over to the heap once its buffer runs out") {
+    CountDefault count;
+
+    WithArena<Collect, 256> coro{Collect{1'000}};
+    REQUIRE(StepOnce(coro) == 1'000);
+    REQUIRE(count.counting.allocations > 0);
+}
@@ -0,0 +1,213 @@
+#include <proto-coro/blocking/blocking-pool.hpp>
+#include <proto-coro/blocking/file.hpp>
+#include <proto-coro/blocking/spawn-blocking.hpp>
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/pc.hpp>
+#include <proto-coro/thread/event.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "run-on-loop.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+auto Nap(BlockingPool& pool, int value) {
+    return SpawnBlocking(pool, [value] {
+        std::this_thread::sleep_for(20ms);
+        return value;
+    });
+}
+
+using NapOp = decltype(Nap(std::declval<BlockingPool&>(), 0));
+
+struct NapAndAdd : Pc {
+    NapAndAdd(BlockingPool& pool, int value) : pool_(pool), value_(value) {
+    }
+
+    PROTO_CORO(int) {
+        PC_BEGIN;
+
+        {
+            CALL(auto res, Nap(pool_, value_));
+            return res + 1;
+        }
+
+        PC_END;
+    }
+
+  private:
+    BlockingPool& pool_;
+    int value_;
+    CALLS(NapOp);
+};
+
+// Writes data to a file and reads it back in two different ways
+struct RoundTrip : Pc {
+    RoundTrip(std::string path, std::string data)
+        : path_(std::move(path)), data_(std::move(data)),
+          read_(data_.size()) {
+    }
+
+    PROTO_CORO(std::string) {
+        PC_BEGIN;
+
+        {
+            CALL(auto fd, OpenFile(path_, O_RDWR | O_CREAT | O_TRUNC, 0600));
+            fd_ = std::move(*fd);
+        }
+        {
+            CALL(auto written, WriteAt(fd_.AsRawFd(), data_, 0));
+            if (*written != data_.size()) {
+                return std::string{};
+            }
+        }
+        {
+            CALL(auto read, ReadAt(fd_.AsRawFd(), read_, 0));
+            if (*read != data_.size()) {
+                return std::string{};
+            }
+        }
+        {
+            CALL(auto whole, ReadFile(path_));
+            if (*whole != std::string(read_.begin(), read_.end())) {
+                return std::string{};
+            }
+            return std::move(*whole);
+        }
+
+        PC_END;
+    }
+
+  private:
+    std::string path_;
+    std::string data_;
+    std::vector<char> read_;
+    OwnedFd fd_;
+    CALLS(decltype(OpenFile("", 0)), decltype(WriteAt(0, {}, 0)),
+          decltype(ReadAt(0, {}, 0)), decltype(ReadFile("")));
+};
+
+// A task is counted once it has resumed its routine
+void AwaitCompleted(BlockingPool& pool, uint64_t tasks) {
+    while (pool.GetMetrics().completed < tasks) {
+        std::this_thread::sleep_for(1ms);
+    }
+}
+
+}  // namespace
+
+TEST_CASE("Blocking calls run off the workers of the loop") {
+    constexpr int kRoutines = 8;
+
+    EventLoop loop{1};
+    loop.Start();
+    BlockingPool pool;
+
+    std::vector<NapAndAdd> routines;
+    for (int i = 0; i < kRoutines; ++i) {
+        routines.emplace_back(pool, i);
+    }
+
+    auto start = Clock::now();
+    auto res = RunOnLoop(loop, WhenAll(std::move(routines)));
+    // A single worker would have taken kRoutines naps in a row
+    REQUIRE(Clock::now() - start < kRoutines * 20ms);
+    for (int i = 0; i < kRoutines; ++i) {
+        REQUIRE(res[i] == i + 1);
+    }
+
+    AwaitCompleted(pool, kRoutines);
+    auto metrics = pool.GetMetrics();
+    REQUIRE(metrics.threads > 1);
+    REQUIRE(metrics.queued == 0);
+
+    loop.Stop();
+}
+
+TEST_CASE("The blocking pool grows up to its cap") {
+    EventLoop loop{2};
+    loop.Start();
+    BlockingPool pool{2};
+
+    std::vector<NapAndAdd> routines(6, NapAndAdd{pool, 0});
+    RunOnLoop(loop, WhenAll(std::move(routines)));
+
+    AwaitCompleted(pool, 6);
+    auto metrics = pool.GetMetrics();
+    REQUIRE(metrics.threads <= 2);
+    REQUIRE(metrics.peak_queued >= 4);
+
+    loop.Stop();
+}
+
+TEST_CASE("A queued blocking call is withdrawn when cancelled") {
+    EventLoop loop{2};
+    loop.Start();
+    BlockingPool pool{1};
+
+    ThreadOneshotEvent release;
+    std::atomic<bool> ran = false;
+
+    // Keeps the only thread of the pool busy
+    struct Blocker final : BlockingTask {
+        explicit Blocker(ThreadOneshotEvent& release) : release(release) {
+        }
+
+        void Run() override {
+            release.Wait();
+        }
+
+        ThreadOneshotEvent& release;
+    } blocker{release};
+    pool.Submit(&blocker);
+
+    auto res = RunOnLoop(loop, Timeout(SpawnBlocking(pool,
+                                                     [&] {
+                                                         ran = true;
+                                                     }),
+                                       10ms));
+    REQUIRE(res == std::nullopt);
+    REQUIRE(pool.GetMetrics().queued == 0);
+
+    release.Fire();
+    AwaitCompleted(pool, 1);
+    REQUIRE(!ran);
+
+    loop.Stop();
+}
+
+TEST_CASE("Files are read and written through the blocking pool") {
+    EventLoop loop{2};
+    loop.Start();
+
+    char path[] = "/tmp/proto-coro-file-XXXXXX";
+    int fd = mkstemp(path);
+    REQUIRE(fd >= 0);
+    close(fd);
+
+    std::string data(100'000, 'x');
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>('a' + i % 26);
+    }
+    REQUIRE(RunOnLoop(loop, RoundTrip{path, data}) == data);
+    unlink(path);
+
+    auto missing = RunOnLoop(loop, OpenFile(path, O_RDONLY));
+    REQUIRE(!missing.has_value());
+    REQUIRE(missing.error() == ENOENT);
+
+    loop.Stop();
+}
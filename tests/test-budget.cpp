@@ -0,0 +1,138 @@
+#include <proto-coro/budget.hpp>
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "run-on-loop.hpp"
+
+#include <atomic>
+#include <optional>
+
+namespace {
+
+// Never suspends on its own: whatever it polls is always ready
+struct Hot : Pc {
+    Hot(int polls, std::atomic<bool>& other_done)
+        : polls_(polls), other_done_(other_done) {
+    }
+
+    PROTO_CORO(bool) {
+        PC_BEGIN;
+
+        for (i_ = 0; i_ < polls_; ++i_) {
+            POLL(auto value, std::optional<int>{i_});
+            sum_ += value;
+        }
+        return other_done_.load();
+
+        PC_END;
+    }
+
+  private:
+    int polls_;
+    std::atomic<bool>& other_done_;
+    int i_ = 0;
+    int64_t sum_ = 0;
+};
+
+struct Busy : Pc {
+    Busy(int rounds, std::atomic<bool>& other_done)
+        : rounds_(rounds), other_done_(other_done) {
+    }
+
+    PROTO_CORO(bool) {
+        PC_BEGIN;
+
+        for (i_ = 0; i_ < rounds_; ++i_) {
+            COOPERATE;
+        }
+        return other_done_.load();
+
+        PC_END;
+    }
+
+  private:
+    int rounds_;
+    std::atomic<bool>& other_done_;
+    int i_ = 0;
+};
+
+struct SetFlag : Pc {
+    explicit SetFlag(std::atomic<bool>& flag) : flag_(flag) {
+    }
+
+    PROTO_CORO(bool) {
+        flag_ = true;
+        return true;
+    }
+
+  private:
+    std::atomic<bool>& flag_;
+};
+
+// Wrappers, each of which is a level of nesting
+auto Zero() {
+    return FMap{[](auto) {
+        return 0;
+    }};
+}
+
+auto Inc() {
+    return FMap{[](int n) {
+        return n + 1;
+    }};
+}
+
+}  // namespace
+
+TEST_CASE("A routine that is always ready makes way for the others") {
+    // A single worker, so that the other routine has no one else to run it
+    EventLoop loop{1, 16};
+    loop.Start();
+
+    for (int i = 0; i < 10; ++i) {
+        std::atomic<bool> other_done = false;
+        auto [hot_saw_other, _] = RunOnLoop(
+            loop, WhenAll(Hot{10'000, other_done}, SetFlag{other_done}));
+        REQUIRE(hot_saw_other);
+
+        other_done = false;
+        auto [busy_saw_other, __] = RunOnLoop(
+            loop, WhenAll(Busy{10'000, other_done}, SetFlag{other_done}));
+        REQUIRE(busy_saw_other);
+    }
+
+    loop.Stop();
+}
+
+TEST_CASE("Coroutines nested deeper than the budget make progress") {
+    using namespace std::chrono_literals;
+
+    for (uint32_t budget : {1u, 2u}) {
+        EventLoop loop{1, budget};
+        loop.Start();
+
+        auto slept =
+            RunOnLoop(loop, Sleep{1ms} | Zero() | Inc() | Inc() | Inc());
+        REQUIRE(slept == 3);
+
+        std::atomic<bool> other_done = true;
+        auto polled = RunOnLoop(loop, Hot{100, other_done} | Zero() | Inc() |
+                                          Inc() | Inc() | Inc());
+        REQUIRE(polled == 4);
+
+        loop.Stop();
+    }
+}
+
+TEST_CASE("The budget is unlimited outside of a runtime") {
+    REQUIRE(Budget::Remaining() == Budget::kUnlimited);
+
+    // Would have to be resubmitted to a runtime that is not there
+    std::atomic<bool> other_done = false;
+    Hot hot{10'000, other_done};
+    Context ctx{nullptr, nullptr};
+    REQUIRE(hot.Step(&ctx).has_value());
+}
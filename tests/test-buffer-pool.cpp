@@ -0,0 +1,150 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/event-loop/owned-fd.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/io/buf-reader.hpp>
+#include <proto-coro/io/buf-writer.hpp>
+#include <proto-coro/io/buffer-pool.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "run-on-loop.hpp"
+#include "socket-pair.hpp"
+
+#include <algorithm>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+TEST_CASE("BufferPool hands out size classes and reuses them") {
+    BufferPool pool{{.size_classes = {1024, 256}}};
+    REQUIRE(pool.SizeFor(1) == 256);
+    REQUIRE(pool.SizeFor(256) == 256);
+    REQUIRE(pool.SizeFor(257) == 1024);
+    REQUIRE(pool.SizeFor(5000) == 5000);
+
+    auto buffer = pool.Acquire(100);
+    REQUIRE(buffer.Size() == 256);
+    auto* data = buffer.Data();
+    buffer.Reset();
+    REQUIRE(pool.CachedBytes() == 256);
+
+    // Back from the cache
+    buffer = pool.Acquire(200);
+    REQUIRE(buffer.Data() == data);
+    REQUIRE(pool.CachedBytes() == 0);
+
+    // Too large for any class, so never cached
+    pool.Acquire(5000).Reset();
+    REQUIRE(pool.CachedBytes() == 0);
+
+    // Returned on another thread, which caches it on its own
+    std::thread other{[buffer = std::move(buffer)]() mutable {
+        buffer.Reset();
+    }};
+    other.join();
+    REQUIRE(pool.CachedBytes() == 256);
+}
+
+TEST_CASE("BufferPool caches up to its caps") {
+    BufferPool pool{{.size_classes = {1024},
+                     .max_cached_per_thread = 2048,
+                     .max_cached_shared = 1024}};
+    std::vector<BufferPool::Buffer> buffers;
+    std::vector<char*> data;
+    for (int i = 0; i < 4; ++i) {
+        buffers.push_back(pool.Acquire(1024));
+        data.push_back(buffers.back().Data());
+    }
+    // Two for the thread, one overflows into the shared cache and the last
+    // goes back to the heap
+    buffers.clear();
+    REQUIRE(pool.CachedBytes() == 3072);
+
+    // Another thread has nothing of its own yet, so it takes the shared one
+    char* taken = nullptr;
+    std::thread{[&] {
+        taken = pool.Acquire(1024).Data();
+    }}.join();
+    REQUIRE(std::find(data.begin(), data.end(), taken) != data.end());
+    // Then caches it on its own when done
+    REQUIRE(pool.CachedBytes() == 3072);
+}
+
+TEST_CASE("Pooled BufReader holds a buffer only while it has data") {
+    // A single worker, so that every buffer goes through the same cache
+    EventLoop loop{1};
+    loop.Start();
+    auto [fd, peer] = MakePair(loop);
+    BufferPool pool{{.size_classes = {4096}}};
+
+    {
+        BufReader reader{fd, pool, 100};
+        REQUIRE(reader.Capacity() == 4096);
+        REQUIRE_FALSE(reader.HoldsBuffer());
+
+        // Takes a buffer for each attempt to read and gives it back when
+        // there is nothing yet, so waiting for data holds none
+        size_t cached_while_waiting = 0;
+        std::thread writer{[&] {
+            std::this_thread::sleep_for(10ms);
+            cached_while_waiting = pool.CachedBytes();
+            [[maybe_unused]] auto n = write(peer.AsRawFd(), "one\ntwo\n", 8);
+        }};
+        auto line = RunOnLoop(loop, reader.PeekUntil("\n"));
+        writer.join();
+        REQUIRE(cached_while_waiting == 4096);
+        REQUIRE(line == "one\n");
+        REQUIRE(reader.HoldsBuffer());
+
+        reader.Consume(line->size());
+        REQUIRE(reader.HoldsBuffer());
+        line = RunOnLoop(loop, reader.PeekUntil("\n"));
+        REQUIRE(line == "two\n");
+        reader.Consume(line->size());
+        REQUIRE_FALSE(reader.HoldsBuffer());
+        REQUIRE(pool.CachedBytes() == 4096);
+    }
+
+    loop.Stop();
+}
+
+TEST_CASE("Pooled BufWriter holds a buffer only while output is pending") {
+    EventLoop loop{1};
+    loop.Start();
+    auto [fd, peer] = MakePair(loop);
+    BufferPool pool{{.size_classes = {4096}}};
+
+    {
+        BufWriter writer{fd, pool, 4096};
+        REQUIRE_FALSE(writer.HoldsBuffer());
+
+        std::string_view data = "hello";
+        REQUIRE(RunOnLoop(loop, writer.WriteAll(data)) == 5);
+        REQUIRE(writer.HoldsBuffer());
+        REQUIRE(RunOnLoop(loop, writer.Flush()) == 5);
+        REQUIRE_FALSE(writer.HoldsBuffer());
+        REQUIRE(pool.CachedBytes() == 4096);
+
+        // Too large to buffer, so it goes out directly
+        std::string large(10000, 'x');
+        REQUIRE(RunOnLoop(loop, writer.WriteAll(large)) == large.size());
+        REQUIRE_FALSE(writer.HoldsBuffer());
+
+        std::string got(5 + large.size(), 0);
+        for (size_t done = 0; done < got.size();) {
+            auto n = read(peer.AsRawFd(), got.data() + done, got.size() - done);
+            REQUIRE(n > 0);
+            done += n;
+        }
+        REQUIRE(got == "hello" + large);
+    }
+
+    loop.Stop();
+}
@@ -0,0 +1,145 @@
+#include <proto-coro/cancel.hpp>
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "run-on-loop.hpp"
+
+#include <atomic>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Stuck like a client that never sends its request
+struct ReadOne : Pc {
+    explicit ReadOne(RawFd fd) : fd_(fd) {
+    }
+
+    PROTO_CORO(char) {
+        PC_BEGIN;
+
+        while (true) {
+            {
+                char c;
+                if (read(fd_, &c, 1) == 1) {
+                    return c;
+                }
+            }
+            WAIT_READY(fd_, InterestKind::Readable);
+        }
+
+        PC_END;
+    }
+
+  private:
+    RawFd fd_;
+};
+
+struct Spin : Pc {
+    explicit Spin(std::atomic<int>& spins) : spins_(spins) {
+    }
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        while (true) {
+            ++spins_;
+            CANCELLATION_POINT;
+        }
+
+        PC_END;
+    }
+
+  private:
+    std::atomic<int>& spins_;
+};
+
+struct Pipe {
+    Pipe(IRuntime* rt) {
+        int fds[2];
+        REQUIRE(pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0);
+        read_end.emplace(OwnedFd::FromRaw(fds[0]), rt);
+        write_end = OwnedFd::FromRaw(fds[1]);
+    }
+
+    std::optional<RegisteredFd> read_end;
+    OwnedFd write_end;
+};
+
+}  // namespace
+
+TEST_CASE("Timeout drops a routine stuck waiting for an fd") {
+    EventLoop loop{2};
+    loop.Start();
+    Pipe pipe{&loop};
+
+    auto start = Clock::now();
+    auto res =
+        RunOnLoop(loop, Timeout(ReadOne{pipe.read_end->AsRawFd()}, 20ms));
+    REQUIRE(!res.has_value());
+    REQUIRE(Clock::now() - start >= 20ms);
+
+    REQUIRE(write(pipe.write_end.AsRawFd(), "x", 1) == 1);
+    res = RunOnLoop(loop, Timeout(ReadOne{pipe.read_end->AsRawFd()}, 1h));
+    REQUIRE(res == 'x');
+
+    loop.Stop();
+}
+
+TEST_CASE("CancelSource cancels every routine run on its token") {
+    EventLoop loop{2};
+    loop.Start();
+    Pipe first{&loop};
+    Pipe second{&loop};
+
+    CancelSource source;
+    std::thread canceller([&source] {
+        std::this_thread::sleep_for(20ms);
+        source.Cancel();
+    });
+
+    auto [a, b] = RunOnLoop(
+        loop,
+        WhenAll(WithCancel(ReadOne{first.read_end->AsRawFd()}, source.Token()),
+                WithCancel(ReadOne{second.read_end->AsRawFd()},
+                           source.Token())));
+    canceller.join();
+
+    REQUIRE(!a.has_value());
+    REQUIRE(!b.has_value());
+
+    // Cancelled before it starts, so it never runs
+    std::atomic<int> spins = 0;
+    auto res = RunOnLoop(loop, WithCancel(Spin{spins}, source.Token()));
+    REQUIRE(!res.has_value());
+    REQUIRE(spins == 0);
+
+    loop.Stop();
+}
+
+TEST_CASE("Routines that never suspend stop at a cancellation point") {
+    EventLoop loop{2};
+    loop.Start();
+
+    CancelSource source;
+    std::atomic<int> spins = 0;
+    std::thread canceller([&] {
+        while (spins < 1000) {
+            std::this_thread::yield();
+        }
+        source.Cancel();
+    });
+
+    auto res = RunOnLoop(loop, WithCancel(Spin{spins}, source.Token()));
+    canceller.join();
+    REQUIRE(!res.has_value());
+
+    loop.Stop();
+}
@@ -0,0 +1,256 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/pc.hpp>
+#include <proto-coro/sync/channel.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "run-on-loop.hpp"
+
+#include <atomic>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+using IntChannel = Channel<int>;
+
+// Sends [from, from + count), the last producer to finish closes the channel
+struct Producer : Pc {
+    Producer(IntChannel& channel, int from, int count,
+             std::atomic<int>& producers)
+        : channel_(channel), from_(from), count_(count),
+          producers_(producers) {
+    }
+
+    PROTO_CORO(int) {
+        PC_BEGIN;
+
+        for (i_ = 0; i_ < count_; ++i_) {
+            CALL(bool sent, channel_.Send(from_ + i_));
+            sent_ += sent ? 1 : 0;
+        }
+        if (producers_.fetch_sub(1) == 1) {
+            channel_.Close();
+        }
+        return sent_;
+
+        PC_END;
+    }
+
+  private:
+    IntChannel& channel_;
+    int from_;
+    int count_;
+    std::atomic<int>& producers_;
+    int i_ = 0;
+    int sent_ = 0;
+    CALLS(IntChannel::SendOp);
+};
+
+// Receives until the channel is closed and drained
+struct Consumer : Pc {
+    explicit Consumer(IntChannel& channel) : channel_(channel) {
+    }
+
+    PROTO_CORO(int64_t) {
+        PC_BEGIN;
+
+        while (true) {
+            CALL(auto value, channel_.Recv());
+            if (!value.has_value()) {
+                return sum_;
+            }
+            sum_ += *value;
+        }
+
+        PC_END;
+    }
+
+  private:
+    IntChannel& channel_;
+    int64_t sum_ = 0;
+    CALLS(IntChannel::RecvOp);
+};
+
+struct BatchProducer : Pc {
+    BatchProducer(IntChannel& channel, std::vector<int> values)
+        : channel_(channel), values_(std::move(values)) {
+    }
+
+    PROTO_CORO(size_t) {
+        PC_BEGIN;
+
+        CALL(sent_, channel_.SendMany(values_));
+        channel_.Close();
+        return sent_;
+
+        PC_END;
+    }
+
+  private:
+    IntChannel& channel_;
+    std::vector<int> values_;
+    size_t sent_ = 0;
+    CALLS(IntChannel::SendManyOp);
+};
+
+struct BatchConsumer : Pc {
+    explicit BatchConsumer(IntChannel& channel)
+        : channel_(channel), buffer_(5) {
+    }
+
+    PROTO_CORO(std::vector<int>) {
+        PC_BEGIN;
+
+        while (true) {
+            CALL(size_t received, channel_.RecvMany(buffer_));
+            if (received == 0) {
+                return std::move(values_);
+            }
+            values_.insert(values_.end(), buffer_.begin(),
+                           buffer_.begin() + received);
+        }
+
+        PC_END;
+    }
+
+  private:
+    IntChannel& channel_;
+    std::vector<int> buffer_;
+    std::vector<int> values_;
+    CALLS(IntChannel::RecvManyOp);
+};
+
+}  // namespace
+
+TEST_CASE("Channel delivers every value across producers and consumers") {
+    constexpr int kProducers = 4;
+    constexpr int kConsumers = 4;
+    constexpr int kPerProducer = 10'000;
+
+    EventLoop loop{4};
+    loop.Start();
+
+    IntChannel channel{4};
+    std::atomic<int> producers = kProducers;
+
+    std::vector<Producer> senders;
+    for (int i = 0; i < kProducers; ++i) {
+        senders.emplace_back(channel, i * kPerProducer, kPerProducer,
+                             producers);
+    }
+    std::vector<Consumer> receivers(kConsumers, Consumer{channel});
+
+    auto [sent, sums] = RunOnLoop(
+        loop, WhenAll(WhenAll(std::move(senders)), WhenAll(receivers)));
+
+    constexpr int64_t kTotal = kProducers * kPerProducer;
+    REQUIRE(std::accumulate(sent.begin(), sent.end(), 0) == kTotal);
+    REQUIRE(std::accumulate(sums.begin(), sums.end(), int64_t{0}) ==
+            kTotal * (kTotal - 1) / 2);
+
+    loop.Stop();
+}
+
+TEST_CASE("Channel batches keep the order of a single producer") {
+    EventLoop loop{2};
+    loop.Start();
+
+    IntChannel channel{8};
+    std::vector<int> values(1'000);
+    std::iota(values.begin(), values.end(), 0);
+
+    auto [sent, received] = RunOnLoop(
+        loop, WhenAll(BatchProducer{channel, values}, BatchConsumer{channel}));
+
+    REQUIRE(sent == values.size());
+    REQUIRE(received == values);
+
+    loop.Stop();
+}
+
+TEST_CASE("A full channel blocks senders at exactly its capacity") {
+    EventLoop loop{2};
+    loop.Start();
+
+    IntChannel channel{1};
+    REQUIRE(channel.Capacity() == 1);
+    REQUIRE(RunOnLoop(loop, channel.Send(1)));
+    REQUIRE(RunOnLoop(loop, Timeout(channel.Send(2), 10ms)) == std::nullopt);
+
+    REQUIRE(RunOnLoop(loop, channel.Recv()) == 1);
+    REQUIRE(RunOnLoop(loop, channel.Send(3)));
+    REQUIRE(RunOnLoop(loop, channel.Recv()) == 3);
+
+    // Not rounded up to a power of two either
+    IntChannel three{3};
+    for (int lap = 0; lap < 3; ++lap) {
+        for (int i = 0; i < 3; ++i) {
+            int value = i;
+            REQUIRE(three.TrySend(value));
+        }
+        int value = 3;
+        REQUIRE(!three.TrySend(value));
+        for (int i = 0; i < 3; ++i) {
+            REQUIRE(three.TryRecv() == i);
+        }
+        REQUIRE(three.TryRecv() == std::nullopt);
+    }
+
+    loop.Stop();
+}
+
+TEST_CASE("Closing a channel fails sends and drains receives") {
+    EventLoop loop{2};
+    loop.Start();
+
+    IntChannel channel{2};
+    int value = 1;
+    REQUIRE(channel.TrySend(value));
+    channel.Close();
+
+    value = 2;
+    REQUIRE(!channel.TrySend(value));
+    REQUIRE(!RunOnLoop(loop, channel.Send(3)));
+
+    REQUIRE(RunOnLoop(loop, channel.Recv()) == 1);
+    REQUIRE(RunOnLoop(loop, channel.Recv()) == std::nullopt);
+
+    loop.Stop();
+}
+
+TEST_CASE("Close wakes up blocked receivers") {
+    EventLoop loop{2};
+    loop.Start();
+
+    IntChannel channel{2};
+    std::atomic<int> producers = 1;
+
+    auto [sent, sums] = RunOnLoop(
+        loop, WhenAll(Producer{channel, 0, 0, producers},
+                      WhenAll(std::vector<Consumer>(3, Consumer{channel}))));
+
+    REQUIRE(sent == 0);
+    REQUIRE(sums == std::vector<int64_t>(3, 0));
+
+    loop.Stop();
+}
+
+TEST_CASE("A receiver that times out leaves no waiter behind") {
+    EventLoop loop{2};
+    loop.Start();
+
+    IntChannel channel{1};
+    REQUIRE(RunOnLoop(loop, Timeout(channel.Recv(), 10ms)) == std::nullopt);
+
+    // Would wake the receiver that is gone
+    int value = 5;
+    REQUIRE(channel.TrySend(value));
+    REQUIRE(RunOnLoop(loop, channel.Recv()) == 5);
+
+    loop.Stop();
+}
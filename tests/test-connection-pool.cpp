@@ -0,0 +1,157 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/event-loop/owned-fd.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/net/acceptor.hpp>
+#include <proto-coro/net/address.hpp>
+#include <proto-coro/net/connect.hpp>
+#include <proto-coro/net/connection-pool.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "run-on-loop.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <optional>
+#include <sys/socket.h>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// A listener on loopback, whose connections just sit in its queue until
+// taken
+struct TestServer {
+    TestServer() {
+        auto fd = Listen(SocketAddress::Loopback(0));
+        REQUIRE(fd.has_value());
+        listener = std::move(*fd);
+        addr = *SocketAddress::LocalOf(listener.AsRawFd());
+    }
+
+    // The connections made since the last call
+    std::vector<OwnedFd> TakeAccepted() {
+        std::vector<OwnedFd> accepted;
+        while (true) {
+            int fd = accept4(listener.AsRawFd(), nullptr, nullptr,
+                             SOCK_CLOEXEC);
+            if (fd < 0) {
+                return accepted;
+            }
+            accepted.push_back(OwnedFd::FromRaw(fd));
+        }
+    }
+
+    OwnedFd listener;
+    SocketAddress addr;
+};
+
+}  // namespace
+
+TEST_CASE("Connect opens connections and reports failed ones") {
+    EventLoop loop{1};
+    loop.Start();
+    TestServer server;
+
+    auto fd = RunOnLoop(loop, Connect(server.addr));
+    REQUIRE(fd.has_value());
+    REQUIRE(server.TakeAccepted().size() == 1);
+
+    // Nothing listens on the port once the listener is gone
+    auto addr = server.addr;
+    server.listener.Reset();
+    auto refused = RunOnLoop(loop, Connect(addr));
+    REQUIRE_FALSE(refused.has_value());
+    REQUIRE(refused.error() == ECONNREFUSED);
+
+    loop.Stop();
+}
+
+TEST_CASE("ConnectionPool reuses released connections") {
+    EventLoop loop{1};
+    loop.Start();
+    TestServer server;
+    ConnectionPool pool{server.addr};
+
+    {
+        auto lease = RunOnLoop(loop, pool.Acquire());
+        REQUIRE(lease.has_value());
+        REQUIRE_FALSE(lease->IsReused());
+        lease->Release();
+    }
+    REQUIRE(pool.IdleCount() == 1);
+    {
+        auto lease = RunOnLoop(loop, pool.Acquire());
+        REQUIRE(lease.has_value());
+        REQUIRE(lease->IsReused());
+        REQUIRE(pool.IdleCount() == 0);
+        // Dropped without a release, so it is closed
+    }
+    REQUIRE(pool.IdleCount() == 0);
+    {
+        auto lease = RunOnLoop(loop, pool.Acquire());
+        REQUIRE(lease.has_value());
+        REQUIRE_FALSE(lease->IsReused());
+        lease->Release();
+    }
+    REQUIRE(server.TakeAccepted().size() == 2);
+
+    loop.Stop();
+}
+
+TEST_CASE("ConnectionPool drops expired and closed connections") {
+    EventLoop loop{1};
+    loop.Start();
+    TestServer server;
+    ConnectionPool pool{server.addr, {.idle_timeout = 20ms}};
+
+    RunOnLoop(loop, pool.Acquire())->Release();
+    std::this_thread::sleep_for(30ms);
+    pool.EvictIdle();
+    REQUIRE(pool.IdleCount() == 0);
+
+    // Closed by the server while idle
+    RunOnLoop(loop, pool.Acquire())->Release();
+    REQUIRE(server.TakeAccepted().size() == 2);
+    REQUIRE(pool.IdleCount() == 1);
+    {
+        auto lease = RunOnLoop(loop, pool.Acquire());
+        REQUIRE(lease.has_value());
+        REQUIRE_FALSE(lease->IsReused());
+        lease->Release();
+    }
+
+    loop.Stop();
+}
+
+TEST_CASE("ConnectionPool waits for a connection at its limit") {
+    EventLoop loop{2};
+    loop.Start();
+    TestServer server;
+    ConnectionPool pool{server.addr, {.max_connections = 1}};
+
+    auto first = RunOnLoop(loop, pool.Acquire());
+    REQUIRE(first.has_value());
+
+    std::atomic<bool> acquired = false;
+    std::optional<ConnectionPool::AcquireResult> second;
+    std::thread waiter{[&] {
+        second.emplace(RunOnLoop(loop, pool.Acquire()));
+        acquired = true;
+    }};
+    std::this_thread::sleep_for(20ms);
+    REQUIRE_FALSE(acquired);
+
+    first->Release();
+    waiter.join();
+    REQUIRE(second->has_value());
+    REQUIRE((*second)->IsReused());
+    REQUIRE(server.TakeAccepted().size() == 1);
+
+    loop.Stop();
+}
@@ -0,0 +1,181 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/pc.hpp>
+#include <proto-coro/sync/event.hpp>
+#include <proto-coro/sync/latch.hpp>
+#include <proto-coro/sync/wait-group.hpp>
+#include <proto-coro/thread/event.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "run-on-loop.hpp"
+
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+template <class Primitive>
+struct WaitFor : Pc {
+    WaitFor(Primitive& primitive, std::atomic<int>& woken)
+        : primitive_(primitive), woken_(woken) {
+    }
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        CALL_DISCARD(primitive_.Wait());
+        ++woken_;
+        return Unit{};
+
+        PC_END;
+    }
+
+  private:
+    Primitive& primitive_;
+    std::atomic<int>& woken_;
+    CALLS(decltype(std::declval<Primitive&>().Wait()));
+};
+
+struct CountDown : Pc {
+    explicit CountDown(Latch& latch) : latch_(latch) {
+    }
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        YIELD;
+        latch_.CountDown();
+        return Unit{};
+
+        PC_END;
+    }
+
+  private:
+    Latch& latch_;
+};
+
+}  // namespace
+
+TEST_CASE("Event fired by a thread wakes up routines and threads") {
+    constexpr int kRoutines = 8;
+    constexpr int kThreads = 4;
+
+    EventLoop loop{2};
+    loop.Start();
+
+    Event event;
+    std::atomic<int> woken = 0;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < kThreads; ++i) {
+        threads.emplace_back([&] {
+            event.BlockingWait();
+            ++woken;
+        });
+    }
+    std::thread firer{[&] {
+        std::this_thread::sleep_for(10ms);
+        event.Fire();
+    }};
+
+    RunOnLoop(loop, WhenAll(std::vector<WaitFor<Event>>(
+                        kRoutines, WaitFor<Event>{event, woken})));
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    firer.join();
+
+    REQUIRE(woken == kRoutines + kThreads);
+    REQUIRE(event.IsFired());
+
+    loop.Stop();
+}
+
+TEST_CASE("Latch opens once every routine has counted down") {
+    constexpr int kRoutines = 16;
+
+    EventLoop loop{4};
+    loop.Start();
+
+    Latch latch{kRoutines};
+    std::atomic<int> woken = 0;
+
+    RunOnLoop(loop,
+              WhenAll(WaitFor<Latch>{latch, woken},
+                      WhenAll(std::vector<CountDown>(kRoutines,
+                                                     CountDown{latch}))));
+
+    REQUIRE(woken == 1);
+    REQUIRE(latch.TryWait());
+    latch.BlockingWait();
+
+    loop.Stop();
+}
+
+TEST_CASE("WaitGroup releases its waiters every time it drains") {
+    EventLoop loop{2};
+    loop.Start();
+
+    WaitGroup group;
+    std::atomic<int> woken = 0;
+
+    for (int round = 1; round <= 3; ++round) {
+        group.Add(2);
+        std::thread worker{[&] {
+            std::this_thread::sleep_for(5ms);
+            group.Done();
+            group.Done();
+        }};
+        RunOnLoop(loop, WaitFor<WaitGroup>{group, woken});
+        group.BlockingWait();
+        worker.join();
+
+        REQUIRE(woken == round);
+        REQUIRE(group.IsIdle());
+    }
+
+    loop.Stop();
+}
+
+TEST_CASE("A routine that stops waiting for an event is withdrawn") {
+    EventLoop loop{2};
+    loop.Start();
+
+    std::atomic<int> woken = 0;
+    {
+        Event event;
+        REQUIRE(RunOnLoop(loop, Timeout(WaitFor<Event>{event, woken}, 10ms)) ==
+                std::nullopt);
+        // Would wake the routine that is gone
+        event.Fire();
+    }
+    REQUIRE(woken == 0);
+
+    loop.Stop();
+}
+
+TEST_CASE("ThreadOneshotEvent releases every waiting thread") {
+    ThreadOneshotEvent event;
+    std::atomic<int> woken = 0;
+
+    std::vector<std::thread> threads;
+    for (int i = 0; i < 4; ++i) {
+        threads.emplace_back([&] {
+            event.Wait();
+            ++woken;
+        });
+    }
+    std::this_thread::sleep_for(5ms);
+    event.Fire();
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    event.Wait();
+
+    REQUIRE(woken == 4);
+}
@@ -0,0 +1,193 @@
+#include <proto-coro/http/file-cache.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <string>
+#include <string_view>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+struct TempDir {
+    TempDir() {
+        REQUIRE(mkdtemp(path) != nullptr);
+    }
+
+    // Replaces the file as a whole, as FileCache expects
+    void Write(const std::string& name, std::string_view data,
+               time_t mtime = 1'000'000) {
+        auto full = std::string{path} + "/" + name;
+        auto temp = full + ".tmp";
+        int fd = open(temp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600);
+        REQUIRE(fd >= 0);
+        REQUIRE(write(fd, data.data(), data.size()) ==
+                static_cast<ssize_t>(data.size()));
+        timespec times[2] = {{mtime, 0}, {mtime, 0}};
+        REQUIRE(futimens(fd, times) == 0);
+        close(fd);
+        REQUIRE(rename(temp.c_str(), full.c_str()) == 0);
+        files.push_back(full);
+    }
+
+    ~TempDir() {
+        for (auto& file : files) {
+            unlink(file.c_str());
+        }
+        rmdir(path);
+    }
+
+    char path[32] = "/tmp/proto-coro-cache-XXXXXX";
+    std::vector<std::string> files;
+};
+
+}  // namespace
+
+TEST_CASE("Small files are mapped, large ones kept open") {
+    TempDir dir;
+    dir.Write("small.css", "body {}");
+    dir.Write("large.bin", std::string(1000, 'x'));
+    FileCache cache{dir.path, {.max_mapped_size = 100}};
+
+    auto small = cache.Load("small.css");
+    REQUIRE(small.has_value());
+    REQUIRE((*small)->IsMapped());
+    REQUIRE((*small)->Data() == "body {}");
+    REQUIRE((*small)->Headers() ==
+            "Content-Type: text/css; charset=utf-8\r\n"
+            "Last-Modified: Mon, 12 Jan 1970 13:46:40 GMT\r\n");
+
+    auto large = cache.Load("large.bin");
+    REQUIRE(large.has_value());
+    REQUIRE(!(*large)->IsMapped());
+    REQUIRE((*large)->Size() == 1000);
+    char c;
+    REQUIRE(pread((*large)->Fd(), &c, 1, 999) == 1);
+    REQUIRE(c == 'x');
+
+    REQUIRE(cache.TotalMapped() == 7);
+    REQUIRE(cache.Find("small.css") == *small);
+    REQUIRE(cache.Find("missing") == nullptr);
+}
+
+TEST_CASE("Changed files are loaded anew") {
+    TempDir dir;
+    dir.Write("page.html", "old");
+    FileCache cache{dir.path, {.revalidate_after = 0s}};
+
+    auto old = cache.Load("page.html");
+    REQUIRE(old.has_value());
+    // Not fresh for a moment with no revalidation delay
+    REQUIRE(cache.Find("page.html") == nullptr);
+    REQUIRE(cache.Load("page.html") == old);
+
+    dir.Write("page.html", "newer", 2'000'000);
+    auto fresh = cache.Load("page.html");
+    REQUIRE(fresh.has_value());
+    REQUIRE((*fresh)->Data() == "newer");
+    // Whoever holds the old entry still sees the old contents
+    REQUIRE((*old)->Data() == "old");
+    REQUIRE(cache.TotalMapped() == 5);
+}
+
+TEST_CASE("Paths stay under the root") {
+    TempDir dir;
+    dir.Write("index.html", "index");
+    FileCache cache{dir.path};
+
+    REQUIRE((*cache.Load(""))->Data() == "index");
+    REQUIRE((*cache.Load("./index.html"))->Data() == "index");
+    REQUIRE(cache.Load("../index.html").error() == ENOENT);
+    REQUIRE(cache.Load("a/../../etc/passwd").error() == ENOENT);
+    REQUIRE(cache.Load("missing.html").error() == ENOENT);
+    REQUIRE(cache.Load("index.html/x").error() == ENOTDIR);
+}
+
+TEST_CASE("Symlinks do not lead out of the root") {
+    TempDir outside;
+    outside.Write("secret.txt", "secret");
+    TempDir dir;
+    dir.Write("index.html", "index");
+    auto link = [&](const std::string& target, const std::string& name) {
+        auto full = std::string{dir.path} + "/" + name;
+        REQUIRE(symlink(target.c_str(), full.c_str()) == 0);
+        dir.files.push_back(full);
+    };
+    link(std::string{outside.path} + "/secret.txt", "secret.txt");
+    link(outside.path, "out");
+    link("/proc/self/root/etc/passwd", "passwd");
+    link("index.html", "home.html");
+    FileCache cache{dir.path};
+
+    REQUIRE(cache.Load("secret.txt").error() == ENOENT);
+    REQUIRE(cache.Load("out/secret.txt").error() == ENOENT);
+    REQUIRE(cache.Load("passwd").error() == ENOENT);
+    REQUIRE(cache.Size() == 0);
+
+    // Ones that stay under the root are fine
+    REQUIRE((*cache.Load("home.html"))->Data() == "index");
+}
+
+TEST_CASE("Paths to the same file share its entry") {
+    TempDir dir;
+    dir.Write("small.css", "body {}");
+    dir.Write("large.bin", std::string(1000, 'x'));
+    FileCache cache{dir.path, {.max_mapped_size = 100}};
+
+    auto small = cache.Load("small.css");
+    auto large = cache.Load("large.bin");
+    REQUIRE(small.has_value());
+    REQUIRE(large.has_value());
+    for (std::string_view prefix : {"/", "//", "./", "././", ".//./"}) {
+        auto path = std::string{prefix} + "small.css";
+        REQUIRE(cache.Load(path) == small);
+        REQUIRE(cache.Find(path) == *small);
+        REQUIRE(cache.Load(std::string{prefix} + "large.bin") == large);
+    }
+    // Neither mapped nor opened again
+    REQUIRE(cache.Size() == 2);
+    REQUIRE(cache.TotalMapped() == 7);
+}
+
+TEST_CASE("Entries of deleted files are dropped") {
+    TempDir dir;
+    dir.Write("small.css", "body {}");
+    dir.Write("large.bin", std::string(1000, 'x'));
+    FileCache cache{dir.path, {.max_mapped_size = 100, .revalidate_after = 0s}};
+
+    REQUIRE(cache.Load("small.css").has_value());
+    REQUIRE(cache.Load("large.bin").has_value());
+    REQUIRE(cache.Size() == 2);
+
+    for (auto& file : dir.files) {
+        REQUIRE(unlink(file.c_str()) == 0);
+    }
+    REQUIRE(cache.Load("small.css").error() == ENOENT);
+    REQUIRE(cache.Load("./large.bin").error() == ENOENT);
+    REQUIRE(cache.Size() == 0);
+    REQUIRE(cache.TotalMapped() == 0);
+}
+
+TEST_CASE("The cache holds at most max_entries files") {
+    TempDir dir;
+    for (char name = 'a'; name < 'f'; ++name) {
+        dir.Write(std::string{name} + ".txt", std::string{name});
+    }
+    FileCache cache{dir.path, {.max_entries = 2}};
+
+    for (char name = 'a'; name < 'f'; ++name) {
+        auto file = cache.Load(std::string{name} + ".txt");
+        REQUIRE(file.has_value());
+        REQUIRE((*file)->Data() == std::string{name});
+    }
+    REQUIRE(cache.Size() == 2);
+    REQUIRE(cache.TotalMapped() == 2);
+    REQUIRE(cache.Find("e.txt") != nullptr);
+    REQUIRE(cache.Find("a.txt") == nullptr);
+}
@@ -0,0 +1,122 @@
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/http/file-cache.hpp>
+#include <proto-coro/http/request.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "http_connection.hpp"
+#include "run-on-loop.hpp"
+#include "socket-pair.hpp"
+
+#include <string>
+#include <string_view>
+#include <unistd.h>
+
+TEST_CASE("Requests are parsed in place") {
+    std::string head =
+        "POST /submit?x=1 HTTP/1.1\r\n"
+        "Host: localhost:3333\r\n"
+        "content-length:  12 \r\n"
+        "X-Empty:\r\n"
+        "\r\n";
+    HttpRequest request;
+    REQUIRE(ParseHttpRequest(head, request).has_value());
+
+    REQUIRE(request.method == "POST");
+    REQUIRE(request.target == "/submit?x=1");
+    REQUIRE(request.minor_version == 1);
+    REQUIRE(request.content_length == 12);
+    REQUIRE(request.keep_alive);
+    REQUIRE(request.headers.size() == 3);
+    REQUIRE(request.Find("HOST") == "localhost:3333");
+    REQUIRE(request.Find("x-empty") == "");
+    REQUIRE(request.Find("Accept") == std::nullopt);
+
+    // Views into the head rather than copies
+    REQUIRE(request.method.data() == head.data());
+    REQUIRE(request.headers[0].value.data() == head.data() + 33);
+}
+
+TEST_CASE("Keep-alive follows the version and Connection") {
+    HttpRequest request;
+
+    REQUIRE(ParseHttpRequest(
+                "GET / HTTP/1.1\r\nConnection: Upgrade, close\r\n\r\n",
+                request)
+                .has_value());
+    REQUIRE(!request.keep_alive);
+
+    REQUIRE(ParseHttpRequest("GET / HTTP/1.0\r\n\r\n", request).has_value());
+    REQUIRE(!request.keep_alive);
+
+    REQUIRE(ParseHttpRequest(
+                "GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n", request)
+                .has_value());
+    REQUIRE(request.keep_alive);
+    REQUIRE(request.minor_version == 0);
+
+    // Nothing is left over from the previous request
+    REQUIRE(ParseHttpRequest("GET / HTTP/1.1\r\n\r\n", request).has_value());
+    REQUIRE(request.keep_alive);
+    REQUIRE(request.headers.empty());
+    REQUIRE(request.content_length == 0);
+}
+
+TEST_CASE("Header names and options fold the case of letters only") {
+    using http_detail::EqualsIgnoreCase;
+    using http_detail::HasOption;
+
+    REQUIRE(EqualsIgnoreCase("Keep-Alive", "keep-alive"));
+    REQUIRE(!EqualsIgnoreCase("@", "`"));
+    REQUIRE(!EqualsIgnoreCase("[", "{"));
+    REQUIRE(!EqualsIgnoreCase("\r", "-"));
+
+    REQUIRE(HasOption("Upgrade, KEEP-ALIVE", "keep-alive"));
+    REQUIRE(!HasOption("keep\ralive", "keep-alive"));
+}
+
+TEST_CASE("Malformed requests are rejected") {
+    HttpRequest request;
+    auto status = [&](std::string_view head) {
+        auto res = ParseHttpRequest(head, request);
+        return res.has_value() ? uint16_t{0} : res.error();
+    };
+
+    REQUIRE(status("GET / HTTP/1.1\r\n") == 400);
+    REQUIRE(status("\r\n\r\n") == 400);
+    REQUIRE(status("GET /\r\n\r\n") == 400);
+    REQUIRE(status("GET / HTTP/2.0\r\n\r\n") == 400);
+    REQUIRE(status("G(T / HTTP/1.1\r\n\r\n") == 400);
+    REQUIRE(status("GET / HTTP/1.1\r\nNo colon\r\n\r\n") == 400);
+    REQUIRE(status("GET / HTTP/1.1\r\nA: b\r\n folded\r\n\r\n") == 400);
+    REQUIRE(status("GET / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n") == 400);
+    REQUIRE(status("GET / HTTP/1.1\r\nContent-Length: 1\r\n"
+                   "Content-Length: 2\r\n\r\n") == 400);
+    REQUIRE(status("GET / HTTP/1.1\r\nTransfer-Encoding: chunked\r\n\r\n") ==
+            501);
+}
+
+TEST_CASE("A Content-Length that would wrap around is too large") {
+    EventLoop loop{2};
+    loop.Start();
+
+    FileCache files{"."};
+    auto [server, client] = MakePair(loop);
+    REQUIRE(WriteBlocking(client.AsRawFd(),
+                          "POST / HTTP/1.1\r\n"
+                          "Content-Length: 18446744073709551615\r\n\r\n"
+                          "GET / HTTP/1.1\r\n\r\n"));
+    RunOnLoop(loop, ConnectionServe{std::move(server), &files});
+
+    // Answered and closed, the rest is not taken for another request
+    std::string response;
+    char buf[1024];
+    while (auto n = read(client.AsRawFd(), buf, sizeof(buf))) {
+        REQUIRE(n > 0);
+        response.append(buf, n);
+    }
+    REQUIRE(response.starts_with("HTTP/1.1 413 "));
+    REQUIRE(response.find("HTTP/1.1", 1) == std::string::npos);
+
+    loop.Stop();
+}
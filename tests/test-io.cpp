@@ -0,0 +1,457 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/event-loop/owned-fd.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/io/buf-reader.hpp>
+#include <proto-coro/io/buf-writer.hpp>
+#include <proto-coro/io/find.hpp>
+#include <proto-coro/io/io.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "run-on-loop.hpp"
+#include "socket-pair.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <memory_resource>
+#include <random>
+#include <string>
+#include <string_view>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+#include <utility>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// A nonblocking end for the loop and a blocking one for a plain thread
+std::string ReadToEnd(int fd) {
+    std::string data;
+    char buf[4096];
+    while (true) {
+        auto n = read(fd, buf, sizeof(buf));
+        if (n <= 0) {
+            return data;
+        }
+        data.append(buf, n);
+    }
+}
+
+std::string Pattern(size_t size) {
+    std::string data(size, 0);
+    for (size_t i = 0; i < size; ++i) {
+        data[i] = static_cast<char>('a' + i * 7 % 26);
+    }
+    return data;
+}
+
+// Reads lines until the end of the stream
+struct ReadLines : Pc {
+    explicit ReadLines(BufReader& reader) : reader_(reader) {
+    }
+
+    PROTO_CORO(std::vector<std::string>) {
+        PC_BEGIN;
+
+        while (true) {
+            line_.clear();
+            {
+                CALL(auto n, reader_.ReadUntil("\r\n", line_, 64));
+                if (!n.has_value() || *n == 0) {
+                    return std::move(lines_);
+                }
+            }
+            lines_.emplace_back(line_);
+        }
+
+        PC_END;
+    }
+
+  private:
+    BufReader& reader_;
+    std::pmr::string line_;
+    std::vector<std::string> lines_;
+    CALLS(BufReader::ReadUntilOp);
+};
+
+// Peeks at a header and consumes it, twice
+struct PeekHeaders : Pc {
+    explicit PeekHeaders(BufReader& reader) : reader_(reader) {
+    }
+
+    PROTO_CORO(std::vector<std::string>) {
+        PC_BEGIN;
+
+        for (i_ = 0; i_ < 2; ++i_) {
+            CALL(auto header, reader_.PeekUntil("\r\n\r\n"));
+            if (!header.has_value()) {
+                return std::move(headers_);
+            }
+            headers_.emplace_back(*header);
+            reader_.Consume(header->size());
+        }
+        return std::move(headers_);
+
+        PC_END;
+    }
+
+  private:
+    BufReader& reader_;
+    std::vector<std::string> headers_;
+    int i_ = 0;
+    CALLS(BufReader::PeekUntilOp);
+};
+
+// A header, then a body that is too large for the buffer
+struct ReadMessage : Pc {
+    ReadMessage(const RegisteredFd& fd, size_t body_size)
+        : reader_(fd, 16), body_(body_size, 0) {
+    }
+
+    PROTO_CORO(std::string) {
+        PC_BEGIN;
+
+        {
+            CALL(auto n, reader_.ReadExact(std::span{head_}));
+            if (n != sizeof(head_)) {
+                return std::string{};
+            }
+        }
+        {
+            CALL(auto n, reader_.ReadExact(body_));
+            if (n != body_.size()) {
+                return std::string{};
+            }
+        }
+        return std::string(head_, sizeof(head_)) +
+               std::string(body_.begin(), body_.end());
+
+        PC_END;
+    }
+
+  private:
+    BufReader reader_;
+    char head_[5];
+    std::vector<char> body_;
+    CALLS(BufReader::ReadExactOp);
+};
+
+// Mixes small writes, a large one and a gathered one
+struct WriteMessage : Pc {
+    WriteMessage(const RegisteredFd& fd, std::string body)
+        : writer_(fd, 64), body_(std::move(body)) {
+    }
+
+    PROTO_CORO(IoResult) {
+        PC_BEGIN;
+
+        for (i_ = 0; i_ < 3; ++i_) {
+            CALL(auto n, writer_.WriteAll(std::string_view{"head;"}));
+            if (!n.has_value()) {
+                return n;
+            }
+        }
+        {
+            CALL(auto n, writer_.WriteAll(body_));
+            if (!n.has_value()) {
+                return n;
+            }
+        }
+        iov_[0] = {const_cast<char*>("gathered"), 8};
+        iov_[1] = {body_.data(), 100};
+        while (iov_[0].iov_len + iov_[1].iov_len > 0) {
+            CALL(auto n, writer_.WriteV(iov_));
+            if (!n.has_value()) {
+                return n;
+            }
+            for (auto& vec : iov_) {
+                auto taken = std::min(*n, vec.iov_len);
+                vec.iov_base = static_cast<char*>(vec.iov_base) + taken;
+                vec.iov_len -= taken;
+                *n -= taken;
+            }
+        }
+        {
+            CALL(auto n, writer_.Flush());
+            return n;
+        }
+
+        PC_END;
+    }
+
+  private:
+    BufWriter writer_;
+    std::string body_;
+    iovec iov_[2];
+    int i_ = 0;
+    CALLS(BufWriter::WriteAllOp, BufWriter::WriteVOp, BufWriter::FlushOp);
+};
+
+}  // namespace
+
+TEST_CASE("Unbuffered reads and writes wait for the fd") {
+    EventLoop loop{2};
+    loop.Start();
+    auto [fd, peer] = MakePair(loop);
+
+    std::thread writer{[&peer] {
+        std::this_thread::sleep_for(10ms);
+        WriteBlocking(peer.AsRawFd(), "hello");
+    }};
+    char buf[5];
+    REQUIRE(RunOnLoop(loop, ReadExact(fd, buf)) == 5);
+    REQUIRE(std::string_view{buf, 5} == "hello");
+    writer.join();
+
+    auto data = Pattern(1 << 20);
+    std::thread reader{[&peer, &data] {
+        // Only drains once the socket buffer is surely full
+        std::this_thread::sleep_for(10ms);
+        char buf[4096];
+        for (size_t left = data.size(); left > 0;) {
+            auto n = read(peer.AsRawFd(), buf, sizeof(buf));
+            if (n <= 0) {
+                return;
+            }
+            left -= n;
+        }
+    }};
+    REQUIRE(RunOnLoop(loop, WriteAll(fd, data)) == data.size());
+    reader.join();
+
+    loop.Stop();
+}
+
+TEST_CASE("ReadUntil finds delimiters split between reads") {
+    EventLoop loop{2};
+    loop.Start();
+    auto [fd, peer] = MakePair(loop);
+
+    std::thread writer{[&peer] {
+        for (auto part : {"fir", "st\r", "\nsecond\r\nthird li", "ne\r",
+                          "\n\r\n", "tail"}) {
+            WriteBlocking(peer.AsRawFd(), part);
+            std::this_thread::sleep_for(2ms);
+        }
+        peer.Reset();
+    }};
+    // Smaller than most of the lines, so they are gathered over many fills
+    BufReader reader{fd, 4};
+    auto lines = RunOnLoop(loop, ReadLines{reader});
+    writer.join();
+
+    REQUIRE(lines == std::vector<std::string>{"first\r\n", "second\r\n",
+                                              "third line\r\n", "\r\n",
+                                              "tail"});
+
+    loop.Stop();
+}
+
+TEST_CASE("FindBytes agrees with string_view::find") {
+    std::mt19937 gen{42};
+    // Few distinct bytes, so that partial matches are common
+    std::uniform_int_distribution<int> byte{'a', 'd'};
+
+    for (int round = 0; round < 2000; ++round) {
+        std::string haystack(gen() % 200, 0);
+        for (auto& c : haystack) {
+            c = static_cast<char>(byte(gen));
+        }
+        std::string needle(1 + gen() % 5, 0);
+        for (auto& c : needle) {
+            c = static_cast<char>(byte(gen));
+        }
+        REQUIRE(FindBytes(haystack, needle) ==
+                std::string_view{haystack}.find(needle));
+    }
+
+    std::string header(1000, 'x');
+    REQUIRE(FindBytes(header, "\r\n\r\n") == std::string_view::npos);
+    header.replace(997, 3, "\r\n\r");
+    REQUIRE(FindBytes(header, "\r\n\r\n") == std::string_view::npos);
+    header += "\n";
+    REQUIRE(FindBytes(header, "\r\n\r\n") == 997);
+    REQUIRE(FindBytes(header, "") == 0);
+}
+
+TEST_CASE("PeekUntil leaves the header in the buffer") {
+    EventLoop loop{2};
+    loop.Start();
+    auto [fd, peer] = MakePair(loop);
+
+    std::thread writer{[&peer] {
+        for (auto part : {"GET / HTTP/1.1\r\nHost: a\r", "\n\r",
+                          "\nGET /b HTTP/1.1\r\n\r\nrest"}) {
+            WriteBlocking(peer.AsRawFd(), part);
+            std::this_thread::sleep_for(2ms);
+        }
+    }};
+    BufReader reader{fd, 64};
+    auto headers = RunOnLoop(loop, PeekHeaders{reader});
+    writer.join();
+
+    REQUIRE(headers ==
+            std::vector<std::string>{"GET / HTTP/1.1\r\nHost: a\r\n\r\n",
+                                     "GET /b HTTP/1.1\r\n\r\n"});
+    REQUIRE(std::string_view{reader.Buffered().data(),
+                             reader.Buffered().size()} == "rest");
+
+    WriteBlocking(peer.AsRawFd(), "123456");
+    auto body = RunOnLoop(loop, reader.Peek(8));
+    REQUIRE(body == "rest1234");
+    REQUIRE(reader.Buffered().size() == 10);
+    reader.Consume(10);
+
+    // One that can't fit
+    WriteBlocking(peer.AsRawFd(), std::string(100, 'x'));
+    auto res = RunOnLoop(loop, reader.PeekUntil("\r\n\r\n"));
+    REQUIRE(!res.has_value());
+    REQUIRE(res.error() == EMSGSIZE);
+
+    loop.Stop();
+}
+
+TEST_CASE("ReadUntil gives up after the limit") {
+    EventLoop loop{1};
+    loop.Start();
+    auto [fd, peer] = MakePair(loop);
+
+    WriteBlocking(peer.AsRawFd(), std::string(1000, 'x'));
+    BufReader reader{fd, 16};
+    std::pmr::string line;
+    auto res = RunOnLoop(loop, reader.ReadUntil("\n", line, 100));
+    REQUIRE(!res.has_value());
+    REQUIRE(res.error() == EMSGSIZE);
+
+    loop.Stop();
+}
+
+TEST_CASE("Large reads skip the buffer") {
+    EventLoop loop{2};
+    loop.Start();
+    auto [fd, peer] = MakePair(loop);
+
+    auto data = Pattern(300'000);
+    std::thread writer{[&peer, &data] {
+        WriteBlocking(peer.AsRawFd(), data);
+    }};
+    REQUIRE(RunOnLoop(loop, ReadMessage{fd, data.size() - 5}) == data);
+    writer.join();
+
+    loop.Stop();
+}
+
+TEST_CASE("Buffered writes keep their order") {
+    EventLoop loop{2};
+    loop.Start();
+    auto [fd, peer] = MakePair(loop);
+
+    auto body = Pattern(200'000);
+    std::string received;
+    std::thread reader{[&peer, &received] {
+        received = ReadToEnd(peer.AsRawFd());
+    }};
+    auto res = RunOnLoop(loop, WriteMessage{fd, body});
+    fd.Reset();
+    reader.join();
+
+    REQUIRE(res.has_value());
+    REQUIRE(received == "head;head;head;" + body + "gathered" +
+                            body.substr(0, 100));
+
+    loop.Stop();
+}
+
+TEST_CASE("WriteAllV resumes partial writes") {
+    EventLoop loop{2};
+    loop.Start();
+    auto [fd, peer] = MakePair(loop);
+
+    // More iovecs than a single writev takes, and more bytes than the
+    // socket buffer
+    auto body = Pattern(500'000);
+    std::vector<std::string> chunks;
+    std::vector<iovec> iov;
+    std::string expected;
+    for (int i = 0; i < 3000; ++i) {
+        chunks.push_back(std::to_string(i) + ";");
+    }
+    for (auto& chunk : chunks) {
+        iov.push_back({chunk.data(), chunk.size()});
+        expected += chunk;
+    }
+    iov.push_back({body.data(), body.size()});
+    expected += body;
+
+    std::string received;
+    std::thread reader{[&peer, &received] {
+        received = ReadToEnd(peer.AsRawFd());
+    }};
+    auto res = RunOnLoop(loop, WriteAllV(fd, iov));
+    fd.Reset();
+    reader.join();
+
+    REQUIRE(res == expected.size());
+    REQUIRE(received == expected);
+
+    loop.Stop();
+}
+
+TEST_CASE("SendFileAll sends a range of a file") {
+    EventLoop loop{2};
+    loop.Start();
+    auto [fd, peer] = MakePair(loop);
+
+    char path[] = "/tmp/proto-coro-sendfile-XXXXXX";
+    auto file = OwnedFd::FromRaw(mkstemp(path));
+    REQUIRE(file.IsValid());
+    unlink(path);
+    auto data = Pattern(1 << 20);
+    WriteBlocking(file.AsRawFd(), data);
+
+    std::string received;
+    std::thread reader{[&peer, &received] {
+        received = ReadToEnd(peer.AsRawFd());
+    }};
+    auto sent = RunOnLoop(loop, SendFileAll(fd, file.AsRawFd(), 10,
+                                            data.size() - 20));
+    // Past the end of the file
+    auto rest = RunOnLoop(loop, SendFileAll(fd, file.AsRawFd(),
+                                            data.size() - 10, 100));
+    fd.Reset();
+    reader.join();
+
+    REQUIRE(sent == data.size() - 20);
+    REQUIRE(rest == 10);
+    REQUIRE(received == data.substr(10, data.size() - 20) +
+                            data.substr(data.size() - 10));
+
+    loop.Stop();
+}
+
+TEST_CASE("I/O errors are returned rather than fatal") {
+    // As any server on top of this would
+    std::signal(SIGPIPE, SIG_IGN);
+
+    EventLoop loop{1};
+    loop.Start();
+    auto [fd, peer] = MakePair(loop);
+    peer.Reset();
+
+    BufWriter writer{fd, 16};
+    auto res = RunOnLoop(loop, writer.WriteAll(std::string_view{"hello"}));
+    REQUIRE(res == 5);
+    res = RunOnLoop(loop, writer.Flush());
+    REQUIRE(!res.has_value());
+    REQUIRE(res.error() == EPIPE);
+
+    char buf[4];
+    REQUIRE(RunOnLoop(loop, ReadExact(fd, buf)) == 0);
+
+    loop.Stop();
+}
@@ -0,0 +1,77 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/event-loop/owned-fd.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/io/buf-reader.hpp>
+#include <proto-coro/io/mirrored-ring.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "run-on-loop.hpp"
+#include "socket-pair.hpp"
+
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <utility>
+
+TEST_CASE("MirroredRing maps its pages twice") {
+    auto ring = MirroredRing::Create(100);
+    REQUIRE(ring.has_value());
+    size_t size = ring->Size();
+    REQUIRE(size >= 100);
+    REQUIRE(size % sysconf(_SC_PAGESIZE) == 0);
+
+    char* data = ring->Data();
+    std::memcpy(data + size - 3, "wrapped", 7);
+    REQUIRE(std::string_view{data, 4} == "pped");
+    REQUIRE(std::string_view{data + size - 3, 7} == "wrapped");
+
+    auto moved = std::move(*ring);
+    REQUIRE_FALSE(ring->IsValid());
+    REQUIRE(moved.Data() == data);
+}
+
+TEST_CASE("BufReader over a MirroredRing keeps messages in place") {
+    EventLoop loop{1};
+    loop.Start();
+    auto [fd, peer] = MakePair(loop);
+    auto ring = MirroredRing::Create(4096);
+    REQUIRE(ring.has_value());
+    size_t size = ring->Size();
+
+    {
+        BufReader reader{fd, std::move(*ring)};
+        REQUIRE(reader.Capacity() == size);
+
+        std::string first(size - 1000, 'a');
+        first.push_back('\n');
+        std::string second(500, 'b');
+        REQUIRE(WriteBlocking(peer.AsRawFd(), first + second));
+
+        auto line = RunOnLoop(loop, reader.PeekUntil("\n"));
+        REQUIRE(line == first);
+        reader.Consume(line->size());
+        const char* rest = reader.Buffered().data();
+
+        // The second line runs past the end of the ring, and still reads
+        // as one piece, right where it began
+        second += std::string(1000, 'c') + "\n";
+        REQUIRE(WriteBlocking(peer.AsRawFd(), std::string(1000, 'c') + "\n"));
+        line = RunOnLoop(loop, reader.PeekUntil("\n"));
+        REQUIRE(line == second);
+        REQUIRE(line->data() == rest);
+        reader.Consume(line->size());
+
+        // A message as large as the ring
+        std::string full(size, 'd');
+        full.back() = '\n';
+        REQUIRE(WriteBlocking(peer.AsRawFd(), full));
+        line = RunOnLoop(loop, reader.PeekUntil("\n"));
+        REQUIRE(line == full);
+    }
+
+    loop.Stop();
+}
@@ -0,0 +1,228 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/pc.hpp>
+#include <proto-coro/sync/mutex.hpp>
+#include <proto-coro/sync/rw-lock.hpp>
+#include <proto-coro/sync/semaphore.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "run-on-loop.hpp"
+
+#include <atomic>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Increments a plain counter, yielding in the middle of the critical section
+struct Increment : Pc {
+    Increment(Mutex& mutex, int& counter, int times)
+        : mutex_(mutex), counter_(counter), times_(times) {
+    }
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        for (i_ = 0; i_ < times_; ++i_) {
+            CALL_DISCARD(mutex_.Lock());
+            value_ = counter_;
+            YIELD;
+            counter_ = value_ + 1;
+            mutex_.Unlock();
+        }
+        return Unit{};
+
+        PC_END;
+    }
+
+  private:
+    Mutex& mutex_;
+    int& counter_;
+    int times_;
+    int i_ = 0;
+    int value_ = 0;
+    CALLS(Mutex::LockOp);
+};
+
+struct InFlight {
+    std::atomic<int> now = 0;
+    std::atomic<int> max = 0;
+    std::atomic<bool> overlapped = false;
+
+    void Enter() {
+        int value = ++now;
+        int seen = max.load();
+        while (seen < value && !max.compare_exchange_weak(seen, value)) {
+        }
+    }
+
+    void Leave() {
+        --now;
+    }
+};
+
+struct Throttled : Pc {
+    Throttled(Semaphore& semaphore, InFlight& in_flight)
+        : semaphore_(semaphore), in_flight_(in_flight) {
+    }
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        CALL_DISCARD(semaphore_.Acquire());
+        in_flight_.Enter();
+        SLEEP_FOR(1ms);
+        in_flight_.Leave();
+        semaphore_.Release();
+        return Unit{};
+
+        PC_END;
+    }
+
+  private:
+    Semaphore& semaphore_;
+    InFlight& in_flight_;
+    CALLS(Semaphore::AcquireOp);
+};
+
+struct Reader : Pc {
+    Reader(RwLock& lock, InFlight& readers, InFlight& writers)
+        : lock_(lock), readers_(readers), writers_(writers) {
+    }
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        for (i_ = 0; i_ < 100; ++i_) {
+            CALL_DISCARD(lock_.LockShared());
+            readers_.Enter();
+            readers_.overlapped = readers_.overlapped || writers_.now != 0;
+            YIELD;
+            readers_.Leave();
+            lock_.UnlockShared();
+        }
+        return Unit{};
+
+        PC_END;
+    }
+
+  private:
+    RwLock& lock_;
+    InFlight& readers_;
+    InFlight& writers_;
+    int i_ = 0;
+    CALLS(RwLock::ReadLockOp);
+};
+
+struct Writer : Pc {
+    Writer(RwLock& lock, InFlight& readers, InFlight& writers)
+        : lock_(lock), readers_(readers), writers_(writers) {
+    }
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        for (i_ = 0; i_ < 100; ++i_) {
+            CALL_DISCARD(lock_.Lock());
+            writers_.Enter();
+            writers_.overlapped = writers_.overlapped || readers_.now != 0;
+            YIELD;
+            writers_.Leave();
+            lock_.Unlock();
+        }
+        return Unit{};
+
+        PC_END;
+    }
+
+  private:
+    RwLock& lock_;
+    InFlight& readers_;
+    InFlight& writers_;
+    int i_ = 0;
+    CALLS(RwLock::WriteLockOp);
+};
+
+}  // namespace
+
+TEST_CASE("Mutex serializes routines across workers") {
+    constexpr int kRoutines = 8;
+    constexpr int kTimes = 1'000;
+
+    EventLoop loop{4};
+    loop.Start();
+
+    Mutex mutex;
+    int counter = 0;
+    RunOnLoop(loop, WhenAll(std::vector<Increment>(
+                        kRoutines, Increment{mutex, counter, kTimes})));
+
+    REQUIRE(counter == kRoutines * kTimes);
+
+    loop.Stop();
+}
+
+TEST_CASE("Semaphore caps the number of routines inside") {
+    constexpr int kPermits = 3;
+
+    EventLoop loop{4};
+    loop.Start();
+
+    Semaphore semaphore{kPermits};
+    InFlight in_flight;
+    RunOnLoop(loop, WhenAll(std::vector<Throttled>(
+                        32, Throttled{semaphore, in_flight})));
+
+    REQUIRE(in_flight.max <= kPermits);
+    REQUIRE(in_flight.max > 1);
+    for (int i = 0; i < kPermits; ++i) {
+        REQUIRE(semaphore.TryAcquire());
+    }
+    REQUIRE(!semaphore.TryAcquire());
+
+    loop.Stop();
+}
+
+TEST_CASE("RwLock lets readers in together and writers alone") {
+    EventLoop loop{4};
+    loop.Start();
+
+    RwLock lock;
+    InFlight readers;
+    InFlight writers;
+    RunOnLoop(loop,
+              WhenAll(WhenAll(std::vector<Reader>(
+                          6, Reader{lock, readers, writers})),
+                      WhenAll(std::vector<Writer>(
+                          2, Writer{lock, readers, writers}))));
+
+    REQUIRE(writers.max == 1);
+    REQUIRE(!readers.overlapped);
+    REQUIRE(!writers.overlapped);
+    REQUIRE(lock.TryLock());
+    REQUIRE(!lock.TryLockShared());
+    lock.Unlock();
+    REQUIRE(lock.TryLockShared());
+    REQUIRE(lock.TryLockShared());
+    REQUIRE(!lock.TryLock());
+
+    loop.Stop();
+}
+
+TEST_CASE("A routine that gives up waiting for a mutex leaves the queue") {
+    EventLoop loop{2};
+    loop.Start();
+
+    Mutex mutex;
+    REQUIRE(mutex.TryLock());
+    REQUIRE(RunOnLoop(loop, Timeout(mutex.Lock(), 10ms)) == std::nullopt);
+
+    // Would hand the mutex over to the routine that is gone
+    mutex.Unlock();
+    REQUIRE(mutex.TryLock());
+    mutex.Unlock();
+
+    loop.Stop();
+}
@@ -0,0 +1,332 @@
+#include <proto-coro/arena.hpp>
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/http/file-cache.hpp>
+#include <proto-coro/pc.hpp>
+#include <proto-coro/sync/latch.hpp>
+#include <proto-coro/thread/event.hpp>
+
+#include <falter/interface.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "http_connection.hpp"
+#include "run-on-loop.hpp"
+#include "socket-pair.hpp"
+
+#include <cstdlib>
+#include <fcntl.h>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// For checks on worker threads, where Catch cannot be used, and in regions
+// where it could allocate
+void Expect(bool condition) {
+    if (!condition) {
+        std::abort();
+    }
+}
+
+void WriteAll(RawFd fd, std::string_view data) {
+    Expect(write(fd, data.data(), data.size()) ==
+           static_cast<ssize_t>(data.size()));
+}
+
+struct YieldMany : Pc {
+    explicit YieldMany(int times) : times_(times) {
+    }
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        for (i_ = 0; i_ < times_; ++i_) {
+            YIELD;
+        }
+        return Unit{};
+
+        PC_END;
+    }
+
+  private:
+    int times_;
+    int i_ = 0;
+};
+
+// Passes a byte back and forth over a pair of pipes
+struct PingPong : Pc {
+    PingPong(RawFd in, RawFd out, int rounds, bool serve)
+        : in_(in), out_(out), rounds_(rounds), serve_(serve) {
+    }
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        for (i_ = 0; i_ < rounds_; ++i_) {
+            if (serve_) {
+                WriteAll(out_, "x");
+            }
+            while (true) {
+                {
+                    char c;
+                    if (read(in_, &c, 1) == 1) {
+                        break;
+                    }
+                }
+                WAIT_READY(in_, InterestKind::Readable);
+            }
+            if (!serve_) {
+                WriteAll(out_, "x");
+            }
+        }
+        return Unit{};
+
+        PC_END;
+    }
+
+  private:
+    RawFd in_;
+    RawFd out_;
+    int rounds_;
+    bool serve_;
+    int i_ = 0;
+};
+
+// Answers a request with its own length, the way the HTTP example serves one
+struct ServeRequest : Pc {
+    ServeRequest(RegisteredFd fd, Latch& done)
+        : fd_(std::move(fd)), done_(done) {
+    }
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        request_.emplace(ARENA);
+        while (!request_->ends_with("\r\n\r\n")) {
+            {
+                char buf[256];
+                auto n = read(fd_.AsRawFd(), buf, sizeof(buf));
+                if (n > 0) {
+                    request_->append(buf, n);
+                    continue;
+                }
+            }
+            WAIT_READY(fd_.AsRawFd(), InterestKind::Readable);
+        }
+
+        response_.emplace(ARENA);
+        response_->append("HTTP/1.1 200 OK\r\nContent-Length: ")
+            .append(std::to_string(request_->size()))
+            .append("\r\n\r\n")
+            .append(*request_);
+        WriteAll(fd_.AsRawFd(), *response_);
+
+        done_.CountDown();
+        return Unit{};
+
+        PC_END;
+    }
+
+  private:
+    RegisteredFd fd_;
+    Latch& done_;
+    std::optional<std::pmr::string> request_;
+    std::optional<std::pmr::string> response_;
+};
+
+// Serves requests that are in flight at the same time, one per connection
+void ServeConcurrently(EventLoop& loop, int requests) {
+    constexpr std::string_view kRequest = "GET / HTTP/1.1\r\n\r\n";
+
+    Latch done{static_cast<size_t>(requests)};
+    std::optional<OwnedFd> clients[4];
+    Expect(requests <= 4);
+    for (int i = 0; i < requests; ++i) {
+        int fds[2];
+        Expect(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+        Expect(fcntl(fds[0], F_SETFL, O_NONBLOCK) == 0);
+        clients[i].emplace(OwnedFd::FromRaw(fds[1]));
+
+        RegisteredFd server{OwnedFd::FromRaw(fds[0]), &loop};
+        loop.Submit(new PooledCoro{Timeout(
+            WithArena{ServeRequest{std::move(server), done}}, 1s)});
+        WriteAll(fds[1], kRequest);
+    }
+    done.BlockingWait();
+
+    for (int i = 0; i < requests; ++i) {
+        char buf[256];
+        Expect(read(clients[i]->AsRawFd(), buf, sizeof(buf)) > 0);
+    }
+}
+
+// Sends the same requests, pipelined, and reads back one page for each
+void ExchangePipelined(RawFd fd, std::string_view requests, int count) {
+    constexpr std::string_view kPageEnd = "</html>\n";
+
+    Expect(WriteBlocking(fd, requests));
+    char buf[4096];
+    size_t size = 0;
+    for (int pages = 0; pages < count;) {
+        auto n = read(fd, buf + size, sizeof(buf) - size);
+        Expect(n > 0);
+        size += n;
+        while (true) {
+            std::string_view seen{buf, size};
+            auto end = seen.find(kPageEnd);
+            if (end == std::string_view::npos) {
+                break;
+            }
+            end += kPageEnd.size();
+            std::copy(buf + end, buf + size, buf);
+            size -= end;
+            ++pages;
+        }
+    }
+    Expect(size == 0);
+}
+
+}  // namespace
+
+TEST_CASE("AllocationRegion counts the allocations of the thread") {
+    if (!AllocationsTracked()) {
+        return;
+    }
+
+    AllocationRegion region{AllocationRegion::Scope::Thread};
+    auto value = std::make_unique<int>(42);
+    REQUIRE(region.Allocations() == 1);
+    REQUIRE(region.Bytes() == sizeof(int));
+}
+
+TEST_CASE("Submit and Step do not allocate once warm") {
+    if (!AllocationsTracked()) {
+        return;
+    }
+
+    EventLoop loop{2};
+    loop.Start();
+
+    RunOnLoop(loop, YieldMany{1'000});
+    {
+        AllocationRegion region;
+        RunOnLoop(loop, YieldMany{10'000});
+        REQUIRE(region.Allocations() == 0);
+    }
+
+    loop.Stop();
+}
+
+TEST_CASE("Waiting for an fd does not allocate once warm") {
+    if (!AllocationsTracked()) {
+        return;
+    }
+
+    EventLoop loop{2};
+    loop.Start();
+
+    int ping[2];
+    int pong[2];
+    REQUIRE(pipe2(ping, O_NONBLOCK | O_CLOEXEC) == 0);
+    REQUIRE(pipe2(pong, O_NONBLOCK | O_CLOEXEC) == 0);
+    RegisteredFd ping_in{OwnedFd::FromRaw(ping[0]), &loop};
+    OwnedFd ping_out = OwnedFd::FromRaw(ping[1]);
+    RegisteredFd pong_in{OwnedFd::FromRaw(pong[0]), &loop};
+    OwnedFd pong_out = OwnedFd::FromRaw(pong[1]);
+
+    auto play = [&](int rounds) {
+        RunOnLoop(loop, WhenAll(PingPong{pong_in.AsRawFd(),
+                                         ping_out.AsRawFd(), rounds, true},
+                                PingPong{ping_in.AsRawFd(),
+                                         pong_out.AsRawFd(), rounds, false}));
+    };
+
+    play(100);
+    {
+        AllocationRegion region;
+        play(1'000);
+        REQUIRE(region.Allocations() == 0);
+    }
+
+    loop.Stop();
+}
+
+TEST_CASE("Serving a request does not allocate once warm") {
+    if (!AllocationsTracked()) {
+        return;
+    }
+
+    // A single worker, so that its object pool is the one warmed up
+    EventLoop loop{1};
+    loop.Start();
+
+    for (int i = 0; i < 10; ++i) {
+        ServeConcurrently(loop, 4);
+    }
+    // The timeouts of one round may still be pending when the next one
+    // starts, so the pool of timer nodes needs some slack
+    RunOnLoop(loop, WhenAll(std::vector<Sleep>(32, Sleep{1ms})));
+    {
+        AllocationRegion region;
+        for (int i = 0; i < 100; ++i) {
+            ServeConcurrently(loop, 1 + i % 4);
+        }
+        REQUIRE(region.Allocations() == 0);
+    }
+
+    loop.Stop();
+}
+
+TEST_CASE("Serving a connection does not allocate once warm") {
+    if (!AllocationsTracked()) {
+        return;
+    }
+
+    constexpr std::string_view kRequests =
+        "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n"
+        "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n"
+        "GET / HTTP/1.1\r\nHost: localhost\r\n\r\n";
+
+    EventLoop loop{1};
+    loop.Start();
+
+    FileCache files{"."};
+    auto [server, client] = MakePair(loop);
+    ThreadOneshotEvent done;
+    // The arena of the connection is small, so that whatever it keeps
+    // taking per request soon spills to the heap
+    auto routine = Spawn{
+        WithArena<ConnectionServe, 1024>{ConnectionServe{std::move(server),
+                                                         &files}} |
+        FMap{[&done](Unit) {
+            done.Fire();
+            return Unit{};
+        }}};
+    loop.Submit(&routine);
+
+    for (int i = 0; i < 10; ++i) {
+        ExchangePipelined(client.AsRawFd(), kRequests, 3);
+    }
+    {
+        AllocationRegion region;
+        for (int i = 0; i < 1'000; ++i) {
+            ExchangePipelined(client.AsRawFd(), kRequests, 3);
+        }
+        REQUIRE(region.Allocations() == 0);
+    }
+
+    client = OwnedFd{};
+    done.Wait();
+
+    loop.Stop();
+}
@@ -0,0 +1,130 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/pc.hpp>
+#include <proto-coro/sync/latch.hpp>
+#include <proto-coro/thread/object-pool.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include <algorithm>
+#include <array>
+#include <thread>
+#include <vector>
+
+namespace {
+
+template <int Tag>
+struct Payload {
+    std::array<char, 100> data;
+};
+
+struct CountDown : Pc {
+    explicit CountDown(Latch& latch) : latch_(latch) {
+    }
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        YIELD;
+        latch_.CountDown();
+        return Unit{};
+
+        PC_END;
+    }
+
+  private:
+    Latch& latch_;
+};
+
+}  // namespace
+
+TEST_CASE("ObjectPool reuses blocks freed on the same thread") {
+    using Pool = ObjectPool<Payload<0>>;
+
+    void* first = Pool::Allocate();
+    Pool::Free(first);
+    REQUIRE(Pool::Cached() == 1);
+
+    void* second = Pool::Allocate();
+    REQUIRE(second == first);
+    REQUIRE(Pool::Cached() == 0);
+    Pool::Free(second);
+}
+
+TEST_CASE("ObjectPool takes back blocks freed on other threads") {
+    using Pool = ObjectPool<Payload<1>>;
+
+    std::vector<void*> blocks;
+    for (int i = 0; i < 8; ++i) {
+        blocks.push_back(Pool::Allocate());
+    }
+    std::thread{[&] {
+        for (auto* block : blocks) {
+            Pool::Free(block);
+        }
+    }}.join();
+
+    REQUIRE(Pool::Cached() == 0);
+    void* reused = Pool::Allocate();
+    REQUIRE(std::find(blocks.begin(), blocks.end(), reused) != blocks.end());
+    REQUIRE(Pool::Cached() == blocks.size() - 1);
+    Pool::Free(reused);
+}
+
+TEST_CASE("ObjectPool keeps its cap after a burst of remote frees") {
+    using Pool = ObjectPool<Payload<3>>;
+
+    std::vector<void*> blocks;
+    for (size_t i = 0; i < Pool::kMaxCached + 100; ++i) {
+        blocks.push_back(Pool::Allocate());
+    }
+    std::thread{[&] {
+        for (auto* block : blocks) {
+            Pool::Free(block);
+        }
+    }}.join();
+
+    // Takes over no more than the cap, the rest goes back to the heap
+    void* reused = Pool::Allocate();
+    REQUIRE(Pool::Cached() == Pool::kMaxCached - 1);
+
+    // And so do local frees past it
+    blocks.clear();
+    blocks.push_back(reused);
+    for (size_t i = 0; i < Pool::kMaxCached + 100; ++i) {
+        blocks.push_back(Pool::Allocate());
+    }
+    for (auto* block : blocks) {
+        Pool::Free(block);
+    }
+    REQUIRE(Pool::Cached() == Pool::kMaxCached);
+}
+
+TEST_CASE("ObjectPool blocks outlive the thread that allocated them") {
+    using Pool = ObjectPool<Payload<2>>;
+
+    void* block = nullptr;
+    std::thread{[&] {
+        block = Pool::Allocate();
+        Pool::Free(Pool::Allocate());
+    }}.join();
+
+    // Goes back to the heap, since there is no one to take it
+    Pool::Free(block);
+    REQUIRE(Pool::Cached() == 0);
+}
+
+TEST_CASE("PooledCoro deletes itself once completed") {
+    constexpr int kRoutines = 64;
+
+    EventLoop loop{4};
+    loop.Start();
+
+    Latch latch{kRoutines};
+    for (int i = 0; i < kRoutines; ++i) {
+        loop.Submit(new PooledCoro{CountDown{latch}});
+    }
+    latch.BlockingWait();
+
+    loop.Stop();
+}
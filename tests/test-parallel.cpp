@@ -0,0 +1,200 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/parallel.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "run-on-loop.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using SumOp = decltype(ParallelReduce(0, 0, 1, uint64_t{0},
+                                      std::function<uint64_t(size_t)>{},
+                                      std::plus<>{}));
+
+// CPU-heavy work done from inside a routine
+struct SumOfSquares : Pc {
+    explicit SumOfSquares(size_t n) : n_(n) {
+    }
+
+    PROTO_CORO(uint64_t) {
+        PC_BEGIN;
+
+        {
+            CALL(auto sum, ParallelReduce(
+                               0, n_, 1'000, uint64_t{0},
+                               std::function<uint64_t(size_t)>{[](size_t i) {
+                                   return uint64_t{i} * i;
+                               }},
+                               std::plus<>{}));
+            return sum;
+        }
+
+        PC_END;
+    }
+
+  private:
+    size_t n_;
+    CALLS(SumOp);
+};
+
+uint64_t SquaresBelow(uint64_t n) {
+    return (n - 1) * n * (2 * n - 1) / 6;
+}
+
+// Counts the routines submitted through it
+struct CountingRuntime final : IRuntime {
+    explicit CountingRuntime(IRuntime* inner, size_t concurrency)
+        : inner_(inner), concurrency_(concurrency) {
+    }
+
+    void Submit(IRoutine* routine) override {
+        ++submitted;
+        inner_->Submit(routine);
+    }
+
+    void After(TimePoint when, IRoutine* routine) override {
+        inner_->After(when, routine);
+    }
+
+    void RegisterFd(RawFd fd) override {
+        inner_->RegisterFd(fd);
+    }
+
+    void DeregisterFd(RawFd fd) override {
+        inner_->DeregisterFd(fd);
+    }
+
+    void WhenReady(RawFd fd, InterestKind type, IRoutine* routine) override {
+        inner_->WhenReady(fd, type, routine);
+    }
+
+    bool CancelAfter(TimePoint when, IRoutine* routine) override {
+        return inner_->CancelAfter(when, routine);
+    }
+
+    bool CancelWhenReady(RawFd fd, IRoutine* routine) override {
+        return inner_->CancelWhenReady(fd, routine);
+    }
+
+    size_t Concurrency() const override {
+        return concurrency_;
+    }
+
+    std::atomic<size_t> submitted = 0;
+
+  private:
+    IRuntime* inner_;
+    size_t concurrency_;
+};
+
+}  // namespace
+
+TEST_CASE("BlockingParallelFor visits every index once") {
+    constexpr size_t kSize = 100'000;
+
+    EventLoop loop{4};
+    loop.Start();
+
+    std::vector<int> visits(kSize);
+    for (size_t grain : {size_t{1}, size_t{7}, size_t{1'000}, kSize * 2}) {
+        BlockingParallelFor(&loop, 0, kSize, grain, [&](size_t i) {
+            ++visits[i];
+        });
+    }
+    REQUIRE(visits == std::vector<int>(kSize, 4));
+
+    loop.Stop();
+}
+
+TEST_CASE("ParallelFor submits no more helpers than there are workers") {
+    EventLoop loop{2};
+    loop.Start();
+    REQUIRE(loop.Concurrency() == 2);
+
+    // The waiter may be submitted on top of the helpers
+    CountingRuntime rt{&loop, loop.Concurrency()};
+    BlockingParallelFor(&rt, 0, 10'000, 1, [](size_t) {
+    });
+    REQUIRE(rt.submitted <= 2);
+
+    // Unknown, so sized by the hardware
+    CountingRuntime unknown{&loop, 0};
+    BlockingParallelFor(&unknown, 0, 10'000, 1, [](size_t) {
+    });
+    REQUIRE(unknown.submitted >= std::thread::hardware_concurrency() - 1);
+
+    loop.Stop();
+}
+
+TEST_CASE("BlockingParallelReduce of an empty range is the identity") {
+    EventLoop loop{2};
+    loop.Start();
+
+    auto product = BlockingParallelReduce(
+        &loop, 5, 5, 1, 1,
+        [](size_t) {
+            return 0;
+        },
+        std::multiplies<>{});
+    REQUIRE(product == 1);
+
+    loop.Stop();
+}
+
+TEST_CASE("ParallelReduce runs from routines and helps out") {
+    EventLoop loop{4};
+    loop.Start();
+
+    REQUIRE(RunOnLoop(loop, SumOfSquares{1'000'000}) ==
+            SquaresBelow(1'000'000));
+
+    loop.Stop();
+}
+
+TEST_CASE("Routines doing ParallelReduce complete on a single worker") {
+    EventLoop loop{1};
+    loop.Start();
+
+    auto sums = RunOnLoop(
+        loop, WhenAll(std::vector<SumOfSquares>(8, SumOfSquares{100'000})));
+    REQUIRE(sums == std::vector<uint64_t>(8, SquaresBelow(100'000)));
+
+    loop.Stop();
+}
+
+TEST_CASE("A cancelled ParallelFor waits for its helpers") {
+    using namespace std::chrono_literals;
+
+    // A small budget, so that the caller stops helping early
+    EventLoop loop{4, 4};
+    loop.Start();
+
+    for (int i = 0; i < 20; ++i) {
+        std::atomic<size_t> visited = 0;
+        auto res = RunOnLoop(
+            loop, Timeout(ParallelFor(0, 2'000, 1,
+                                      [&visited](size_t) {
+                                          std::this_thread::sleep_for(50us);
+                                          ++visited;
+                                      }),
+                          2ms));
+        REQUIRE(!res.has_value());
+
+        // The helpers stopped claiming chunks and are all done by now
+        auto seen = visited.load();
+        REQUIRE(seen < 2'000);
+        std::this_thread::sleep_for(5ms);
+        REQUIRE(visited.load() == seen);
+    }
+
+    loop.Stop();
+}
@@ -0,0 +1,89 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/pc.hpp>
+#include <proto-coro/stream.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "run-on-loop.hpp"
+
+#include <string>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Emits [0, count), suspending after every burst items
+struct Numbers : Pc {
+    Numbers(int count, int burst) : count_(count), burst_(burst) {
+    }
+
+    PROTO_STREAM(int) {
+        PC_BEGIN;
+
+        for (i_ = 0; i_ < count_; ++i_) {
+            if (i_ > 0 && i_ % burst_ == 0) {
+                YIELD;
+            }
+            EMIT(i_);
+        }
+        STREAM_END;
+
+        PC_END;
+    }
+
+  private:
+    int count_;
+    int burst_;
+    int i_ = 0;
+};
+
+}  // namespace
+
+TEST_CASE("A stream is over once it says so") {
+    Numbers numbers{2, 10};
+    Context ctx{nullptr, nullptr};
+
+    REQUIRE(numbers.Next(&ctx) == StreamPoll<int>{0});
+    REQUIRE(numbers.Next(&ctx) == StreamPoll<int>{1});
+    for (int i = 0; i < 3; ++i) {
+        REQUIRE(numbers.Next(&ctx) == StreamPoll<int>{std::in_place});
+    }
+}
+
+TEST_CASE("Stream combinators compose lazily") {
+    EventLoop loop{2};
+    loop.Start();
+
+    auto odd_squares = Numbers{1'000, 7} | Filter{[](int x) {
+                           return x % 2 == 1;
+                       }} |
+                       Map{[](int x) {
+                           return std::to_string(x * x);
+                       }} |
+                       Take{4};
+    auto squares = RunOnLoop(loop, Collect(std::move(odd_squares)));
+    REQUIRE(squares == std::vector<std::string>{"1", "9", "25", "49"});
+
+    auto chunks = RunOnLoop(loop, Collect(Numbers{10, 3} | Chunks{4}));
+    REQUIRE(chunks == std::vector<std::vector<int>>{
+                          {0, 1, 2, 3}, {4, 5, 6, 7}, {8, 9}});
+
+    loop.Stop();
+}
+
+TEST_CASE("Batches hold what the stream produced without suspending") {
+    EventLoop loop{2};
+    loop.Start();
+
+    auto batches = RunOnLoop(loop, Collect(Numbers{10, 3} | Batch{2}));
+    REQUIRE(batches == std::vector<std::vector<int>>{
+                           {0, 1}, {2}, {3, 4}, {5}, {6, 7}, {8}, {9}});
+
+    auto whole = RunOnLoop(loop, Collect(Numbers{10, 4} | Batch{100}));
+    REQUIRE(whole == std::vector<std::vector<int>>{
+                         {0, 1, 2, 3}, {4, 5, 6, 7}, {8, 9}});
+
+    loop.Stop();
+}
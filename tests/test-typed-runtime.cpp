@@ -0,0 +1,78 @@
+#include <proto-coro/arena.hpp>
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "run-on-loop.hpp"
+
+#include <type_traits>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+struct Countdown : Pc {
+    explicit Countdown(int times) : times_(times) {
+    }
+
+    PROTO_CORO_ON(EventLoop, int) {
+        static_assert(std::is_same_v<decltype(RuntimeOf(CTX_VAR)), EventLoop*>);
+
+        PC_BEGIN;
+
+        for (i_ = 0; i_ < times_; ++i_) {
+            YIELD;
+        }
+        SLEEP_FOR(1ms);
+        return times_;
+
+        PC_END;
+    }
+
+  private:
+    int times_;
+    int i_ = 0;
+};
+
+// Only a coroutine on the same runtime can call one of those
+struct Caller : Pc {
+    PROTO_CORO_ON(EventLoop, int) {
+        PC_BEGIN;
+
+        {
+            CALL(auto res, Countdown{3});
+            return res + 1;
+        }
+
+        PC_END;
+    }
+
+  private:
+    CALLS(Countdown);
+};
+
+}  // namespace
+
+static_assert(std::is_same_v<ContextFor<Countdown>, TypedContext<EventLoop>>);
+static_assert(
+    std::is_same_v<ContextFor<WithArena<Countdown>>, TypedContext<EventLoop>>);
+static_assert(std::is_same_v<ContextFor<Sleep>, Context>);
+
+TEST_CASE("Coroutines on a known runtime compose with the plain ones") {
+    EventLoop loop{2};
+    loop.Start();
+
+    std::vector<Countdown> many(4, Countdown{10});
+    REQUIRE(RunOnLoop(loop, Caller{}) == 4);
+    REQUIRE(RunOnLoop(loop, WithArena{Countdown{5}} | FMap{[](int res) {
+                                return res * 2;
+                            }}) == 10);
+    REQUIRE(RunOnLoop(loop, WhenAll(std::move(many))) ==
+            std::vector<int>(4, 10));
+    REQUIRE(RunOnLoop(loop, Timeout(Countdown{1}, 1s)) == 1);
+
+    loop.Stop();
+}
@@ -0,0 +1,156 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/net/address.hpp>
+#include <proto-coro/net/udp.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "run-on-loop.hpp"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+RegisteredFd BindLoopback(EventLoop& loop, const UdpOptions& options = {}) {
+    auto fd = BindUdp(SocketAddress::Loopback(0), options);
+    REQUIRE(fd.has_value());
+    return RegisteredFd{std::move(*fd), &loop};
+}
+
+SocketAddress LocalOf(const RegisteredFd& fd) {
+    auto addr = SocketAddress::LocalOf(fd.AsRawFd());
+    REQUIRE(addr.has_value());
+    return *addr;
+}
+
+// Receives batches until count datagrams came, giving them in order
+struct RecvCount : Pc {
+    RecvCount(const RegisteredFd& fd, DatagramBatch& batch, size_t count)
+        : fd_(fd), batch_(batch), count_(count) {
+    }
+
+    PROTO_CORO(std::vector<std::string>) {
+        PC_BEGIN;
+
+        while (got_.size() < count_) {
+            CALL(auto n, RecvBatch(fd_, batch_));
+            if (!n.has_value()) {
+                return got_;
+            }
+            for (size_t i = 0; i < batch_.Size(); ++i) {
+                auto data = batch_.Data(i);
+                got_.emplace_back(data.data(), data.size());
+            }
+        }
+        return got_;
+
+        PC_END;
+    }
+
+  private:
+    const RegisteredFd& fd_;
+    DatagramBatch& batch_;
+    size_t count_;
+    std::vector<std::string> got_;
+    CALLS(RecvBatchOp);
+};
+
+}  // namespace
+
+TEST_CASE("Datagrams are sent and received in batches") {
+    EventLoop loop{1};
+    loop.Start();
+    auto sender = BindLoopback(loop);
+    auto receiver = BindLoopback(loop);
+
+    DatagramBatch out{16, 64};
+    std::vector<std::string> sent;
+    for (int i = 0; i < 16; ++i) {
+        sent.push_back("datagram " + std::to_string(i));
+        REQUIRE(out.Push(sent.back(), LocalOf(receiver)));
+    }
+    REQUIRE(out.Full());
+    REQUIRE_FALSE(out.Push("one too many", LocalOf(receiver)));
+    REQUIRE(RunOnLoop(loop, SendBatchAll(sender, out)) == 16);
+
+    DatagramBatch in{8, 64};
+    REQUIRE(RunOnLoop(loop, RecvCount{receiver, in, 16}) == sent);
+    REQUIRE(in.Peer(0) == LocalOf(sender));
+
+    loop.Stop();
+}
+
+TEST_CASE("Received datagrams can be sent back as they are") {
+    EventLoop loop{1};
+    loop.Start();
+    auto client = BindLoopback(loop);
+    auto server = BindLoopback(loop);
+
+    DatagramBatch out{4, 16};
+    for (auto data : {"a", "bb", "ccc"}) {
+        REQUIRE(out.Push(std::string_view{data}, LocalOf(server)));
+    }
+    REQUIRE(RunOnLoop(loop, SendBatchAll(client, out)) == 3);
+
+    DatagramBatch echo{4, 16};
+    RunOnLoop(loop, RecvCount{server, echo, 3});
+    echo.PrepareReplies();
+    REQUIRE(RunOnLoop(loop, SendBatchAll(server, echo)) == 3);
+
+    DatagramBatch in{4, 16};
+    REQUIRE(RunOnLoop(loop, RecvCount{client, in, 3}) ==
+            std::vector<std::string>{"a", "bb", "ccc"});
+
+    loop.Stop();
+}
+
+TEST_CASE("GSO splits a datagram into segments") {
+    EventLoop loop{1};
+    loop.Start();
+    auto sender = BindLoopback(loop);
+    auto receiver = BindLoopback(loop);
+
+    std::string data;
+    for (char c = 'a'; c < 'f'; ++c) {
+        data.append(100, c);
+    }
+    data.append(50, 'f');
+    DatagramBatch out{1, data.size()};
+    REQUIRE(out.Push(data, LocalOf(receiver), 100));
+    REQUIRE(out.SegmentSize(0) == 100);
+    REQUIRE(RunOnLoop(loop, SendBatchAll(sender, out)) == 1);
+
+    // Arrive as separate datagrams on a socket without GRO
+    DatagramBatch in{8, 200};
+    auto got = RunOnLoop(loop, RecvCount{receiver, in, 6});
+    REQUIRE(got.size() == 6);
+    for (size_t i = 0; i < 5; ++i) {
+        REQUIRE(got[i] == std::string(100, 'a' + i));
+    }
+    REQUIRE(got[5] == std::string(50, 'f'));
+    REQUIRE(in.SegmentSize(0) == 0);
+
+    loop.Stop();
+}
+
+TEST_CASE("Datagrams that don't fit are reported truncated") {
+    EventLoop loop{1};
+    loop.Start();
+    auto sender = BindLoopback(loop);
+    auto receiver = BindLoopback(loop);
+
+    DatagramBatch out{1, 100};
+    REQUIRE(out.Push(std::string(100, 'x'), LocalOf(receiver)));
+    REQUIRE(RunOnLoop(loop, SendBatchAll(sender, out)) == 1);
+
+    DatagramBatch in{1, 10};
+    REQUIRE(RunOnLoop(loop, RecvBatch(receiver, in)) == 1);
+    REQUIRE(in.IsTruncated(0));
+    REQUIRE(in.Data(0).size() == 10);
+
+    loop.Stop();
+}
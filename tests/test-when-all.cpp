@@ -0,0 +1,93 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "run-on-loop.hpp"
+
+#include <atomic>
+#include <string>
+#include <tuple>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+// Completes only once all of its siblings have started, so it can only finish
+// if the branches are actually interleaved
+struct Rendezvous : Pc {
+    Rendezvous(std::atomic<int>& arrived, int total, int value)
+        : arrived_(arrived), total_(total), value_(value) {
+    }
+
+    PROTO_CORO(int) {
+        PC_BEGIN;
+
+        arrived_.fetch_add(1);
+        while (arrived_.load() < total_) {
+            YIELD;
+        }
+        return value_;
+
+        PC_END;
+    }
+
+  private:
+    std::atomic<int>& arrived_;
+    int total_;
+    int value_;
+};
+
+struct Sleeper : Pc {
+    PROTO_CORO(std::string) {
+        PC_BEGIN;
+
+        SLEEP_FOR(10ms);
+        return "slept";
+
+        PC_END;
+    }
+};
+
+}  // namespace
+
+TEST_CASE("WhenAll runs branches concurrently and collects a tuple") {
+    std::atomic<int> arrived = 0;
+
+    auto [a, b, c] = RunOnLoop(WhenAll(Rendezvous{arrived, 2, 1},
+                                       Rendezvous{arrived, 2, 2}, Sleeper{}));
+
+    REQUIRE(a == 1);
+    REQUIRE(b == 2);
+    REQUIRE(c == "slept");
+}
+
+TEST_CASE("WhenAll over a vector keeps the order of outputs") {
+    constexpr int kBranches = 16;
+    std::atomic<int> arrived = 0;
+
+    std::vector<Rendezvous> coros;
+    for (int i = 0; i < kBranches; ++i) {
+        coros.emplace_back(arrived, kBranches, i);
+    }
+
+    auto outputs = RunOnLoop(WhenAll(std::move(coros)));
+
+    REQUIRE(outputs.size() == kBranches);
+    for (int i = 0; i < kBranches; ++i) {
+        REQUIRE(outputs[i] == i);
+    }
+}
+
+TEST_CASE("WhenAll over an empty vector completes immediately") {
+    struct Never : Pc {
+        PROTO_CORO(int) {
+            std::abort();
+        }
+    };
+
+    auto outputs = RunOnLoop(WhenAll(std::vector<Never>{}));
+    REQUIRE(outputs.empty());
+}
@@ -0,0 +1,215 @@
+#include <proto-coro/concur-util.hpp>
+#include <proto-coro/event-loop/event-loop.hpp>
+#include <proto-coro/event-loop/registered-fd.hpp>
+#include <proto-coro/pc.hpp>
+
+#include <catch2/catch_test_macros.hpp>
+
+#include "run-on-loop.hpp"
+
+#include <atomic>
+#include <fcntl.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace std::chrono_literals;
+
+namespace {
+
+struct Immediate : Pc {
+    explicit Immediate(int value) : value(value) {
+    }
+
+    int value;
+
+    PROTO_CORO(int) {
+        PC_BEGIN;
+
+        YIELD;
+        return value;
+
+        PC_END;
+    }
+};
+
+struct SleepThenSet : Pc {
+    SleepThenSet(Duration duration, std::atomic<bool>& resumed)
+        : duration(duration), resumed(resumed) {
+    }
+
+    Duration duration;
+    std::atomic<bool>& resumed;
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        SLEEP_FOR(duration);
+        resumed = true;
+        return Unit{};
+
+        PC_END;
+    }
+};
+
+struct ReadableThenSet : Pc {
+    ReadableThenSet(RawFd fd, std::atomic<bool>& resumed)
+        : fd(fd), resumed(resumed) {
+    }
+
+    RawFd fd;
+    std::atomic<bool>& resumed;
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        WAIT_READY(fd, InterestKind::Readable);
+        resumed = true;
+        return Unit{};
+
+        PC_END;
+    }
+};
+
+struct Tracked {
+    std::atomic<int>& alive;
+
+    explicit Tracked(std::atomic<int>& alive) : alive(alive) {
+        ++alive;
+    }
+
+    ~Tracked() {
+        --alive;
+    }
+};
+
+struct SleepForever : Pc {
+    explicit SleepForever(std::atomic<int>& alive) : alive(alive) {
+    }
+
+    std::atomic<int>& alive;
+    std::optional<Tracked> tracked;
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        tracked.emplace(alive);
+        SLEEP_FOR(1h);
+        return Unit{};
+
+        PC_END;
+    }
+};
+
+// Gets cancelled in the middle of a call
+struct CallsSleepForever : Pc {
+    explicit CallsSleepForever(std::atomic<int>& alive) : alive(alive) {
+    }
+
+    std::atomic<int>& alive;
+    CALLS(SleepForever);
+
+    PROTO_CORO(Unit) {
+        PC_BEGIN;
+
+        CALL_DISCARD(SleepForever{alive});
+        return Unit{};
+
+        PC_END;
+    }
+};
+
+struct WaitAlive : Pc {
+    explicit WaitAlive(std::atomic<int>& alive) : alive(alive) {
+    }
+
+    std::atomic<int>& alive;
+
+    PROTO_CORO(int) {
+        PC_BEGIN;
+
+        while (alive == 0) {
+            YIELD;
+        }
+        return alive;
+
+        PC_END;
+    }
+};
+
+}  // namespace
+
+TEST_CASE("WhenAny completes with the first output and withdraws timers") {
+    EventLoop loop{2};
+    loop.Start();
+
+    std::atomic<bool> resumed = false;
+    auto res =
+        RunOnLoop(loop, WhenAny(SleepThenSet{50ms, resumed}, Immediate{7}));
+
+    REQUIRE(res.index() == 1);
+    REQUIRE(std::get<1>(res) == 7);
+
+    std::this_thread::sleep_for(100ms);
+    REQUIRE(!resumed);
+
+    loop.Stop();
+}
+
+TEST_CASE("WhenAny withdraws the fd interest of a loser") {
+    EventLoop loop{2};
+    loop.Start();
+
+    int fds[2];
+    REQUIRE(pipe2(fds, O_NONBLOCK | O_CLOEXEC) == 0);
+    RegisteredFd read_end{OwnedFd::FromRaw(fds[0]), &loop};
+    OwnedFd write_end = OwnedFd::FromRaw(fds[1]);
+
+    std::atomic<bool> resumed = false;
+    auto reader = ReadableThenSet{read_end.AsRawFd(), resumed} | FMap{[](Unit) {
+                      return 0;
+                  }};
+    auto res = RunOnLoop(loop, Race(std::move(reader), Immediate{42}));
+    REQUIRE(res == 42);
+
+    REQUIRE(write(write_end.AsRawFd(), "x", 1) == 1);
+    std::this_thread::sleep_for(50ms);
+    REQUIRE(!resumed);
+
+    loop.Stop();
+}
+
+TEST_CASE("WhenAny destroys the losers cancelled in the middle of a call") {
+    EventLoop loop{2};
+    loop.Start();
+
+    std::atomic<int> alive = 0;
+    {
+        std::vector<WaitAlive> winners{WaitAlive{alive}, WaitAlive{alive}};
+        auto res = RunOnLoop(
+            loop, WhenAny(CallsSleepForever{alive},
+                          WhenAny(std::move(winners)) | FMap{[](auto res) {
+                              return res.second;
+                          }}));
+        REQUIRE(res.index() == 1);
+        REQUIRE(std::get<1>(res) == 1);
+    }
+    REQUIRE(alive == 0);
+
+    loop.Stop();
+}
+
+TEST_CASE("Cancellation of a branch propagates into nested forks") {
+    EventLoop loop{2};
+    loop.Start();
+
+    std::atomic<bool> resumed = false;
+    auto res = RunOnLoop(
+        loop, WhenAny(WhenAll(SleepThenSet{1h, resumed}, Immediate{1},
+                              SleepThenSet{1h, resumed}),
+                      SleepThenSet{10ms, resumed}));
+
+    REQUIRE(res.index() == 1);
+
+    loop.Stop();
+}